@@ -4,7 +4,7 @@
 #include <ams/fileutils.h>
 #include <ams/codetiming.h>
 
-#include "RJISMaps.h"
+#include "RJISDataset.h"
 #include "ActiveStations.h"
 #include "config.h"
 #include "RJISAnalyser.h"
@@ -18,15 +18,15 @@
 // Description: given a station which might or might be a group
 //
 //----------------------------------------------------------------------------
-void DeGroupIndividualStation(std::set<UNLC>& activeStationSet, UNLC nlc, bool decluster = true)
+void DeGroupIndividualStation(const RJISDataset& dataset, std::set<UNLC>& activeStationSet, UNLC nlc, bool decluster = true)
 {
     bool clusterFound = false;
     if (decluster)
     {
         // is the NLC a cluster? If it is then add all stations that are members of
         // that cluster:
-        auto it = RJISMaps::decluster.find(nlc);
-        if (it != RJISMaps::decluster.end())
+        auto it = dataset.decluster.find(nlc);
+        if (it != dataset.decluster.end())
         {
             // mark the fact that we found a cluster:
             clusterFound = true;
@@ -34,8 +34,8 @@ void DeGroupIndividualStation(std::set<UNLC>& activeStationSet, UNLC nlc, bool d
             for (auto clusterMember : it->second)
             {
                 // the cluster member might be a group station - search in the group map:
-                auto groupit = RJISMaps::degroup.find(clusterMember);
-                if (groupit != RJISMaps::degroup.end())
+                auto groupit = dataset.degroup.find(clusterMember);
+                if (groupit != dataset.degroup.end())
                 {
                     // yes, it's a group station, so add all the group members to the active station set:
                     for (auto degroupedStation : groupit->second)
@@ -55,8 +55,8 @@ void DeGroupIndividualStation(std::set<UNLC>& activeStationSet, UNLC nlc, bool d
     // if we DIDN'T find a cluster then we must check to see if the NLC is a group station:
     if (!clusterFound)
     {
-        auto groupit = RJISMaps::degroup.find(nlc);
-        if (groupit != RJISMaps::degroup.end())
+        auto groupit = dataset.degroup.find(nlc);
+        if (groupit != dataset.degroup.end())
         {
             // yes, it's a group station, so add all the group members to the active station set
             // (here we are iterating along a vector):
@@ -83,30 +83,30 @@ void DeGroupIndividualStation(std::set<UNLC>& activeStationSet, UNLC nlc, bool d
 //              or NFO files. These
 //
 //----------------------------------------------------------------------------
-ActiveStations::ActiveStations()
+ActiveStations::ActiveStations(const RJISDataset& dataset) : dataset_(dataset)
 {
     // for all flows in the main flow map:
-    for (auto p : RJISMaps::flowMainFlows)
+    for (auto p : dataset.flowMainFlows)
     {
         // expand all flows with this origin:
-        DeGroupIndividualStation(activeStationSet_, p.first.origin);
+        DeGroupIndividualStation(dataset, activeStationSet_, p.first.origin);
         // expand all flows with this destination:
-        DeGroupIndividualStation(activeStationSet_, p.first.destination);
+        DeGroupIndividualStation(dataset, activeStationSet_, p.first.destination);
     }
 
     PP(activeStationSet_.size());
     // for all NDFs in the NDF map:
-    for (auto p : RJISMaps::ndfMain)
+    for (auto p : dataset.ndfMain)
     {
-        DeGroupIndividualStation(activeStationSet_, p.first.origin);
-        DeGroupIndividualStation(activeStationSet_, p.first.destination);
+        DeGroupIndividualStation(dataset, activeStationSet_, p.first.origin);
+        DeGroupIndividualStation(dataset, activeStationSet_, p.first.destination);
     }
 
     // for all NFOs in the NFO map:
-    for (auto p : RJISMaps::nfoMain)
+    for (auto p : dataset.nfoMain)
     {
-        DeGroupIndividualStation(activeStationSet_, p.first.origin);
-        DeGroupIndividualStation(activeStationSet_, p.first.destination);
+        DeGroupIndividualStation(dataset, activeStationSet_, p.first.origin);
+        DeGroupIndividualStation(dataset, activeStationSet_, p.first.destination);
     }
 }
 
@@ -226,13 +226,13 @@ void CloseFilteredFiles(const NLCHANDLEFOLDERMAP& nlcToHandleMap)
 //              the F-records.
 //
 //----------------------------------------------------------------------------
-void WriteFFLFiles(const NLCHANDLEFOLDERMAP& nlcToHandleMap)
+void WriteFFLFiles(const RJISDataset& dataset, const NLCHANDLEFOLDERMAP& nlcToHandleMap)
 {
     // A set to store the flowIDs of used T records, per NLC
     std::map<UNLC, std::set<int>> usedFlowIDsPerNLC;
 
     int count = 0;
-    for (auto ffl : RJISMaps::flowMainFlows)
+    for (auto ffl : dataset.flowMainFlows)
     {
         if (count % 100000 == 99999)
         {
@@ -240,7 +240,7 @@ void WriteFFLFiles(const NLCHANDLEFOLDERMAP& nlcToHandleMap)
         }
         // we degroup the origin then decluster it:
         std::set<UNLC> usedNLCs;
-        DeGroupIndividualStation(usedNLCs, ffl.first.origin);
+        DeGroupIndividualStation(dataset, usedNLCs, ffl.first.origin);
         // write the flow record to all flow files:
         for (auto usedNLC : usedNLCs)
         {
@@ -285,7 +285,7 @@ void WriteFFLFiles(const NLCHANDLEFOLDERMAP& nlcToHandleMap)
         for (auto flowid : originMapEntry.second)
         {
             // get all the matching T-records:
-            auto matchingTrecords = RJISMaps::flowMainFares.equal_range(flowid);
+            auto matchingTrecords = dataset.flowMainFares.equal_range(flowid);
             // for each T-record in the set of matching T-records:
             for (auto trecord = matchingTrecords.first; trecord != matchingTrecords.second; ++trecord)
             {
@@ -315,11 +315,11 @@ void WriteFFLFiles(const NLCHANDLEFOLDERMAP& nlcToHandleMap)
 // Description: Write each single-origin NDF file to its appropriate folder.
 //
 //----------------------------------------------------------------------------
-void WriteNDFFiles(const NLCHANDLEFOLDERMAP& nlcToHandleMap)
+void WriteNDFFiles(const RJISDataset& dataset, const NLCHANDLEFOLDERMAP& nlcToHandleMap)
 {
 
     int count = 0;
-    for (auto ndf : RJISMaps::ndfMain)
+    for (auto ndf : dataset.ndfMain)
     {
         if (count % 100000 == 99999)
         {
@@ -328,7 +328,7 @@ void WriteNDFFiles(const NLCHANDLEFOLDERMAP& nlcToHandleMap)
         
         // we degroup the origin (it might be a group station but it cannot be a cluster)
         std::set<UNLC> usedNLCs;
-        DeGroupIndividualStation(usedNLCs, ndf.first.origin, false);
+        DeGroupIndividualStation(dataset, usedNLCs, ndf.first.origin, false);
 
         // write the flow record to all flow files:
         for (auto usedNLC : usedNLCs)
@@ -368,10 +368,10 @@ void WriteNDFFiles(const NLCHANDLEFOLDERMAP& nlcToHandleMap)
 //
 //----------------------------------------------------------------------------
 
-void WriteNFOFiles(const NLCHANDLEFOLDERMAP& nlcToHandleMap)
+void WriteNFOFiles(const RJISDataset& dataset, const NLCHANDLEFOLDERMAP& nlcToHandleMap)
 {
     int count = 0;
-    for (auto nfo : RJISMaps::nfoMain)
+    for (auto nfo : dataset.nfoMain)
     {
         if (count % 100000 == 99999)
         {
@@ -380,7 +380,7 @@ void WriteNFOFiles(const NLCHANDLEFOLDERMAP& nlcToHandleMap)
 
         // we degroup the origin (it might be a group station but it cannot be a cluster)
         std::set<UNLC> usedNLCs;
-        DeGroupIndividualStation(usedNLCs, nfo.first.origin, false);
+        DeGroupIndividualStation(dataset, usedNLCs, nfo.first.origin, false);
         // write the flow record to all flow files:
         for (auto usedNLC : usedNLCs)
         {
@@ -479,15 +479,15 @@ void ActiveStations::MakeFilteredSets()
     {
         try
         {
-            auto& locit = RJISMaps::locations.find(thisNLC);
-            if (locit == RJISMaps::locations.end())
+            auto locit = dataset_.locations.find(thisNLC);
+            if (locit == dataset_.locations.end())
             {
                 throw QException("Cannot find NLC "s + thisNLC.GetString() + " in locations file.");
             }
 
             // check the station has a CRS code - if it does, the folder name is CRS-NLC - e.g.
             // POO-5883 for Poole:
-            CRSCode& crs = locit->second.crsCode_;
+            const CRSCode& crs = locit->second.crsCode_;
             if (isalpha(crs[0]) && isalpha(crs[1]) && isalpha(crs[2]))
             {
                 // concatenate CRS and NLC to form folder name:
@@ -530,19 +530,19 @@ void ActiveStations::MakeFilteredSets()
     // quickly to any station output file that requires that fare:
     CreateFilteredFiles(nlcToHandleMap, fflFilename);
     std::cout << "FFL files opened\n";
-    WriteFFLFiles(nlcToHandleMap);
+    WriteFFLFiles(dataset_, nlcToHandleMap);
     CloseFilteredFiles(nlcToHandleMap);
     std::cout << "FFL files closed\n";
 
     CreateFilteredFiles(nlcToHandleMap, ndfFilename);
     std::cout << "NDF files opened\n";
-    WriteNDFFiles(nlcToHandleMap);
+    WriteNDFFiles(dataset_, nlcToHandleMap);
     CloseFilteredFiles(nlcToHandleMap);
     std::cout << "NDF files closed\n";
 
     CreateFilteredFiles(nlcToHandleMap, nfoFilename);
     std::cout << "NFO files opened\n";
-    WriteNFOFiles(nlcToHandleMap);
+    WriteNFOFiles(dataset_, nlcToHandleMap);
     CloseFilteredFiles(nlcToHandleMap);
     std::cout << "NFO files closed\n";
 
@@ -1,10 +1,12 @@
 #pragma once
+#include "RJISDataset.h"
 
 class ActiveStations
 {
+    const RJISDataset& dataset_;
     std::set<UNLC> activeStationSet_;
 public:
-    ActiveStations();
+    ActiveStations(const RJISDataset& dataset);
     void GetList(std::set<UNLC>& activeStationSet) const;
     void MakeFilteredSets();
     virtual ~ActiveStations(){}
@@ -0,0 +1,568 @@
+#include "stdafx.h"
+#include "ChangeSet.h"
+#include "SourceReader.h"
+#include "LineParsers.h"
+
+namespace LP = LineParsers; // namespace alias
+
+namespace {
+
+// 64 bit FNV-1a:
+inline uint64_t GetLineHash(const std::string& line)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (auto c : line)
+    {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// keys are at most eight characters and never contain a null:
+inline uint64_t PackKey(const std::string& key)
+{
+    uint64_t result = 0;
+    for (size_t i = 0; i < 8; ++i)
+    {
+        result = (result << 8) | (i < key.length() ? static_cast<unsigned char>(key[i]) : 0);
+    }
+    return result;
+}
+
+std::string UnpackKey(uint64_t packed)
+{
+    std::string result;
+    for (int shift = 56; shift >= 0 && static_cast<char>(packed >> shift) != 0; shift -= 8)
+    {
+        result += static_cast<char>(packed >> shift);
+    }
+    return result;
+}
+
+// the groups (flows or fare groups) whose members are not the same, in the same order, in two versions of a file. The
+// lists are of group and member in file order:
+template <class Group, class Member> std::set<Group> GetReorderedGroups(
+    std::vector<std::pair<Group, Member>> oldOrder,
+    std::vector<std::pair<Group, Member>> newOrder)
+{
+    auto byGroup = [](const std::pair<Group, Member>& a, const std::pair<Group, Member>& b) { return a.first < b.first; };
+    std::stable_sort(oldOrder.begin(), oldOrder.end(), byGroup);
+    std::stable_sort(newOrder.begin(), newOrder.end(), byGroup);
+
+    std::set<Group> result;
+    auto p = oldOrder.begin();
+    auto q = newOrder.begin();
+    while (p != oldOrder.end() || q != newOrder.end())
+    {
+        // the lowest group in either list - the entries for it are at the front of each list:
+        Group group = (q == newOrder.end() || (p != oldOrder.end() && p->first < q->first)) ? p->first : q->first;
+        auto oldEnd = p;
+        while (oldEnd != oldOrder.end() && !(group < oldEnd->first))
+        {
+            ++oldEnd;
+        }
+        auto newEnd = q;
+        while (newEnd != newOrder.end() && !(group < newEnd->first))
+        {
+            ++newEnd;
+        }
+        if (!std::equal(p, oldEnd, q, newEnd, [](const std::pair<Group, Member>& a, const std::pair<Group, Member>& b) {
+            return a.second == b.second;
+        }))
+        {
+            result.insert(group);
+        }
+        p = oldEnd;
+        q = newEnd;
+    }
+    return result;
+}
+
+}
+
+/* static */
+bool ChangeSet::CanApply(const std::string& type)
+{
+    static const std::set<std::string> types{ "FFL", "NDF", "NFO", "TTY", "RLC", "LOC" };
+    return types.find(type) != types.end();
+}
+
+// the key for a record - empty if the line is not a record we load:
+/* static */
+std::string ChangeSet::GetRecordKey(const std::string& type, const std::string& line)
+{
+    std::string result;
+    if (type == "NDF" || type == "NFO")
+    {
+        if (LP::IsNDFRecord(line))
+        {
+            result = line.substr(1, 8);
+        }
+    }
+    else if (type == "FFL")
+    {
+        // flows and their fares are both keyed by the flow ID:
+        if (LP::IsFlowRecord(line))
+        {
+            result = line.substr(42, 7);
+        }
+        else if (LP::IsFareRecord(line))
+        {
+            result = line.substr(2, 7);
+        }
+    }
+    else if (type == "TTY")
+    {
+        if (LP::IsTicketTypeRecord(line))
+        {
+            result = line.substr(1, 3);
+        }
+    }
+    else if (type == "RLC")
+    {
+        if (LP::IsRailcardRecord(line))
+        {
+            result = line.substr(0, 3);
+        }
+    }
+    else if (type == "LOC")
+    {
+        if (LP::IsLocationRecord(line))
+        {
+            result = line.substr(36, 4);
+        }
+    }
+    return result;
+}
+
+// add a line of one version of a file - the key and hash of a record we load and, for the FFL and LOC files, the order
+// of the flows and group members it gives. Other files are only compared as a whole:
+/* static */
+void ChangeSet::AddLine(const std::string& type, FileVersion& version, const std::string& line)
+{
+    if (!CanApply(type))
+    {
+        version.fileHash = version.fileHash * 1099511628211ull + GetLineHash(line);
+        ++version.lines;
+        return;
+    }
+
+    auto key = GetRecordKey(type, line);
+    if (key.empty())
+    {
+        return;
+    }
+    version.records.push_back(RecordHash{ PackKey(key), GetLineHash(line) });
+    if (type == "FFL" && LP::IsFlowRecord(line))
+    {
+        // as stored by a full read - in both directions if the flow is reversible:
+        UFlow flow;
+        flow.Set(line, 2);
+        int flowid = std::stoi(key);
+        version.flowOrder.push_back(std::make_pair(flow, flowid));
+        if (line[19] == 'R')
+        {
+            flow.Reverse();
+            version.flowOrder.push_back(std::make_pair(flow, flowid));
+        }
+    }
+    else if (type == "LOC")
+    {
+        UNLC station(line, 36);
+        for (auto& group : LP::GetLocationGroups(line))
+        {
+            version.memberOrder.push_back(std::make_pair(group, station));
+        }
+    }
+}
+
+void ChangeSet::Add(const std::string& type, const std::string& oldFilename, const std::string& newFilename)
+{
+    auto& changes = files_[type];
+    changes.oldFilename = oldFilename;
+    changes.newFilename = newFilename;
+}
+
+std::vector<HANDLE> ChangeSet::StartReading()
+{
+    std::vector<HANDLE> events;
+    FileReaderQueue& queue = FileReaderQueue::GetInstance();
+    auto read = [&events, &queue](const std::string& type, const std::string& filename, FileVersion& version) {
+        HANDLE event = CreateEvent(0, FALSE, FALSE, 0);
+        queue.Add(SourceReader(filename, [type, &version](std::string line) {
+            AddLine(type, version, line);
+        }, event));
+        events.push_back(event);
+    };
+    for (auto& p : files_)
+    {
+        read(p.first, p.second.oldFilename, p.second.oldVersion);
+        read(p.first, p.second.newFilename, p.second.newVersion);
+    }
+    return events;
+}
+
+// find the keys whose records differ in the two versions of a file - in number, content or order. The records for each
+// key are compared in file order:
+/* static */
+void ChangeSet::FindChangedKeys(FileChanges& changes)
+{
+    auto& oldRecords = changes.oldVersion.records;
+    auto& newRecords = changes.newVersion.records;
+    auto byKey = [](const RecordHash& a, const RecordHash& b) { return a.key < b.key; };
+    std::stable_sort(oldRecords.begin(), oldRecords.end(), byKey);
+    std::stable_sort(newRecords.begin(), newRecords.end(), byKey);
+
+    auto sameHash = [](const RecordHash& a, const RecordHash& b) { return a.hash == b.hash; };
+    auto p = oldRecords.begin();
+    auto q = newRecords.begin();
+    while (p != oldRecords.end() || q != newRecords.end())
+    {
+        uint64_t key = (q == newRecords.end() || (p != oldRecords.end() && p->key < q->key)) ? p->key : q->key;
+        auto oldEnd = std::find_if(p, oldRecords.end(), [key](const RecordHash& r) { return r.key != key; });
+        auto newEnd = std::find_if(q, newRecords.end(), [key](const RecordHash& r) { return r.key != key; });
+        if (!std::equal(p, oldEnd, q, newEnd, sameHash))
+        {
+            changes.keys.insert(UnpackKey(key));
+
+            // count the old records with no match in the new ones - the same record may be there more than once:
+            std::vector<uint64_t> oldHashes, newHashes;
+            std::transform(p, oldEnd, std::back_inserter(oldHashes), [](const RecordHash& r) { return r.hash; });
+            std::transform(q, newEnd, std::back_inserter(newHashes), [](const RecordHash& r) { return r.hash; });
+            std::sort(oldHashes.begin(), oldHashes.end());
+            std::sort(newHashes.begin(), newHashes.end());
+            std::vector<uint64_t> removed;
+            std::set_difference(oldHashes.begin(), oldHashes.end(), newHashes.begin(), newHashes.end(), std::back_inserter(removed));
+            changes.removed += removed.size();
+        }
+        p = oldEnd;
+        q = newEnd;
+    }
+}
+
+// the flows to store again - those with a changed flow ID in either version of the file and those whose flow IDs are
+// in a different order. The flows for an origin and destination are kept in file order by the multimap:
+/* static */
+void ChangeSet::FindFlowChanges(FileChanges& changes)
+{
+    std::set<int> flowids;
+    for (auto& key : changes.keys)
+    {
+        flowids.insert(std::stoi(key));
+    }
+    for (auto order : { &changes.oldVersion.flowOrder, &changes.newVersion.flowOrder })
+    {
+        for (auto& entry : *order)
+        {
+            if (flowids.find(entry.second) != flowids.end())
+            {
+                changes.flows.insert(entry.first);
+            }
+        }
+    }
+    for (auto& flow : GetReorderedGroups(changes.oldVersion.flowOrder, changes.newVersion.flowOrder))
+    {
+        changes.flows.insert(flow);
+    }
+}
+
+// the groups and counties whose members are listed again - those with a changed station as a member in either version of
+// the file and those whose members are in a different order. The groups each changed station was in are kept so that
+// only those memberships are taken out of the dataset:
+/* static */
+void ChangeSet::FindLocationChanges(FileChanges& changes)
+{
+    std::set<UNLC> stations;
+    for (auto& key : changes.keys)
+    {
+        stations.insert(UNLC(key, 0));
+    }
+    for (auto& entry : changes.oldVersion.memberOrder)
+    {
+        if (stations.find(entry.second) != stations.end())
+        {
+            changes.oldMemberships[entry.second].insert(entry.first);
+            changes.groups.insert(entry.first);
+        }
+    }
+    for (auto& entry : changes.newVersion.memberOrder)
+    {
+        if (stations.find(entry.second) != stations.end())
+        {
+            changes.groups.insert(entry.first);
+        }
+    }
+    for (auto& group : GetReorderedGroups(changes.oldVersion.memberOrder, changes.newVersion.memberOrder))
+    {
+        changes.groups.insert(group);
+    }
+}
+
+bool ChangeSet::Compare(std::string& type)
+{
+    for (auto p = files_.begin(); p != files_.end();)
+    {
+        auto& changes = p->second;
+        if (!CanApply(p->first))
+        {
+            if (changes.oldVersion.fileHash != changes.newVersion.fileHash || changes.oldVersion.lines != changes.newVersion.lines)
+            {
+                type = p->first;
+                return false;
+            }
+        }
+        else
+        {
+            FindChangedKeys(changes);
+            if (p->first == "FFL")
+            {
+                FindFlowChanges(changes);
+            }
+            else if (p->first == "LOC")
+            {
+                FindLocationChanges(changes);
+            }
+        }
+
+        // only the order of the new file is needed to apply the changes:
+        changes.oldVersion = FileVersion();
+        changes.newVersion.records = std::vector<RecordHash>();
+        if (changes.keys.empty() && changes.flows.empty() && changes.groups.empty())
+        {
+            p = files_.erase(p);
+        }
+        else
+        {
+            ++p;
+        }
+    }
+    return true;
+}
+
+std::vector<HANDLE> ChangeSet::StartReadingRecords()
+{
+    std::vector<HANDLE> events;
+    FileReaderQueue& queue = FileReaderQueue::GetInstance();
+    for (auto& p : files_)
+    {
+        auto& type = p.first;
+        auto& changes = p.second;
+        if (!changes.keys.empty())
+        {
+            HANDLE event = CreateEvent(0, FALSE, FALSE, 0);
+            queue.Add(SourceReader(changes.newFilename, [type, &changes, linenumber = 0](std::string line) mutable {
+                auto key = GetRecordKey(type, line);
+                if (!key.empty() && changes.keys.find(key) != changes.keys.end())
+                {
+                    changes.records.push_back(Record{ linenumber, line });
+                }
+                ++linenumber;
+            }, event));
+            events.push_back(event);
+        }
+    }
+    return events;
+}
+
+void ChangeSet::Apply(RJISDataset& dataset) const
+{
+    for (auto& p : files_)
+    {
+        auto& type = p.first;
+        auto& changes = p.second;
+        if (type == "FFL")
+        {
+            ApplyFlowChanges(dataset, changes);
+        }
+        else if (type == "NDF")
+        {
+            ApplyNDFChanges(dataset.ndfMain, changes);
+        }
+        else if (type == "NFO")
+        {
+            ApplyNDFChanges(dataset.nfoMain, changes);
+        }
+        else if (type == "TTY")
+        {
+            for (auto& key : changes.keys)
+            {
+                dataset.ticketTypes.erase(TicketCode(key, 0));
+            }
+            for (auto& record : changes.records)
+            {
+                LP::AddTicketTypeRecord(dataset, record.line);
+            }
+        }
+        else if (type == "RLC")
+        {
+            for (auto& key : changes.keys)
+            {
+                dataset.railcards.erase(RailcardCode(key, 0));
+            }
+            for (auto& record : changes.records)
+            {
+                LP::AddRailcardRecord(dataset, record.line);
+            }
+        }
+        else if (type == "LOC")
+        {
+            ApplyLocationChanges(dataset, changes);
+        }
+    }
+
+    // the destination indexes are built again in map order, as in a full read, if any of their maps have changed:
+    if (files_.find("FFL") != files_.end() || files_.find("NDF") != files_.end() || files_.find("NFO") != files_.end())
+    {
+        dataset.BuildDestinationIndexes();
+    }
+
+    // the validity indexes are small - build them again if their tables have changed:
+    if (files_.find("TTY") != files_.end() || files_.find("RLC") != files_.end())
+    {
+        dataset.BuildValidityIndexes();
+    }
+}
+
+// Replace the fares for the changed flow IDs and store the flows listed again in the order of the new file. As in a full
+// read, a flow is only stored if it has fares:
+void ChangeSet::ApplyFlowChanges(RJISDataset& dataset, const FileChanges& changes) const
+{
+    std::set<int> flowids;
+    for (auto& key : changes.keys)
+    {
+        flowids.insert(std::stoi(key));
+    }
+
+    // take out everything stored for the flows listed, keeping the flows with unchanged flow IDs to store again:
+    std::map<int, RJISTypes::FFLFlowMainValue> unchanged;
+    for (auto& flow : changes.flows)
+    {
+        auto range = dataset.flowMainFlows.equal_range(flow);
+        for (auto p = range.first; p != range.second; ++p)
+        {
+            if (flowids.find(p->second.flowid_) == flowids.end())
+            {
+                unchanged.insert(std::make_pair(p->second.flowid_, p->second));
+            }
+        }
+        dataset.flowMainFlows.erase(range.first, range.second);
+    }
+    for (auto flowid : flowids)
+    {
+        dataset.flowMainFares.erase(flowid);
+    }
+
+    // fares first so that we know which flows to store:
+    std::map<int, RJISTypes::FFLFlowMainValue> changed;
+    for (auto& record : changes.records)
+    {
+        if (LP::IsFareRecord(record.line))
+        {
+            RJISTypes::FFLFareMainValue value(record.line, 9);
+            dataset.flowMainFares.insert(std::make_pair(std::stoi(record.line.substr(2, 7)), value));
+        }
+        else if (LP::IsFlowRecord(record.line))
+        {
+            RJISTypes::FFLFlowMainValue value(record.line, 10);
+            changed.insert(std::make_pair(value.flowid_, value));
+        }
+    }
+    for (auto& entry : changes.newVersion.flowOrder)
+    {
+        if (changes.flows.find(entry.first) != changes.flows.end() &&
+            dataset.flowMainFares.find(entry.second) != dataset.flowMainFares.end())
+        {
+            auto& values = flowids.find(entry.second) != flowids.end() ? changed : unchanged;
+            auto p = values.find(entry.second);
+            if (p != values.end())
+            {
+                dataset.flowMainFlows.insert(std::make_pair(entry.first, p->second));
+            }
+        }
+    }
+}
+
+// Replace the NDFs (or NFOs) for the changed flows. They keep their line numbers in the new file:
+void ChangeSet::ApplyNDFChanges(std::multimap<UFlow, RJISTypes::NDFMainValue>& ndfs, const FileChanges& changes) const
+{
+    for (auto& key : changes.keys)
+    {
+        UFlow flow;
+        flow.Set(key, 0);
+        ndfs.erase(flow);
+    }
+    for (auto& record : changes.records)
+    {
+        UFlow flow;
+        flow.Set(record.line, 1);
+        RJISTypes::NDFMainValue value(record.line, 9);
+        value.linenumber = record.linenumber; // AMS debug
+        ndfs.insert(std::make_pair(flow, value));
+    }
+}
+
+// Replace the locations for the changed NLCs. A location is also a member of its fare group and county - only the
+// memberships its old L-records gave it are taken out, and the members of each group listed are put back in the
+// order of the new file:
+void ChangeSet::ApplyLocationChanges(RJISDataset& dataset, const FileChanges& changes) const
+{
+    for (auto& key : changes.keys)
+    {
+        UNLC nlc(key, 0);
+        auto p = dataset.groups.find(nlc);
+        auto memberships = changes.oldMemberships.find(nlc);
+        if (p != dataset.groups.end() && memberships != changes.oldMemberships.end())
+        {
+            for (auto& group : memberships->second)
+            {
+                p->second.erase(group);
+            }
+            if (p->second.empty())
+            {
+                dataset.groups.erase(p);
+            }
+        }
+        dataset.locations.erase(nlc);
+    }
+    for (auto& record : changes.records)
+    {
+        LP::AddLocationRecord(dataset, record.line);
+    }
+
+    for (auto& group : changes.groups)
+    {
+        dataset.degroup.erase(group);
+    }
+    for (auto& entry : changes.newVersion.memberOrder)
+    {
+        if (changes.groups.find(entry.first) != changes.groups.end())
+        {
+            dataset.degroup[entry.first].push_back(entry.second);
+        }
+    }
+}
+
+bool ChangeSet::IsEmpty() const
+{
+    return files_.empty();
+}
+
+size_t ChangeSet::GetRemovedCount() const
+{
+    size_t result = 0;
+    for (auto& p : files_)
+    {
+        result += p.second.removed;
+    }
+    return result;
+}
+
+size_t ChangeSet::GetRecordCount() const
+{
+    size_t result = 0;
+    for (auto& p : files_)
+    {
+        result += p.second.records.size();
+    }
+    return result;
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include "RJISDataset.h"
+
+// ChangeSet - the record-level differences between two versions of the RJIS files and the means to apply them to a
+// dataset loaded from the old versions. Most consecutive RJIS sets differ in a small fraction of their records so
+// patching a dataset costs far less than reading the whole set again.
+//
+// Records are grouped by key - the flow for NDF and NFO records, the flow ID for FFL flow and fare records, the
+// ticket code, railcard code or NLC for TTY, RLC and LOC records. Where the records for a key differ in any way -
+// added, removed or only in a different order - every record for that key is replaced by the records for the key in
+// the new file, in file order. Some orders depend on records with different keys: the flows for an origin and
+// destination (which may have several flow IDs) and the members of a fare group or county (which are stations with
+// different NLCs). These are compared too and rebuilt in the order of the new file where they differ, so the patched
+// dataset is the same as a full read of the new files would give.
+//
+// Both versions of every file are read once, all at the same time, on the reader threads. The new version of a file
+// with changes is read a second time for the records with the changed keys.
+//
+// Records are compared by a 64 bit hash of the whole line so two different records with the same hash would be
+// taken as the same record. For a file of ten million records the chance of this is a few in a million.
+class ChangeSet
+{
+    // the key and the hash of a record - the key is up to eight characters packed into an integer:
+    struct RecordHash
+    {
+        uint64_t key;
+        uint64_t hash;
+    };
+
+    // what we keep of one version of a file after reading it:
+    struct FileVersion
+    {
+        std::vector<RecordHash> records;                    // in file order
+        std::vector<std::pair<UFlow, int>> flowOrder;       // FFL - the flow and flow ID stored for each flow record
+        std::vector<std::pair<UNLC, UNLC>> memberOrder;     // LOC - the group and station for each group membership
+        uint64_t fileHash = 0;                              // other files - the hash of every line
+        size_t lines = 0;
+    };
+
+    struct Record
+    {
+        int linenumber;                         // line number in the new file - the NDF and NFO records keep it
+        std::string line;
+    };
+
+    struct FileChanges
+    {
+        std::string oldFilename;
+        std::string newFilename;
+        FileVersion oldVersion;
+        FileVersion newVersion;
+        std::set<std::string> keys;             // the keys for which the records differ
+        size_t removed = 0;                     // records only in the old file
+        std::vector<Record> records;            // every record in the new file with one of the keys, in file order
+        std::set<UFlow> flows;                  // FFL - the flows to store again in the order of the new file
+        std::set<UNLC> groups;                  // LOC - the groups whose members are listed again in file order
+        std::map<UNLC, std::set<UNLC>> oldMemberships;      // LOC - the groups of each changed station in the old file
+    };
+
+    std::map<std::string, FileChanges> files_;  // by file type (RJIS file extension)
+
+    static std::string GetRecordKey(const std::string& type, const std::string& line);
+    static void AddLine(const std::string& type, FileVersion& version, const std::string& line);
+    static void FindChangedKeys(FileChanges& changes);
+    static void FindFlowChanges(FileChanges& changes);
+    static void FindLocationChanges(FileChanges& changes);
+    void ApplyFlowChanges(RJISDataset& dataset, const FileChanges& changes) const;
+    void ApplyNDFChanges(std::multimap<UFlow, RJISTypes::NDFMainValue>& ndfs, const FileChanges& changes) const;
+    void ApplyLocationChanges(RJISDataset& dataset, const FileChanges& changes) const;
+public:
+    // true if changes to files of this type (FFL, NDF etc.) can be applied to a dataset:
+    static bool CanApply(const std::string& type);
+
+    // add the old and new versions of a file to be compared:
+    void Add(const std::string& type, const std::string& oldFilename, const std::string& newFilename);
+
+    // queue both versions of every file added for the reader threads. Returns the events set when each file has been
+    // read - the change set must not be changed or destroyed until they are all set:
+    std::vector<HANDLE> StartReading();
+
+    // once the files have been read, compare the old and new versions. Returns false if a file differs and its
+    // changes cannot be applied, in which case the dataset must be loaded in full:
+    bool Compare(
+        std::string& type                       // OUTPUT. The type of a file that cannot be patched
+    );
+
+    // queue the new version of every file with changes to read the records with the changed keys - as above the events
+    // returned must all be set before the change set is used:
+    std::vector<HANDLE> StartReadingRecords();
+
+    // patch a dataset loaded from the old files so that it is the same as one loaded from the new files. The dataset
+    // must not be published. If this throws the dataset is left part patched and must be discarded:
+    void Apply(RJISDataset& dataset) const;
+
+    bool IsEmpty() const;
+
+    // the number of records removed and the number of records read again:
+    size_t GetRemovedCount() const;
+    size_t GetRecordCount() const;
+};
@@ -0,0 +1,321 @@
+#include "stdafx.h"
+#include "ConnectionScan.h"
+
+namespace {
+
+const uint16_t noTime = 0xFFFF;
+const uint32_t none = 0xFFFFFFFF;
+
+// a journey to the destination in a station's profile - leaving by one connection (enter) and changing or arriving
+// after another on the same trip (exit):
+struct ProfileEntry
+{
+    uint16_t departure;
+    uint16_t arrival;
+    uint32_t enter;
+    uint32_t exit;
+};
+
+// a station's profile is in the order the entries were found - latest departure first, each arriving earlier than the
+// one before. The entry to use when ready to leave at a time is the last one leaving at or after it:
+const ProfileEntry* FindProfileEntry(const std::vector<ProfileEntry>& profile, uint16_t ready)
+{
+    auto p = std::partition_point(profile.begin(), profile.end(), [ready](const ProfileEntry& entry) {return entry.departure >= ready;});
+    return p == profile.begin() ? nullptr : &*(p - 1);
+}
+}
+
+void ConnectionScan::Build(const Timetable& timetable, const TimetableIndex& index, const ServiceCalendar& calendar,
+    const std::map<CRSCode, uint16_t>& changeTimes)
+{
+    timetable_ = &timetable;
+    index_ = &index;
+    calendar_ = &calendar;
+
+    changeTimes_.assign(index.GetStationCount(), RaptorPlanner::defaultChangeTime);
+    for (size_t station = 0; station < changeTimes_.size(); ++station)
+    {
+        auto p = changeTimes.find(index.GetStation(station));
+        if (p != changeTimes.end())
+        {
+            changeTimes_[station] = p->second;
+        }
+    }
+    cache_.Clear();
+}
+
+std::shared_ptr<const ConnectionScan::ConnectionDay> ConnectionScan::MakeConnectionDay(const RJISDate::Date& date) const
+{
+    auto& timetable = *timetable_;
+    auto day = std::make_shared<ConnectionDay>();
+
+    // the trains of the day before after midnight, the trains of the day and the trains of the next day in its first
+    // hours - the departures taken from each are from fromMinutes up to toMinutes of its own service day:
+    struct Part
+    {
+        RJISDate::Date date;
+        int offset;
+        uint16_t fromMinutes;
+        uint16_t toMinutes;
+    };
+    const Part parts[] = {
+        { date + (-1), -1440, 1440, noTime },
+        { date, 0, 0, noTime },
+        { date + 1, 1440, 0, nextDayMinutes },
+    };
+
+    // each run is looked at once for all three parts - its call times and stations are found once into buffers reused
+    // from run to run. The connections and trips of each part are kept apart and joined in part order so that the
+    // connections are in the same order as if each part were made in turn:
+    const size_t partCount = sizeof parts / sizeof parts[0];
+    std::shared_ptr<const ServiceCalendar::ServiceDay> serviceDays[partCount];
+    std::vector<ConnectionDay::Connection> partConnections[partCount];
+    std::vector<uint32_t> partTrips[partCount];
+    for (size_t p = 0; p < partCount; ++p)
+    {
+        serviceDays[p] = calendar_->GetServiceDay(parts[p].date);
+    }
+
+    std::vector<std::pair<uint16_t, uint16_t>> times;
+    std::vector<uint32_t> stations;
+    for (uint32_t run = 0; run < timetable.GetRunCount(); ++run)
+    {
+        auto runView = timetable[run];
+        if (runView.GetCallCount() < 2)
+        {
+            continue;
+        }
+        bool haveCalls = false;
+        for (size_t p = 0; p < partCount; ++p)
+        {
+            if (!serviceDays[p]->IsRunning(run))
+            {
+                continue;
+            }
+            if (!haveCalls)
+            {
+                runView.GetCallTimes(times);
+                stations.clear();
+                for (size_t i = 0; i < runView.GetCallCount(); ++i)
+                {
+                    stations.push_back(static_cast<uint32_t>(index_->FindStation(runView.GetCRS(i))));
+                }
+                haveCalls = true;
+            }
+            auto& part = parts[p];
+            auto trip = none;
+            for (uint16_t i = 0; i + 1 < runView.GetCallCount(); ++i)
+            {
+                if (times[i].second >= part.fromMinutes && times[i].second < part.toMinutes)
+                {
+                    if (trip == none)
+                    {
+                        trip = static_cast<uint32_t>(partTrips[p].size());
+                        partTrips[p].push_back(run);
+                    }
+                    partConnections[p].push_back(ConnectionDay::Connection{
+                        static_cast<uint16_t>(times[i].second + part.offset),
+                        static_cast<uint16_t>(times[i + 1].first + part.offset),
+                        stations[i],
+                        stations[i + 1],
+                        trip,
+                        i });
+                }
+            }
+        }
+    }
+
+    size_t connectionCount = 0;
+    size_t tripCount = 0;
+    for (size_t p = 0; p < partCount; ++p)
+    {
+        connectionCount += partConnections[p].size();
+        tripCount += partTrips[p].size();
+    }
+    day->connections_.reserve(connectionCount);
+    day->trips_.reserve(tripCount);
+    for (size_t p = 0; p < partCount; ++p)
+    {
+        auto firstTrip = static_cast<uint32_t>(day->trips_.size());
+        day->trips_.insert(day->trips_.end(), partTrips[p].begin(), partTrips[p].end());
+        for (auto connection : partConnections[p])
+        {
+            connection.trip += firstTrip;
+            day->connections_.push_back(connection);
+        }
+    }
+
+    // a stable sort keeps the connections of a trip in order when they leave at the same minute:
+    std::stable_sort(day->connections_.begin(), day->connections_.end(), [](const auto& x, const auto& y) {return x.departure < y.departure;});
+    return day;
+}
+
+std::shared_ptr<const ConnectionScan::ConnectionDay> ConnectionScan::GetConnectionDay(const RJISDate::Date& date) const
+{
+    return cache_.Get(date, [this](const RJISDate::Date& date) {return MakeConnectionDay(date);});
+}
+
+size_t ConnectionScan::GetMemoryBytes() const
+{
+    return changeTimes_.capacity() * sizeof(uint16_t) +
+        cache_.GetMemoryBytes([](const ConnectionDay& day) {return day.GetMemoryBytes();});
+}
+
+ConnectionScan::Leg ConnectionScan::GetLeg(const ConnectionDay& day, uint32_t enter, uint32_t exit) const
+{
+    auto& first = day.connections_[enter];
+    auto& last = day.connections_[exit];
+    return Leg{ day.trips_[first.trip], first.position, static_cast<uint16_t>(last.position + 1), first.departure, last.arrival };
+}
+
+//----------------------------------------------------------------------------
+//
+// Name: EarliestArrival
+//
+// Description: Scan forward from the first connection leaving at or after
+//              the departure time. A trip can be boarded at a connection
+//              if its station has been reached in time to change (or it is
+//              the origin) and once boarded every later connection on it
+//              is reachable. The scan stops at the first connection leaving
+//              after the destination has been reached.
+//
+//----------------------------------------------------------------------------
+ConnectionScan::Journey ConnectionScan::EarliestArrival(const ConnectionDay& day, const CRSCode& origin, const CRSCode& destination, uint16_t departAfter) const
+{
+    Journey result;
+    auto originStation = index_->FindStation(origin);
+    auto destinationStation = index_->FindStation(destination);
+    if (originStation == index_->GetStationCount() || destinationStation == index_->GetStationCount() || originStation == destinationStation)
+    {
+        return result;
+    }
+
+    auto& connections = day.connections_;
+    std::vector<uint16_t> arrivals(index_->GetStationCount(), noTime);
+    std::vector<std::pair<uint32_t, uint32_t>> legs(index_->GetStationCount());   // the connections boarded and left to arrive
+    std::vector<uint32_t> boarded(day.trips_.size(), none);                        // the connection each trip was boarded at
+    arrivals[originStation] = departAfter;
+
+    auto first = std::lower_bound(connections.begin(), connections.end(), departAfter, [](const auto& connection, uint16_t minutes) {
+        return connection.departure < minutes;
+    });
+    for (auto c = static_cast<uint32_t>(first - connections.begin()); c < connections.size(); ++c)
+    {
+        auto& connection = connections[c];
+        if (connection.departure >= arrivals[destinationStation])
+        {
+            break;
+        }
+        if (boarded[connection.trip] == none && arrivals[connection.from] != noTime &&
+            arrivals[connection.from] + (connection.from == originStation ? 0 : changeTimes_[connection.from]) <= connection.departure)
+        {
+            boarded[connection.trip] = c;
+        }
+        if (boarded[connection.trip] != none && connection.arrival < arrivals[connection.to])
+        {
+            arrivals[connection.to] = connection.arrival;
+            legs[connection.to] = std::make_pair(boarded[connection.trip], c);
+        }
+    }
+
+    if (arrivals[destinationStation] != noTime)
+    {
+        for (auto station = destinationStation; station != originStation; station = connections[legs[station].first].from)
+        {
+            result.legs.push_back(GetLeg(day, legs[station].first, legs[station].second));
+        }
+        std::reverse(result.legs.begin(), result.legs.end());
+    }
+    return result;
+}
+
+//----------------------------------------------------------------------------
+//
+// Name: Profile
+//
+// Description: Scan backward from the connections leaving before the first
+//              journey after the window arrives, keeping for each station
+//              the journeys to the destination that no other beats and for
+//              each trip the earliest arrival by staying on it. A connection
+//              arrives at the destination, is followed by a change to the
+//              best journey from its station, or stays on its trip, which
+//              ever arrives first - if that beats the journeys already found
+//              from its station it is added to the station's profile.
+//
+//----------------------------------------------------------------------------
+std::vector<ConnectionScan::Journey> ConnectionScan::Profile(const ConnectionDay& day, const CRSCode& origin, const CRSCode& destination,
+    uint16_t fromMinutes, uint16_t toMinutes) const
+{
+    std::vector<Journey> result;
+    auto originStation = index_->FindStation(origin);
+    auto destinationStation = index_->FindStation(destination);
+    if (originStation == index_->GetStationCount() || destinationStation == index_->GetStationCount() || originStation == destinationStation)
+    {
+        return result;
+    }
+
+    // a journey leaving in the window that arrives after a journey leaving after it is not worth taking:
+    auto& connections = day.connections_;
+    auto after = EarliestArrival(day, origin, destination, toMinutes);
+    auto lastArrival = after.legs.empty() ? noTime : after.GetArrival();
+    auto byDeparture = [](const auto& connection, uint16_t minutes) {return connection.departure < minutes;};
+    auto first = std::lower_bound(connections.begin(), connections.end(), fromMinutes, byDeparture) - connections.begin();
+    auto last = std::lower_bound(connections.begin(), connections.end(), lastArrival, byDeparture) - connections.begin();
+
+    std::vector<std::vector<ProfileEntry>> profiles(index_->GetStationCount());
+    std::vector<uint16_t> tripArrivals(day.trips_.size(), noTime);
+    std::vector<uint32_t> tripExits(day.trips_.size(), none);
+    for (auto c = static_cast<uint32_t>(last); c-- > static_cast<uint32_t>(first);)
+    {
+        auto& connection = connections[c];
+        uint16_t arrival = noTime;
+        uint32_t exit = c;
+        if (connection.to == destinationStation)
+        {
+            arrival = connection.arrival;
+        }
+        else
+        {
+            auto entry = FindProfileEntry(profiles[connection.to], static_cast<uint16_t>(connection.arrival + changeTimes_[connection.to]));
+            if (entry != nullptr)
+            {
+                arrival = entry->arrival;
+            }
+        }
+        if (tripArrivals[connection.trip] < arrival)
+        {
+            arrival = tripArrivals[connection.trip];
+            exit = tripExits[connection.trip];
+        }
+        else if (arrival != noTime)
+        {
+            tripArrivals[connection.trip] = arrival;
+            tripExits[connection.trip] = exit;
+        }
+
+        auto& profile = profiles[connection.from];
+        if (arrival != noTime && (profile.empty() || arrival < profile.back().arrival))
+        {
+            if (!profile.empty() && profile.back().departure == connection.departure)
+            {
+                profile.pop_back();
+            }
+            profile.push_back(ProfileEntry{ connection.departure, arrival, c, exit });
+        }
+    }
+
+    // follow the journeys from the origin, changing to the best journey from each station left at:
+    auto& originProfile = profiles[originStation];
+    for (auto p = originProfile.rbegin(); p != originProfile.rend() && p->departure < toMinutes; ++p)
+    {
+        Journey journey;
+        for (auto entry = &*p; entry != nullptr;)
+        {
+            journey.legs.push_back(GetLeg(day, entry->enter, entry->exit));
+            auto& exit = connections[entry->exit];
+            entry = exit.to == destinationStation ? nullptr : FindProfileEntry(profiles[exit.to], static_cast<uint16_t>(exit.arrival + changeTimes_[exit.to]));
+        }
+        result.push_back(std::move(journey));
+    }
+    return result;
+}
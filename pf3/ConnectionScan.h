@@ -0,0 +1,94 @@
+#pragma once
+#include "TimetableIndex.h"
+#include "ServiceCalendar.h"
+#include "RaptorPlanner.h"
+
+// ConnectionScan - journey planning by the Connection Scan Algorithm (Dibbelt, Pajor, Strasser and Wagner, "Connection
+// Scan Algorithm"). The trains running on a service day are broken into connections - one train from one call to the
+// next - held in a single array in departure time order. A query is one pass over the array, so it reads memory in
+// order and needs no queue:
+//
+//     EarliestArrival    scans forward from the departure time and gives the journey arriving first.
+//     Profile            scans backward from the end of the window and gives every journey in the window that no
+//                        other beats - in one pass rather than one search for each departure.
+//
+// The connections of a service day also hold the trains of the day before that are still running after midnight and
+// the trains of the next day that leave in its first nextDayMinutes, so a window that crosses midnight needs no
+// special treatment. Times are minutes from midnight of the service day, so times after the next midnight are 1440
+// and more. A change takes the minimum connection time for the station, as for RaptorPlanner.
+class ConnectionScan
+{
+public:
+    typedef RaptorPlanner::Leg Leg;
+    typedef RaptorPlanner::Journey Journey;
+
+    static constexpr uint16_t nextDayMinutes = 6 * 60;
+
+    // the connections of one service day:
+    class ConnectionDay
+    {
+        struct Connection
+        {
+            uint16_t departure;
+            uint16_t arrival;
+            uint32_t from;          // station numbers (see TimetableIndex)
+            uint32_t to;
+            uint32_t trip;          // in trips_
+            uint16_t position;      // of the call departed from in its run
+        };
+        std::vector<Connection> connections_;   // in departure order - a trip's connections are in its order
+        std::vector<uint32_t> trips_;           // the run of each trip
+        friend class ConnectionScan;
+    public:
+        size_t GetConnectionCount() const
+        {
+            return connections_.size();
+        }
+
+        size_t GetMemoryBytes() const
+        {
+            return connections_.capacity() * sizeof(Connection) + trips_.capacity() * sizeof(uint32_t);
+        }
+    };
+
+private:
+    static const size_t cacheSize = 4;
+
+    const Timetable* timetable_ = nullptr;
+    const TimetableIndex* index_ = nullptr;
+    const ServiceCalendar* calendar_ = nullptr;
+    std::vector<uint16_t> changeTimes_;                 // the minimum connection time at each station
+    DateCache<ConnectionDay, cacheSize> cache_;
+
+    std::shared_ptr<const ConnectionDay> MakeConnectionDay(const RJISDate::Date& date) const;
+
+    // the leg on a trip boarded at one connection (enter) and left at the end of another (exit):
+    Leg GetLeg(const ConnectionDay& day, uint32_t enter, uint32_t exit) const;
+
+public:
+    ConnectionScan() = default;
+    ConnectionScan(const ConnectionScan&) = delete;
+    ConnectionScan& operator=(const ConnectionScan&) = delete;
+
+    // the timetable, its index and its calendar must outlive this and not change. The change times are in minutes by
+    // CRS:
+    void Build(const Timetable& timetable, const TimetableIndex& index, const ServiceCalendar& calendar,
+        const std::map<CRSCode, uint16_t>& changeTimes);
+
+    // the connections of a service day - made when a date is first asked for and kept in a DateCache. The day returned
+    // stays valid after it has left the cache:
+    std::shared_ptr<const ConnectionDay> GetConnectionDay(const RJISDate::Date& date) const;
+
+    // the journey from origin to destination leaving at or after departAfter that arrives first - no legs if there
+    // is none:
+    Journey EarliestArrival(const ConnectionDay& day, const CRSCode& origin, const CRSCode& destination, uint16_t departAfter) const;
+
+    // every journey leaving in the window from fromMinutes up to toMinutes that no other journey beats - no journey
+    // leaves later and arrives earlier. Journeys arriving after the first journey leaving after the window are left
+    // out. In departure order:
+    std::vector<Journey> Profile(const ConnectionDay& day, const CRSCode& origin, const CRSCode& destination,
+        uint16_t fromMinutes, uint16_t toMinutes) const;
+
+    // including the connection days in the cache:
+    size_t GetMemoryBytes() const;
+};
@@ -0,0 +1,474 @@
+#include "stdafx.h"
+#include <atomic>
+#include <ams/athread.h>
+#include <ams/codetiming.h>
+#include <ams/debugutils.h>
+#include "DatasetLoader.h"
+#include "ChangeSet.h"
+#include "globals.h"
+#include "RJISAnalyser.h"
+#include "LoadReport.h"
+#include "ActiveStations.h"
+#include "ReadIDMS.h"
+#include "TiplocToNLC.h"
+#include "LineParsers.h"
+#include "config.h"
+#include "ZipArchive.h"
+
+namespace LP = LineParsers; // namespace alias
+
+//----------------------------------------------------------------------------
+//
+// Name: GetSourceFiles
+//
+// Description: Get the files a dataset is loaded from, by file type. The
+//              RJIS types are the RJIS file extensions.
+//
+//----------------------------------------------------------------------------
+DatasetLoader::FileMap DatasetLoader::GetSourceFiles()
+{
+    // analyse the RJIS file set to get the set numbers of the files - the files may have changed since the last load:
+    RJISAnalyser& rja = RJISAnalyser::GetInstance();
+    rja.Rescan();
+    int ndfSet = rja.GetSetNumber("NDF");
+    if (rja.GetNumberOfSets() == 0)
+    {
+        throw QException("No RJIS files to process in the directory " + g_workingDirectory);
+    }
+    else if ((rja.GetNumberOfSets() == 2 && rja.GetNumberOfFilesInSet(ndfSet) != 1) || rja.GetNumberOfSets() > 2)
+    {
+        throw QException("Too many different RJIS sets in folder " +
+            g_workingDirectory + ": " + rja.GetFileSetsAsString() +
+            "\n(one NDF file from a different set is permitted.)"
+            );
+    }
+
+    std::string auxDir = Config::directories.GetDirectory("aux");
+
+    FileMap files;
+    files["PBN"] = auxDir + "/" + "PFAUX.PLUSBUSNLC";           // plusbus NLCs - not part of RJIS
+    files["PBR"] = auxDir + "/" + "PFAUX.PLUSBUSRESTRICT";      // plusbus restrictions - not part of RJIS
+    // optional auxiliary groups file - not part of RJIS:
+    //if (!rja.GetFilename("AGS").empty())
+    //{
+    //    files["AGS"] = rja.GetFilename("AGS");
+    //}
+    files["NDF"] = rja.GetFilename("NDF");                      // non-derivable fares
+    //files["NFO"] = rja.GetFilename("NFO");                    // non-derivable fares override
+    // AMS need to arrange to get the name of this properly:
+    //files["MCA"] = "s:\\ttisf968.mca";                        // timetable file
+    //files["MSN"] = "s:\\ttisf968.msn";                        // timetable stations - minimum connection times
+    //files["FFL"] = rja.GetFilename("FFL");                    // flows
+    //files["TTY"] = rja.GetFilename("TTY");                    // ticket types
+    //files["FSC"] = rja.GetFilename("FSC");                    // clusters
+    //files["RLC"] = rja.GetFilename("RLC");                    // railcards
+    //files["FNS"] = rja.GetFilename("FNS");                    // non-standard discounts
+    //files["DIS"] = rja.GetFilename("DIS");                    // standard discounts
+    files["LOC"] = rja.GetFilename("LOC");                      // locations file
+    //files["RCM"] = rja.GetFilename("RCM");                    // railcard minimum fares (RSPS5045 p40)
+    //files["RST"] = rja.GetFilename("RST");                    // restrictions (RSPS5045 p45)
+    return files;
+}
+
+// the journey plan files - one for each origin, named j followed by the origin's CRS code:
+/* static */
+std::vector<std::string> DatasetLoader::GetJourneyPlanFiles()
+{
+    std::vector<std::string> result;
+    std::string planDir = Config::directories.GetDirectory("aux") + "/jp";
+    WIN32_FIND_DATA fdata;
+    HANDLE h = FindFirstFile((planDir + "/j*.plan").c_str(), &fdata);
+    if (h != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            result.push_back(planDir + "/" + fdata.cFileName);
+        } while (FindNextFile(h, &fdata));
+        FindClose(h);
+    }
+    return result;
+}
+
+//----------------------------------------------------------------------------
+//
+// Name: WaitForFiles
+//
+// Description: Wait for the reader threads to read the files with the
+//              events given then close the events. Throws if a file could
+//              not be read or if the files are not all read in time. The
+//              reader threads fill inUse (the dataset being loaded) so if
+//              we give up waiting it is never freed - a reader thread may
+//              still be writing to it.
+//
+//----------------------------------------------------------------------------
+void DatasetLoader::WaitForFiles(const std::vector<HANDLE>& events, std::shared_ptr<void> inUse)
+{
+    // a full load takes a few minutes - a reader thread still going after this long is stuck:
+    const ULONGLONG readTimeoutMilliseconds = 30 * 60 * 1000;
+    const ULONGLONG deadline = GetTickCount64() + readTimeoutMilliseconds;
+
+    // we can only wait for MAXIMUM_WAIT_OBJECTS events at once:
+    for (size_t i = 0; i < events.size(); i += MAXIMUM_WAIT_OBJECTS)
+    {
+        auto count = std::min<size_t>(events.size() - i, MAXIMUM_WAIT_OBJECTS);
+        ULONGLONG now = GetTickCount64();
+        DWORD wait = static_cast<DWORD>(now < deadline ? deadline - now : 0);
+        DWORD result = WaitForMultipleObjects(static_cast<DWORD>(count), events.data() + i, TRUE, wait);
+        if (result == WAIT_TIMEOUT || result == WAIT_FAILED)
+        {
+            // the events are not closed either - a reader thread still holding one will set it later:
+            abandoned_.push_back(inUse);
+            throw QException("RJIS files not read after " + std::to_string(readTimeoutMilliseconds / 60'000) +
+                " minutes - the load is abandoned");
+        }
+    }
+
+    std::string failures;
+    for (auto event : events)
+    {
+        auto failure = FileReaderQueue::GetInstance().TakeFailure(event);
+        if (!failure.empty())
+        {
+            failures += "\n" + failure;
+        }
+        CloseHandle(event);
+    }
+    if (!failures.empty())
+    {
+        throw QException("Cannot read the RJIS files:" + failures);
+    }
+}
+
+//----------------------------------------------------------------------------
+//
+// Name: Load
+//
+// Description: Read the files given into a new dataset and build its
+//              indexes.
+//
+//----------------------------------------------------------------------------
+std::shared_ptr<RJISDataset> DatasetLoader::Load(const FileMap& files, const TiplocUpdates& tiplocUpdates)
+{
+    typedef HANDLE(*AddFileFunction)(RJISDataset&, std::string, SourceStats*);
+    static const std::map<std::string, AddFileFunction> addFileFunctions{
+        { "PBN", LP::AddPlusBusNLCFile },
+        { "PBR", LP::AddPlusBusRestrictionsFile },
+        { "AGS", LP::AddAuxGroupsFile },
+        { "NDF", LP::AddNDFFile },
+        { "NFO", LP::AddNFOFile },
+        { "MCA", LP::AddTimetableFile },
+        { "MSN", LP::AddTimetableStationsFile },
+        { "FFL", LP::AddFFLFile },
+        { "TTY", LP::AddTicketTypeFile },
+        { "FSC", LP::AddClustersFile },
+        { "RLC", LP::AddRailcardFile },
+        { "FNS", LP::AddNSDiscountsFile },
+        { "DIS", LP::AddStandardDiscountsFile },
+        { "LOC", LP::AddLocationsFile },
+        { "RCM", LP::AddRailcardMinFaresFile },
+        { "RST", LP::AddRestrictionsFile },
+    };
+
+    auto ft1 = ams::GetCurrentFiletime();
+
+    // the dataset is filled by the line parsers then frozen and published once its indexes are built:
+    auto dataset = std::make_shared<RJISDataset>();
+    dataset->tiplocUpdates = tiplocUpdates;
+    auto report = std::make_unique<LoadReport>();
+
+    std::vector<HANDLE> events;
+
+    // Each Lineparser function (LP::f) below adds a filename and a method to parse a line from that
+    // file to a queue. The reader threads (one per core) process the queue.
+    for (auto& file : files)
+    {
+        events.push_back(addFileFunctions.at(file.first)(*dataset, file.second, report->AddFile(file.first, file.second)));
+    }
+
+    // the journey plans - there is a file for each origin so they are not reported one by one:
+    for (auto& filename : GetJourneyPlanFiles())
+    {
+        events.push_back(LP::AddJourneyPlanFile(*dataset, filename));
+    }
+
+    // wait for every file to be read - the reader threads are kept for the next load. If a file cannot be read the
+    // new dataset is dropped here and the one already published stays in use:
+    WaitForFiles(events, dataset);
+
+    //std::cout << "number of restrictions RR records is " << dataset->rrMap.size() << std::endl;
+    //auto range = dataset->rrMap.equal_range(RJISTypes::RestrictionsRRKey('F', "YNG"));
+    //for (auto p = range.first; p != range.second; ++p)
+    //{
+    //    std::cout << p->second.ticketCode_ << " " << p->second.restrictionCode_ << "\n";
+    //}
+
+    //std::cout << "number of restrictions TR records is " << dataset->trMap.size() << std::endl;
+    //auto range2 = dataset->trMap.equal_range(RJISTypes::RestrictionsKey('F', "R1"));
+    //for (auto p = range2.first; p != range2.second; ++p)
+    //{
+    //    std::cout << TTTypes::GetTimeFromMinutes(p->second.minutesFrom_) << " " << TTTypes::GetTimeFromMinutes(p->second.minutesTo_) << "\n";
+    //}
+
+    //dataset->AdjustHDRecords();
+
+    //std::cout << "number of restrictions HD records is " << dataset->hdMap.size() << std::endl;
+    //auto range3 = dataset->hdMap.equal_range(RJISTypes::RestrictionsKey('F', "R1"));
+    //for (auto p = range3.first; p != range3.second; ++p)
+    //{
+    //    p->second.dateRange_.DumpDates(std::cout);
+    //    p->second.days_.DumpDays(std::cout);
+    //}
+
+
+    // non-standard discount, destination, standard discount, validity and timetable indexes - this also removes
+    // flows without fares:
+    dataset->BuildIndexes();
+
+    // remove plusbus nlcs from m-records:
+
+    //std::set<UNLC> pbNLCs;
+    //for (auto p : dataset->plusbusNLCMap)
+    //{
+    //    pbNLCs.insert(p.second);
+    //}
+
+    //for (auto p : dataset->g)
+
+
+    auto ft2 = ams::GetCurrentFiletime();
+    report->Complete(*dataset, (ft2 - ft1) / 10'000'000.0);
+    report->Print(std::cout);
+    SetLastReport(std::move(report));
+
+    std::cout << "finished!\n";
+
+    return dataset;
+}
+
+//----------------------------------------------------------------------------
+//
+// Name: Patch
+//
+// Description: Make a dataset for the files given by applying the changes
+//              since the previous dataset to it. Returns null if the
+//              previous dataset cannot be patched - a full load is then
+//              needed. The timetable is never patched so a change to the
+//              TIPLOC updates needs a full load too.
+//
+//----------------------------------------------------------------------------
+std::shared_ptr<RJISDataset> DatasetLoader::Patch(const FileMap& files, const TiplocUpdates& tiplocUpdates)
+{
+    // the dataset before the one published can only be changed once no request is using it. No request can start
+    // using it again as it is not published so if we hold the only reference it is ours:
+    if (!previous_.dataset || previous_.dataset.use_count() != 1 || previous_.snapshots.size() != files.size())
+    {
+        return nullptr;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (previous_.dataset->tiplocUpdates != tiplocUpdates)
+    {
+        std::cout << "The IDMS TIPLOCs have changed - loading the complete set\n";
+        return nullptr;
+    }
+
+    // both versions of every file are read at the same time on the reader threads:
+    auto changes = std::make_shared<ChangeSet>();
+    for (auto& file : files)
+    {
+        auto p = previous_.snapshots.find(file.first);
+        if (p == previous_.snapshots.end())
+        {
+            return nullptr;
+        }
+        changes->Add(file.first, p->second, file.second);
+    }
+    WaitForFiles(changes->StartReading(), changes);
+
+    std::string type;
+    if (!changes->Compare(type))
+    {
+        std::cout << "RJIS " << type << " file cannot be patched - loading the complete set\n";
+        return nullptr;
+    }
+    WaitForFiles(changes->StartReadingRecords(), changes);
+
+    std::cout << "RJIS changes: " << changes->GetRemovedCount() << " records removed, " <<
+        changes->GetRecordCount() << " records read again\n";
+    auto dataset = std::move(previous_.dataset);
+    changes->Apply(*dataset);
+    return dataset;
+}
+
+//----------------------------------------------------------------------------
+//
+// Name: LoadAndPublish
+//
+// Description: Make a dataset from the files in the current directory -
+//              by patching the previous dataset if we can, otherwise by
+//              reading every file - and publish it.
+//
+//----------------------------------------------------------------------------
+void DatasetLoader::LoadAndPublish()
+{
+    auto files = GetSourceFiles();
+
+    // the IDMS station reference data has the TIPLOCs of new stations - they must be known before the timetable is
+    // read:
+    std::string idmsDir = Config::directories.GetDirectory("idms");
+    std::string webDir = Config::directories.GetDirectory("docroot");
+    ReadIDMS ridms(webDir, idmsDir);
+    TiplocUpdates tiplocUpdates(ridms.GetTiplocCRSCodes());
+
+    // patching needs a copy of the files the previous dataset was loaded from - the RJIS files are replaced by the
+    // next set so we keep our own copies in the snapshot directory. Without one every load is a full load:
+    std::string snapshotDir = Config::directories.GetDirectory("snapshot");
+
+    std::shared_ptr<RJISDataset> dataset;
+    if (!snapshotDir.empty())
+    {
+        try
+        {
+            dataset = Patch(files, tiplocUpdates);
+        }
+        catch (std::exception& ex)
+        {
+            // a part patched dataset has been freed by now:
+            std::cerr << "Cannot patch the RJIS dataset: " << ex.what() << "\n";
+        }
+    }
+    if (!dataset)
+    {
+        // free the previous dataset before reading another:
+        Discard(previous_);
+        dataset = Load(files, tiplocUpdates);
+    }
+
+    RJISAnalyser& rja = RJISAnalyser::GetInstance();
+    dataset->fflSetNumber_ = rja.GetSetNumber("FFL");
+    dataset->ndfSetNumber_ = rja.GetSetNumber("NDF");
+
+    ActiveStations as(*dataset);
+    as.GetList(dataset->activeStations);
+    //std::cout << "found " << dataset->activeStations.size() << "\n";
+    ridms.WriteJSON("locations.js", dataset->activeStations);
+
+    Loaded loaded;
+    if (!snapshotDir.empty())
+    {
+        loaded.snapshots = TakeSnapshots(files, snapshotDir);
+        loaded.dataset = dataset;
+    }
+
+    RJISDataset::Publish(dataset);
+
+    // keep the dataset just replaced so that the next load can patch it:
+    Discard(previous_);
+    previous_ = std::move(current_);
+    current_ = std::move(loaded);
+}
+
+void DatasetLoader::SetLastReport(std::unique_ptr<LoadReport> report)
+{
+    AcquireSRWLockExclusive(&reportLock_);
+    lastReport_ = std::move(report);
+    ReleaseSRWLockExclusive(&reportLock_);
+}
+
+std::string DatasetLoader::GetLastReportJSON()
+{
+    std::string result = "{}";
+    AcquireSRWLockShared(&reportLock_);
+    if (lastReport_)
+    {
+        result = lastReport_->GetJSON();
+    }
+    ReleaseSRWLockShared(&reportLock_);
+    return result;
+}
+
+// copy the files a dataset was loaded from to the snapshot directory. A member of a zip archive is extracted:
+DatasetLoader::FileMap DatasetLoader::TakeSnapshots(const FileMap& files, const std::string& snapshotDir)
+{
+    FileMap result;
+    ++loadNumber_;
+    for (auto& file : files)
+    {
+        std::string snapshot = snapshotDir + "\\pf3snapshot" + std::to_string(loadNumber_) + "." + file.first;
+        if (ZipArchive::IsMemberPath(file.second))
+        {
+            std::ofstream ofs(snapshot, std::ios::binary);
+            SourceReader reader(file.second, [&ofs](std::string line) {
+                ofs << line << "\r\n";
+            });
+            reader.Read();
+            if (!ofs.flush())
+            {
+                throw QException("Cannot write " + snapshot);
+            }
+        }
+        else if (!CopyFile(file.second.c_str(), snapshot.c_str(), FALSE))
+        {
+            DWORD error = GetLastError();
+            throw QException("Cannot copy " + file.second + " to " + snapshot + " - Windows error was " + ams::GetWinErrorAsString(error));
+        }
+        result[file.first] = snapshot;
+    }
+    return result;
+}
+
+// release a dataset (it is freed when the last request using it finishes) and delete its snapshots:
+void DatasetLoader::Discard(Loaded& loaded)
+{
+    loaded.dataset.reset();
+    for (auto& snapshot : loaded.snapshots)
+    {
+        DeleteFile(snapshot.second.c_str());
+    }
+    loaded.snapshots.clear();
+}
+
+bool DatasetLoader::StartReload()
+{
+    // only one load at a time:
+    if (InterlockedCompareExchange(&loading_, 1, 0) != 0)
+    {
+        return false;
+    }
+    try
+    {
+        // the last reload thread clears loading_ as it finishes so it has ended or is about to - wait for it and
+        // close it before starting another:
+        if (reloadThread_)
+        {
+            WaitForSingleObject(*reloadThread_, INFINITE);
+            reloadThread_.reset();
+        }
+        reloadThread_ = std::make_unique<AThread>(ReloadThread, 0, this, false);
+    }
+    catch (...)
+    {
+        InterlockedExchange(&loading_, 0);
+        throw;
+    }
+    return true;
+}
+
+/* static - the thread function: */
+unsigned WINAPI DatasetLoader::ReloadThread(void *p)
+{
+    DatasetLoader& loader = *static_cast<DatasetLoader*>(p);
+    try
+    {
+        auto ft1 = ams::GetCurrentFiletime();
+        loader.LoadAndPublish();
+        auto ft2 = ams::GetCurrentFiletime();
+        std::cout << "RJIS dataset " << RJISDataset::Get().version_ << " published after " << (ft2 - ft1) / 10'000'000.0 << " seconds\n";
+    }
+    catch (std::exception& ex)
+    {
+        // the dataset already published stays in use:
+        std::cerr << "RJIS reload failed: " << ex.what() << "\n";
+    }
+    InterlockedExchange(&loader.loading_, 0);
+    return 0;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <ams/AThread.h>
+#include "RJISDataset.h"
+#include "ReaderThreads.h"
+#include "LoadReport.h"
+
+// DatasetLoader - read an RJIS file set into a new RJISDataset. The first load is done by main before the server starts;
+// later loads are done by a background thread while the server carries on answering queries from the dataset already
+// published. When the new dataset is complete it replaces the old one (see RJISDataset::Publish) and the old one is
+// freed when the last query using it finishes. If a reload fails the old dataset stays in use.
+//
+// If a snapshot directory is configured the loader keeps the dataset it last replaced, with copies of the files it was
+// loaded from. The next load then patches that dataset with the records that have changed (see ChangeSet) rather than
+// reading every file again. This costs the memory for a second dataset. The journey plan files are not RJIS files and
+// are only read by a full load - a patched dataset keeps the plans it has.
+//
+// The reader threads are owned by the loader and live for the whole program so that the file reader queue is never
+// stopped between loads. A file that cannot be read fails the load but not the reader thread reading it.
+class DatasetLoader
+{
+    typedef std::map<std::string, std::string> FileMap;     // filenames by file type
+
+    // a dataset we have published and the copies of the files it was loaded from:
+    struct Loaded
+    {
+        std::shared_ptr<RJISDataset> dataset;
+        FileMap snapshots;
+    };
+
+    ReaderThreads readerThreads_;
+
+    // the report of the last full load - read by the request threads:
+    SRWLOCK reportLock_ = SRWLOCK_INIT;
+    std::unique_ptr<LoadReport> lastReport_;
+
+    std::unique_ptr<AThread> reloadThread_;
+    volatile LONG loading_ = 0;
+
+    // datasets from loads that were given up while a reader thread was still filling them - never freed:
+    std::vector<std::shared_ptr<void>> abandoned_;
+
+    // only used by the thread doing a load:
+    unsigned loadNumber_ = 0;
+    Loaded current_;        // the dataset published
+    Loaded previous_;       // the dataset it replaced
+
+    DatasetLoader() = default;
+    static unsigned WINAPI ReloadThread(void *p);
+    FileMap GetSourceFiles();
+    static std::vector<std::string> GetJourneyPlanFiles();
+    void WaitForFiles(const std::vector<HANDLE>& events, std::shared_ptr<void> inUse);
+    std::shared_ptr<RJISDataset> Load(const FileMap& files, const TiplocUpdates& tiplocUpdates);
+    std::shared_ptr<RJISDataset> Patch(const FileMap& files, const TiplocUpdates& tiplocUpdates);
+    FileMap TakeSnapshots(const FileMap& files, const std::string& snapshotDir);
+    static void Discard(Loaded& loaded);
+    void SetLastReport(std::unique_ptr<LoadReport> report);
+public:
+    static DatasetLoader& GetInstance()
+    {
+        static DatasetLoader instance;
+        return instance;
+    }
+
+    DatasetLoader(const DatasetLoader&) = delete;
+    DatasetLoader& operator=(const DatasetLoader&) = delete;
+
+    // make a dataset from the files in the current directory and publish it:
+    void LoadAndPublish();
+
+    // start loading a new dataset in the background and publish it when it is complete. Returns false if a load
+    // is already in progress:
+    bool StartReload();
+
+    // the report of the last full load as JSON (see LoadReport) - an empty object before the first load completes:
+    std::string GetLastReportJSON();
+
+    bool IsLoading() const
+    {
+        return loading_ != 0;
+    }
+};
@@ -0,0 +1,73 @@
+#pragma once
+#include <list>
+
+// DateCache - values made for a date, such as the runs running on the date (see ServiceCalendar). A value is made when
+// its date is first asked for and the most recently used dates are kept, so the dates most often queried (today and the
+// next few days) stay ready while the memory used is bounded. Values are shared and never changed once made, so a
+// value stays valid after it has left the cache.
+//
+// A cache is the only part of a published dataset that changes, so it has its own lock.
+template <class T, size_t cacheSize> class DateCache
+{
+    mutable SRWLOCK lock_ = SRWLOCK_INIT;
+    mutable std::list<std::pair<RJISDate::Date, std::shared_ptr<const T>>> cache_;   // most recently used first
+
+public:
+    DateCache() = default;
+    DateCache(const DateCache&) = delete;
+    DateCache& operator=(const DateCache&) = delete;
+
+    void Clear()
+    {
+        AcquireSRWLockExclusive(&lock_);
+        cache_.clear();
+        ReleaseSRWLockExclusive(&lock_);
+    }
+
+    // the memory used by the cached values - bytes(value) gives the memory owned by a value:
+    template <class F> size_t GetMemoryBytes(F bytes) const
+    {
+        size_t result = 0;
+        AcquireSRWLockShared(&lock_);
+        for (auto& entry : cache_)
+        {
+            result += sizeof(entry) + sizeof(T) + bytes(*entry.second);
+        }
+        ReleaseSRWLockShared(&lock_);
+        return result;
+    }
+
+    // the value for a date - make(date) is called to make it if it is not in the cache:
+    template <class F> std::shared_ptr<const T> Get(const RJISDate::Date& date, F make) const
+    {
+        std::shared_ptr<const T> result;
+        AcquireSRWLockExclusive(&lock_);
+        auto p = std::find_if(cache_.begin(), cache_.end(), [&date](const auto& entry) {return entry.first == date;});
+        if (p != cache_.end())
+        {
+            cache_.splice(cache_.begin(), cache_, p);
+            result = p->second;
+        }
+        ReleaseSRWLockExclusive(&lock_);
+
+        if (!result)
+        {
+            // made without the lock so that requests for other dates are not held up. If two threads make the same
+            // date at once the second one made is cached:
+            result = make(date);
+            AcquireSRWLockExclusive(&lock_);
+            cache_.emplace_front(date, result);
+            auto q = std::find_if(std::next(cache_.begin()), cache_.end(), [&date](const auto& entry) {return entry.first == date;});
+            if (q != cache_.end())
+            {
+                cache_.erase(q);
+            }
+            if (cache_.size() > cacheSize)
+            {
+                cache_.pop_back();
+            }
+            ReleaseSRWLockExclusive(&lock_);
+        }
+        return result;
+    }
+};
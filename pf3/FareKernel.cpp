@@ -0,0 +1,226 @@
+#include "stdafx.h"
+#include <emmintrin.h>
+#include "FareKernel.h"
+
+namespace {
+
+// multiply four unsigned 32 bit values keeping the low 32 bits of each product - the same wrap-around as unsigned
+// multiplication in C++. SSE2 has no 32 bit multiply-low so we multiply the even and odd lanes separately:
+inline __m128i MulLo32(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// unsigned division of four 32 bit values by a constant, done as a multiply by a magic number and a shift. The shift
+// must be at least 32 so that each quotient fits in the low half of its 64 bit product:
+template <uint32_t magic, int shift> inline __m128i DivU32(__m128i u)
+{
+    const __m128i m = _mm_set1_epi32(magic);
+    __m128i even = _mm_srli_epi64(_mm_mul_epu32(u, m), shift);
+    __m128i odd = _mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(u, 32), m), shift);
+    return _mm_or_si128(even, _mm_slli_epi64(odd, 32));
+}
+
+// u / 1000 - exact for every 32 bit u since 274877907 * 1000 - 2^38 = 56 <= 2^(38 - 32):
+inline __m128i Div1000(__m128i u)
+{
+    return DivU32<274877907u, 38>(u);
+}
+
+// u / 5 - exact for every 32 bit u since 0xCCCCCCCD * 5 - 2^34 = 1 <= 2^(34 - 32):
+inline __m128i Div5(__m128i u)
+{
+    return DivU32<0xCCCCCCCDu, 34>(u);
+}
+
+// Rounding for four fares and four percentages. Where a percentage is noDiscount the fare is returned unchanged:
+inline __m128i Rounding4(__m128i x, __m128i percent)
+{
+    const __m128i thousand = _mm_set1_epi32(1000);
+    const __m128i roundup = _mm_set1_epi32(999);
+    const __m128i two = _mm_set1_epi32(2);
+    const __m128i keep = _mm_cmpeq_epi32(percent, _mm_set1_epi32(FareKernel::noDiscount));
+
+    __m128i t = _mm_add_epi32(MulLo32(x, _mm_sub_epi32(thousand, percent)), roundup);
+    __m128i q = _mm_add_epi32(Div1000(t), two);
+    __m128i r = Div5(q);
+    r = _mm_add_epi32(_mm_slli_epi32(r, 2), r);
+    return _mm_or_si128(_mm_and_si128(keep, x), _mm_andnot_si128(keep, r));
+}
+
+inline __m128i GatherPercentages(const uint8_t* categories, const FareKernel::PercentageTable& percentages)
+{
+    return _mm_set_epi32(percentages[categories[3]], percentages[categories[2]],
+        percentages[categories[1]], percentages[categories[0]]);
+}
+
+inline unsigned RoundingOrKeep(unsigned x, unsigned percent)
+{
+    return percent == FareKernel::noDiscount ? x : FareKernel::Rounding(x, percent);
+}
+
+}
+
+namespace FareKernel
+{
+
+void DiscountFares(
+    uint32_t* prices,
+    const uint32_t* fares,
+    const uint8_t* categories,
+    size_t count,
+    const PercentageTable& percentages)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(fares + i));
+        __m128i result = Rounding4(x, GatherPercentages(categories + i, percentages));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(prices + i), result);
+    }
+    // at most three left over:
+    for (; i < count; ++i)
+    {
+        prices[i] = RoundingOrKeep(fares[i], percentages[categories[i]]);
+    }
+}
+
+void DiscountFares(
+    uint32_t* adultPrices,
+    uint32_t* childPrices,
+    const uint32_t* fares,
+    const uint8_t* categories,
+    size_t count,
+    const PercentageTable& adultPercentages,
+    const PercentageTable& childPercentages)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(fares + i));
+        __m128i adult = Rounding4(x, GatherPercentages(categories + i, adultPercentages));
+        __m128i child = Rounding4(x, GatherPercentages(categories + i, childPercentages));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(adultPrices + i), adult);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(childPrices + i), child);
+    }
+    for (; i < count; ++i)
+    {
+        uint32_t fare = fares[i];
+        adultPrices[i] = RoundingOrKeep(fare, adultPercentages[categories[i]]);
+        childPrices[i] = RoundingOrKeep(fare, childPercentages[categories[i]]);
+    }
+}
+
+bool SelfTest(std::ostream& os)
+{
+    int errors = 0;
+    const int maxErrors = 20;
+
+    auto report = [&os, &errors](const char* what, uint64_t input, uint64_t percent, uint64_t expected, uint64_t actual)
+    {
+        if (errors++ < maxErrors)
+        {
+            os << "FareKernel mismatch (" << what << "): input " << input << " percent " << percent <<
+                " expected " << expected << " got " << actual << "\n";
+        }
+    };
+
+    // 1. the magic number divisions for every possible 32 bit input:
+    const uint64_t top = 0x100000000ull;
+    for (uint64_t u = 0; u < top && errors < maxErrors; u += 4)
+    {
+        __m128i v = _mm_set_epi32(static_cast<int>(u + 3), static_cast<int>(u + 2), static_cast<int>(u + 1), static_cast<int>(u));
+        alignas(16) uint32_t q1000[4], q5[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(q1000), Div1000(v));
+        _mm_store_si128(reinterpret_cast<__m128i*>(q5), Div5(v));
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            uint32_t x = static_cast<uint32_t>(u + lane);
+            if (q1000[lane] != x / 1000)
+            {
+                report("divide by 1000", x, 0, x / 1000, q1000[lane]);
+            }
+            if (q5[lane] != x / 5)
+            {
+                report("divide by 5", x, 0, x / 5, q5[lane]);
+            }
+        }
+    }
+
+    // 2. the whole kernel against Rounding for every percentage and every fare up to 1,000,000 pence. Use an
+    // odd batch size so that the scalar tail is exercised too. The adult table has the percentage under test and
+    // the child table has noDiscount so both the discount and the pass-through paths are checked:
+    const uint32_t maxFare = 1000000;
+    const size_t batchSize = 4099;
+    std::vector<uint32_t> fares(batchSize), adult(batchSize), child(batchSize);
+    std::vector<uint8_t> categories(batchSize, 1);
+    PercentageTable adultPercentages, childPercentages;
+    adultPercentages.fill(noDiscount);
+    childPercentages.fill(noDiscount);
+
+    for (unsigned percent = 0; percent < 1000 && errors < maxErrors; ++percent)
+    {
+        adultPercentages[1] = static_cast<uint16_t>(percent);
+        for (uint32_t first = 0; first < maxFare; first += batchSize)
+        {
+            size_t count = std::min<size_t>(batchSize, maxFare - first);
+            for (size_t i = 0; i < count; ++i)
+            {
+                fares[i] = first + static_cast<uint32_t>(i);
+            }
+            DiscountFares(adult.data(), child.data(), fares.data(), categories.data(), count, adultPercentages, childPercentages);
+            for (size_t i = 0; i < count; ++i)
+            {
+                unsigned expected = Rounding(fares[i], percent);
+                if (adult[i] != expected)
+                {
+                    report("discount", fares[i], percent, expected, adult[i]);
+                }
+                if (child[i] != fares[i])
+                {
+                    report("no discount", fares[i], noDiscount, fares[i], child[i]);
+                }
+            }
+        }
+    }
+
+    // 3. mixed categories in a single batch, checking the per-lane percentage lookup:
+    for (size_t i = 0; i < batchSize; ++i)
+    {
+        fares[i] = static_cast<uint32_t>(i * 7919 % 99999999);
+        categories[i] = static_cast<uint8_t>(i % categoryCount);
+    }
+    for (int category = 0; category < invalidCategory; ++category)
+    {
+        adultPercentages[category] = static_cast<uint16_t>(category * 10);
+        childPercentages[category] = static_cast<uint16_t>(category % 3 == 0 ? noDiscount : 500 + category);
+    }
+    DiscountFares(adult.data(), child.data(), fares.data(), categories.data(), batchSize, adultPercentages, childPercentages);
+    for (size_t i = 0; i < batchSize; ++i)
+    {
+        unsigned expectedAdult = RoundingOrKeep(fares[i], adultPercentages[categories[i]]);
+        unsigned expectedChild = RoundingOrKeep(fares[i], childPercentages[categories[i]]);
+        if (adult[i] != expectedAdult)
+        {
+            report("mixed adult", fares[i], adultPercentages[categories[i]], expectedAdult, adult[i]);
+        }
+        if (child[i] != expectedChild)
+        {
+            report("mixed child", fares[i], childPercentages[categories[i]], expectedChild, child[i]);
+        }
+    }
+
+    if (errors == 0)
+    {
+        os << "FareKernel self test passed\n";
+    }
+    else
+    {
+        os << "FareKernel self test FAILED with " << errors << " mismatches\n";
+    }
+    return errors == 0;
+}
+
+}
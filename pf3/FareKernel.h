@@ -0,0 +1,60 @@
+#pragma once
+
+// FareKernel - apply discount percentages to batches of fares. The discount percentages for a status code are resolved
+// once per discount category into a small table; applying them is then pure arithmetic over contiguous arrays of fares
+// which we do four fares at a time with SSE2.
+//
+// The rounding rule is the RJIS one: the discounted fare is rounded UP to the nearest penny THEN to the nearest 5p.
+namespace FareKernel
+{
+    // a percentage table entry meaning "no discount found for this category" - the fare is returned unchanged:
+    const uint16_t noDiscount = 0xFFFF;
+
+    // discount categories are two digit codes 00-99. Any other code is given the index invalidCategory
+    // whose percentage is always noDiscount:
+    const int invalidCategory = 100;
+    const int categoryCount = 101;
+
+    // a percentage for each discount category index:
+    typedef std::array<uint16_t, categoryCount> PercentageTable;
+
+    // given an RJIS percentage 0-999 reprenting 0-99.9% calculate the final price. We round UP to the nearest penny THEN round to the nearest 5p:
+    inline unsigned Rounding(unsigned x, unsigned  percent)
+    {
+        return ((x * (1000 - percent) + 999) / 1000 + 2) / 5 * 5;
+    }
+
+    inline uint8_t GetCategoryIndex(const DiscountCategory& category)
+    {
+        if (category[0] >= '0' && category[0] <= '9' && category[1] >= '0' && category[1] <= '9')
+        {
+            return static_cast<uint8_t>((category[0] - '0') * 10 + category[1] - '0');
+        }
+        return invalidCategory;
+    }
+
+    // calculate discounted prices for count fares. Each fare has a category index - the percentage to apply is looked
+    // up in the percentage table. The result for each fare is exactly Rounding(fare, percentage) or the fare itself when
+    // the percentage is noDiscount. The output array may be the same as the fares array.
+    void DiscountFares(
+        uint32_t* prices,                       // OUT - count discounted prices
+        const uint32_t* fares,                  // IN - count undiscounted fares
+        const uint8_t* categories,              // IN - count category indexes
+        size_t count,
+        const PercentageTable& percentages);
+
+    // the same calculation for the adult and child prices of a batch of fares in one pass:
+    void DiscountFares(
+        uint32_t* adultPrices,
+        uint32_t* childPrices,
+        const uint32_t* fares,
+        const uint8_t* categories,
+        size_t count,
+        const PercentageTable& adultPercentages,
+        const PercentageTable& childPercentages);
+
+    // check that the batch kernel gives exactly the same results as Rounding. The division steps are checked for every
+    // possible 32 bit input and the whole kernel for every percentage 000-999 with every fare up to £10,000. Returns
+    // true if there are no mismatches - mismatches are reported to the stream given.
+    bool SelfTest(std::ostream& os);
+}
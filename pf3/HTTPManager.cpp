@@ -7,6 +7,8 @@
 #include "msgthread.h"
 #include "ProcessFareList.h"
 #include "ProcessTimetableRequest.h"
+#include "DatasetLoader.h"
+#include "WorkerPool.h"
 #include "config.h"
 #include "globals.h"
 #include "mimetypesmap.h"
@@ -61,10 +63,110 @@ void GetODR(bool& success, std::string& origin, std::string& destination, std::s
 		}
 	}
 }
+
+// the parameters of an all-to-one query - ?d=NLC&r=RLC. The railcard may be empty:
+void GetDR(bool& success, std::string& destination, std::string& railcard, const std::string& url)
+{
+	success = false;
+	if (url[0] == '?')
+	{
+		std::string d, r;
+		std::string::size_type start = 1;
+		for (;;)
+		{
+			auto pos = url.find('&', start);
+			std::string s = url.substr(start, pos == std::string::npos ? std::string::npos : pos - start);
+			auto epos = s.find('=');
+			if (epos != std::string::npos)
+			{
+				std::string name = s.substr(0, epos);
+				if (name == "d")
+				{
+					d = s.substr(epos + 1);
+				}
+				else if (name == "r")
+				{
+					r = s.substr(epos + 1);
+				}
+			}
+			if (pos == std::string::npos)
+			{
+				break;
+			}
+			start = pos + 1;
+		}
+		if (d.length() == 4)
+		{
+			destination = d;
+			railcard = r;
+			success = true;
+		}
+	}
+}
+
+// split the railcard parameter on commas - e.g. r=YNG,SRN,FAM. An empty railcard (or an empty list) means no railcard:
+void GetRailcardList(std::vector<RailcardCode>& railcards, const std::string& railcardParam)
+{
+	railcards.clear();
+	std::string::size_type start = 0;
+	for (;;)
+	{
+		auto pos = railcardParam.find(',', start);
+		std::string railcard = railcardParam.substr(start, pos == std::string::npos ? std::string::npos : pos - start);
+		ams::MakeUpper(railcard);
+		if (railcard.empty())
+		{
+			railcard = "   ";
+		}
+		RailcardCode code;
+		code = railcard;
+		if (std::find(railcards.begin(), railcards.end(), code) == railcards.end())
+		{
+			railcards.push_back(code);
+		}
+		if (pos == std::string::npos)
+		{
+			break;
+		}
+		start = pos + 1;
+	}
+}
+
+// the value of a header from the request lines (the first line is the request itself) - header names are not case
+// sensitive. Empty if the header is not present:
+std::string GetHeaderValue(const std::vector<std::string>& request, const std::string& name)
+{
+	std::string result;
+	for (size_t i = 1; i < request.size(); ++i)
+	{
+		auto pos = request[i].find(':');
+		if (pos != std::string::npos && pos == name.length() &&
+			std::equal(name.begin(), name.end(), request[i].begin(), [](char c1, char c2) { return toupper(c1) == toupper(c2); }))
+		{
+			result = request[i].substr(pos + 1);
+			ams::Trim(result);
+			break;
+		}
+	}
+	return result;
+}
 }
 
 int64_t HTTPManager::perfFreq = HTTPManager::GetPerfFrequency();
 
+// the /PFADMIN URIs reload the dataset and report on the server, so they are only answered for a caller on this
+// device or one sending the admin token from the config file:
+bool HTTPManager::IsAdminAllowed() const
+{
+    bool result = loopbackPeer_;
+    if (!result)
+    {
+        std::string token = Config::Config::GetInstance().GetAdminToken();
+        result = !token.empty() && GetHeaderValue(request_, "X-PF-Admin-Token") == token;
+    }
+    return result;
+}
+
 // call this function with a chunk of data from the connected socket. It stores the http headers in the request_ list
 // and returns false if the header is incomplete.
 // When the header is eventually complete - signalled by CRLF on a line by itself (i.e. two CRLFs in a row) then
@@ -148,86 +250,109 @@ void HTTPManager::ProcessCompleteRequest()
 void HTTPManager::GenerateJSON(std::string& json,
     uint64_t elapsed,
     const FareSearchParams& originalSearchParams,
-    const FoundPlusBus& plusbusResultsMap,
-    const FareResultsMap& fareResultsMap,
+    const PlusbusMap& plusbusResultsMap,
+    const RailcardFareResultsMap& railcardFareResults,
     const std::vector<TTTypes::Journey> journeys
     ) const
 {
     uint64_t utcJS = ams::GetJSDateMilliseconds();
     json = "{" + ams::JSON::Key("tech") + "{" + ams::JSON::NVPair("serverutc", utcJS, true) +
         ams::JSON::NVPair("serverCPU", elapsed, true) + ams::JSON::NVPair("computerID", GetComputerID()) + "},";
-    json += ams::JSON::Key("fares") + "{" + ams::JSON::Key("ftec") + "{" + ams::JSON::NVPair("version", 989, true)
-        + ams::JSON::NVPair("ndfVersion", 822) + "},";
-    json += ams::JSON::Key("result") + "[{" +
-        ams::JSON::NVPair("rlc", originalSearchParams.railcard_.GetString(), true);
+    // the set numbers and version of the dataset that answered the query - a new dataset can be published at any time:
+    auto& dataset = RJISDataset::Get();
+    json += ams::JSON::Key("fares") + "{" + ams::JSON::Key("ftec") + "{" + ams::JSON::NVPair("version", dataset.fflSetNumber_, true)
+        + ams::JSON::NVPair("ndfVersion", dataset.ndfSetNumber_, true)
+        + ams::JSON::NVPair("dataset", static_cast<int>(dataset.version_)) + "},";
+    json += ams::JSON::Key("result") + "[";
 
-    // only add a plusbus element if there are any fares:
-    if (!plusbusResultsMap.pbFares_.empty())
+    // one result element per railcard searched for:
+    bool firstResult = true;
+    for (auto& railcardResult : railcardFareResults)
     {
-        json += ams::JSON::Key("plusbus") + "{" +
-            ams::JSON::NVPair("o", plusbusResultsMap.origin_.GetString(), true) +
-            ams::JSON::NVPair("d", plusbusResultsMap.destination_.GetString(), true) +
-            ams::JSON::NVPair("po", plusbusResultsMap.pbOrigin_.GetString(), true) +
-            ams::JSON::NVPair("pd", plusbusResultsMap.pbDestination_.GetString(), true) +
-            ams::JSON::Key("fares") + "{";
-
-        for (auto p : plusbusResultsMap.pbFares_)
+        if (firstResult)
         {
-            json += ams::JSON::Key(p.first) +
-                "{" + ams::JSON::NVPair("a", p.second.first, true) + ams::JSON::NVPair("c", p.second.second) + "},";
+            firstResult = false;
         }
-        if (json.back() == ',')
+        else
         {
-            json = json.substr(0, json.length() - 1);
+            json += ',';
         }
-        json += "}},";
-    }
+        const std::string railcard = railcardResult.first.GetString();
+        const FareResults& fareResults = railcardResult.second;
 
-    json += ams::JSON::Key("flows") + "[";
-    // now add array of flows:
-    bool first = true;
-    for (auto p : fareResultsMap)
-    {
-        if (first)
-        {
-            first = false;
-        }
-        else
+        json += "{" + ams::JSON::NVPair("rlc", railcard, true);
+
+        // only add a plusbus element if there are any fares:
+        auto pb = plusbusResultsMap.find(railcard);
+        if (pb != plusbusResultsMap.end() && !pb->second.pbFares_.empty())
         {
-            json += ',';
+            auto& plusbus = pb->second;
+            json += ams::JSON::Key("plusbus") + "{" +
+                ams::JSON::NVPair("o", plusbus.origin_.GetString(), true) +
+                ams::JSON::NVPair("d", plusbus.destination_.GetString(), true) +
+                ams::JSON::NVPair("po", plusbus.pbOrigin_.GetString(), true) +
+                ams::JSON::NVPair("pd", plusbus.pbDestination_.GetString(), true) +
+                ams::JSON::Key("fares") + "{";
+
+            for (auto p : plusbus.pbFares_)
+            {
+                json += ams::JSON::Key(p.first) +
+                    "{" + ams::JSON::NVPair("a", p.second.first, true) + ams::JSON::NVPair("c", p.second.second) + "},";
+            }
+            if (json.back() == ',')
+            {
+                json = json.substr(0, json.length() - 1);
+            }
+            json += "}},";
         }
-        json += "{";
-        json += ams::JSON::NVPair("o", p.first.flow_.origin.GetString(), true) +
-            ams::JSON::NVPair("d", p.first.flow_.destination.GetString(), true) +
-            ams::JSON::NVPair("route", p.first.route_.GetString(), true) +
-            ams::JSON::NVPair("flowid", p.first.flowid_, true) +
-            ams::JSON::NVPair("discount", p.first.discInd_, true) +
-            ams::JSON::Key("fares") + "[";
-        bool first2 = true;
-        for (auto q : p.second)
+
+        json += ams::JSON::Key("flows") + "[";
+        // now add array of flows:
+        bool first = true;
+        fareResults.ForEachFlow([&json, &first](const FoundFareKey& key, auto firstRow, auto lastRow)
         {
-            if (first2)
+            if (first)
             {
-                first2 = false;
+                first = false;
             }
             else
             {
                 json += ',';
             }
             json += "{";
-            json += ams::JSON::NVPair("a", q.adultPrice_, true) + ams::JSON::NVPair("c", q.childPrice_, true) +
-                ams::JSON::NVPair("t", q.ticketcode_.GetString(), true) +
-                ams::JSON::NVPair("cl", q.ticketClass_, true) +
-                ams::JSON::NVPair("tt", q.ticketType_, true) +
-                ams::JSON::NVPair("r", q.restrictionCode_.GetString());
-            json += "}"; // close single fare element
-        }
-        json += "]"; // close fare array 
-        json += "}"; // close single flow element
+            json += ams::JSON::NVPair("o", key.flow_.origin.GetString(), true) +
+                ams::JSON::NVPair("d", key.flow_.destination.GetString(), true) +
+                ams::JSON::NVPair("route", key.route_.GetString(), true) +
+                ams::JSON::NVPair("flowid", key.flowid_, true) +
+                ams::JSON::NVPair("discount", key.discInd_, true) +
+                ams::JSON::Key("fares") + "[";
+            bool first2 = true;
+            for (auto row = firstRow; row != lastRow; ++row)
+            {
+                auto& q = row->fare_;
+                if (first2)
+                {
+                    first2 = false;
+                }
+                else
+                {
+                    json += ',';
+                }
+                json += "{";
+                json += ams::JSON::NVPair("a", q.adultPrice_, true) + ams::JSON::NVPair("c", q.childPrice_, true) +
+                    ams::JSON::NVPair("t", q.ticketcode_.GetString(), true) +
+                    ams::JSON::NVPair("cl", static_cast<int>(q.ticketClass_), true) +
+                    ams::JSON::NVPair("tt", q.ticketType_, true) +
+                    ams::JSON::NVPair("r", q.restrictionCode_.GetString());
+                json += "}"; // close single fare element
+            }
+            json += "]"; // close fare array 
+            json += "}"; // close single flow element
+        });
+        json += "]"; // close flow array
+        json += "}"; // close single result element
     }
-    json += "]"; // close flow array
-    json += "}"; // close single result element
-    json += "]"; // close result array (only one element at the moment)
+    json += "]"; // close result array (one element per railcard)
     json += "},"; // close fares element
     json += ams::JSON::Key("times") + "{" +
         ams::JSON::NVPair("ocrs", originalSearchParams.crsOrigin_.GetString(), true) +
@@ -250,14 +375,199 @@ void HTTPManager::GenerateJSON(std::string& json,
 }
 
 
+void HTTPManager::GenerateCalendarJSON(std::string& json,
+    uint64_t elapsed,
+    const FareSearchParams& originalSearchParams,
+    const FareCalendar& calendar
+    ) const
+{
+    uint64_t utcJS = ams::GetJSDateMilliseconds();
+    json = "{" + ams::JSON::Key("tech") + "{" + ams::JSON::NVPair("serverutc", utcJS, true) +
+        ams::JSON::NVPair("serverCPU", elapsed, true) + ams::JSON::NVPair("computerID", GetComputerID(), true) +
+        ams::JSON::NVPair("dataset", static_cast<int>(RJISDataset::Get().version_)) + "},";
+    json += ams::JSON::Key("calendar") + "{" +
+        ams::JSON::NVPair("o", originalSearchParams.flow_.origin.GetString(), true) +
+        ams::JSON::NVPair("d", originalSearchParams.flow_.destination.GetString(), true) +
+        ams::JSON::NVPair("rlc", originalSearchParams.railcard_.GetString(), true) +
+        ams::JSON::NVPair("intervals", static_cast<int>(calendar.intervals_.size()), true) +
+        ams::JSON::Key("days") + "[";
+    for (auto& day : calendar.days_)
+    {
+        int y, m, d;
+        day.travelDate_.GetYMD(y, m, d);
+        std::ostringstream datestr;
+        datestr << std::setfill('0') << std::setw(4) << y << '-' << std::setw(2) << m << '-' << std::setw(2) << d;
+        json += "{" + ams::JSON::NVPair("date", datestr.str(), true) +
+            ams::JSON::NVPair("a", day.cheapestAdult_, true) +
+            ams::JSON::NVPair("c", day.cheapestChild_) + "},";
+    }
+    if (json.back() == ',')
+    {
+        json = json.substr(0, json.length() - 1);
+    }
+    json += "]"; // close days array
+    json += "}"; // close calendar element
+    json += "}"; // close json
+}
+
+void HTTPManager::GenerateToDestinationJSON(std::string& json,
+    uint64_t elapsed,
+    const FareSearchParams& originalSearchParams,
+    const OriginFareResultsMap& originFareResults
+    ) const
+{
+    uint64_t utcJS = ams::GetJSDateMilliseconds();
+    json = "{" + ams::JSON::Key("tech") + "{" + ams::JSON::NVPair("serverutc", utcJS, true) +
+        ams::JSON::NVPair("serverCPU", elapsed, true) + ams::JSON::NVPair("computerID", GetComputerID(), true) +
+        ams::JSON::NVPair("dataset", static_cast<int>(RJISDataset::Get().version_)) + "},";
+    json += ams::JSON::Key("to") + "{" +
+        ams::JSON::NVPair("d", originalSearchParams.flow_.destination.GetString(), true) +
+        ams::JSON::NVPair("rlc", originalSearchParams.railcard_.GetString(), true) +
+        ams::JSON::Key("origins") + "[";
+    // the cheapest fares from each origin that has any:
+    for (auto& origin : originFareResults)
+    {
+        int cheapestAdult, cheapestChild;
+        origin.second.GetCheapest(cheapestAdult, cheapestChild);
+        if (cheapestAdult >= 0 || cheapestChild >= 0)
+        {
+            json += "{" + ams::JSON::NVPair("o", origin.first.GetString(), true) +
+                ams::JSON::NVPair("a", cheapestAdult, true) +
+                ams::JSON::NVPair("c", cheapestChild) + "},";
+        }
+    }
+    if (json.back() == ',')
+    {
+        json = json.substr(0, json.length() - 1);
+    }
+    json += "]"; // close origins array
+    json += "}"; // close to element
+    json += "}"; // close json
+}
+
 void HTTPManager::ProcessGet(std::string uri)
 {
     static const std::string RJISURI = "/PFRJIS";
+    static const std::string CALENDARURI = "/PFCAL";
+    static const std::string TODESTINATIONURI = "/PFTO";
+    static const std::string ADMINURI = "/PFADMIN/";
+    static const std::string RELOADURI = "/PFADMIN/reload";
+    static const std::string STATUSURI = "/PFADMIN/status";
+    static const std::string LOADREPORTURI = "/PFADMIN/loadreport";
+    static const int calendarDays = 90;
+
+    // pin the dataset published now for the whole request - if a new one is published while we are working
+    // we carry on with this one and it is freed when the last request using it finishes:
+    RJISDataset::Scope datasetScope;
+
+    // containers built while answering the request come from this thread's request arena - everything in it is
+    // released in one go when the scope ends, after the response has been written. The scope must be declared before
+    // any container that uses the arena:
+    static thread_local RequestArena requestArena;
+    RequestArena::Scope arenaScope(requestArena);
+
     bool found = false;
     std::string responseBody;
     std::string responseString;
 	size_t compareLength = RJISURI.length();
-    if (uri.substr(0, compareLength) == RJISURI)
+    if (uri.substr(0, ADMINURI.length()) == ADMINURI && !IsAdminAllowed())
+    {
+        found = true;
+        file = false;
+        responseString = "HTTP/1.0 403 Forbidden\r\n";
+        responseBody = "{" + ams::JSON::NVPair("error", std::string("forbidden")) + "}";
+    }
+    else if (uri == RELOADURI || uri == STATUSURI)
+    {
+        // the admin responses are not for pages from other sites, so there is no Access-Control-Allow-Origin header:
+        found = true;
+        file = false;
+        auto& loader = DatasetLoader::GetInstance();
+
+        // a reload reads the RJIS files in the background and publishes them when complete:
+        bool started = uri == RELOADURI && loader.StartReload();
+        responseString = "HTTP/1.0 200 OK\r\n";
+        responseBody = "{" + ams::JSON::NVPair("started", started ? 1 : 0, true) +
+            ams::JSON::NVPair("loading", loader.IsLoading() ? 1 : 0, true) +
+            ams::JSON::NVPair("dataset", static_cast<int>(RJISDataset::Get().version_)) + "}";
+    }
+    else if (uri == LOADREPORTURI)
+    {
+        // the per-file and per-container costs of the last full load of the RJIS files:
+        found = true;
+        file = false;
+        responseString = "HTTP/1.0 200 OK\r\n";
+        responseBody = DatasetLoader::GetInstance().GetLastReportJSON();
+    }
+    else if (uri.substr(0, CALENDARURI.length()) == CALENDARURI)
+    {
+        found = true;
+        file = false;
+        std::string origin, destination, railcard;
+        bool success;
+        GetODR(success, origin, destination, railcard, uri.substr(CALENDARURI.length()));
+        ams::MakeUpper(origin);
+        ams::MakeUpper(destination);
+        std::vector<RailcardCode> railcards;
+        GetRailcardList(railcards, railcard);
+
+        responseString = "HTTP/1.0 200 OK\r\nAccess-Control-Allow-Origin: *\r\n";
+        if (success)
+        {
+            LARGE_INTEGER prefareTime, postfareTime;
+            QueryPerformanceCounter(&prefareTime);
+
+            // cheapest fares for each day from today:
+            FareSearchParams searchParams(origin, destination, railcards.front().GetString());
+            FareCalendar calendar;
+            ProcessFareList farelist;
+            farelist.GetFareCalendar(calendar, searchParams, calendarDays);
+
+            QueryPerformanceCounter(&postfareTime);
+            GenerateCalendarJSON(responseBody, ams::LiDiff(postfareTime, prefareTime) * 1'000'000 / perfFreq, searchParams, calendar);
+        }
+        else
+        {
+            responseBody =
+                "<?xml version = \"1.0\" encoding = \"UTF-8\" ?>\n"
+                "<powerfares>Bad request</powerfares>\n";
+        }
+    }
+    else if (uri.substr(0, TODESTINATIONURI.length()) == TODESTINATIONURI)
+    {
+        // the cheapest fares from every active station to one destination:
+        found = true;
+        file = false;
+        std::string destination, railcard;
+        bool success;
+        GetDR(success, destination, railcard, uri.substr(TODESTINATIONURI.length()));
+        ams::MakeUpper(destination);
+        std::vector<RailcardCode> railcards;
+        GetRailcardList(railcards, railcard);
+
+        responseString = "HTTP/1.0 200 OK\r\nAccess-Control-Allow-Origin: *\r\n";
+        if (success)
+        {
+            LARGE_INTEGER prefareTime, postfareTime;
+            QueryPerformanceCounter(&prefareTime);
+
+            // the origin of the search is not used:
+            FareSearchParams searchParams(destination, destination, railcards.front().GetString());
+            OriginFareResultsMap originFareResults;
+            ProcessFareList farelist;
+            farelist.GetAllFaresToDestination(originFareResults, RJISDataset::Get().activeStations, searchParams);
+
+            QueryPerformanceCounter(&postfareTime);
+            GenerateToDestinationJSON(responseBody, ams::LiDiff(postfareTime, prefareTime) * 1'000'000 / perfFreq, searchParams, originFareResults);
+        }
+        else
+        {
+            responseBody =
+                "<?xml version = \"1.0\" encoding = \"UTF-8\" ?>\n"
+                "<powerfares>Bad request</powerfares>\n";
+        }
+    }
+    else if (uri.substr(0, compareLength) == RJISURI)
     {
         found = true;
         file = false;
@@ -269,12 +579,10 @@ void HTTPManager::ProcessGet(std::string uri)
 		
 		ams::MakeUpper(origin);
 		ams::MakeUpper(destination);
-		ams::MakeUpper(railcard);
 
-        if (railcard.empty())
-        {
-            railcard = "   ";
-        }
+        // the railcard parameter may be a comma separated list of railcards - all are searched in a single pass:
+        std::vector<RailcardCode> railcards;
+        GetRailcardList(railcards, railcard);
 		//std::cout << "o is " << origin << std::endl;
 		//std::cout << "d is " << destination << std::endl;
 		//std::cout << "r is " << railcard << std::endl;
@@ -288,17 +596,46 @@ void HTTPManager::ProcessGet(std::string uri)
             LARGE_INTEGER prefareTime, postfareTime;
             QueryPerformanceCounter(&prefareTime);
 
-            // get all rail fares:
-            FareResultsMap fareResults;
-            FareSearchParams searchParams(origin, destination, railcard);
-			farelist.GetAllFares(fareResults, searchParams);
-            // Get all plusbusFares:
-            FoundPlusBus plusbusFares;
-            farelist.GetPlusbusFares(plusbusFares, searchParams);
-
+            // the fares, the plusbus fares and the timetable share nothing but the search, so they are evaluated at
+            // the same time on the worker pool. The fields derived from the search (the CRS codes the timetable
+            // needs) are filled in first - the fare search sets them again so the other stages read a copy:
+            RailcardFareResultsMap fareResults;
+            FareSearchParams searchParams(origin, destination, railcards.front().GetString());
+            GetParamsDerivedFields(searchParams);
+            const FareSearchParams stageSearchParams(searchParams);
+            PlusbusMap plusbusFares;
             std::vector<TTTypes::Journey> journeys;
-            ProcessTimetableRequest timetableReq;
-            timetableReq.GetTimes(journeys, searchParams);
+
+            // the calling thread always runs the first stage - the fare search builds its results in this thread's
+            // request arena so it must not run anywhere else. The other stages run with no arena - on a worker there is
+            // none, and if the workers are busy the calling thread runs them too so its arena is put aside for them:
+            auto& dataset = RJISDataset::Get();
+            WorkerPool::GetInstance().ParallelFor(3, [&](size_t stage) {
+                RJISDataset::Scope stageDatasetScope(dataset);
+                if (stage == 0)
+                {
+                    // get all rail fares for every railcard requested:
+                    farelist.GetAllFares(fareResults, searchParams, railcards);
+                    return;
+                }
+
+                RequestArena::NoArenaScope noArenaScope;
+                if (stage == 1)
+                {
+                    // get all plusbus fares - plusbus fares are discounted by railcard so we need a search for each one:
+                    for (auto& rc : railcards)
+                    {
+                        FareSearchParams pbSearchParams(stageSearchParams);
+                        pbSearchParams.railcard_ = rc;
+                        farelist.GetPlusbusFares(plusbusFares[rc.GetString()], pbSearchParams);
+                    }
+                }
+                else
+                {
+                    ProcessTimetableRequest timetableReq;
+                    timetableReq.GetTimes(journeys, stageSearchParams);
+                }
+            });
 
             QueryPerformanceCounter(&postfareTime);
             std::cerr << "Got fares... in time " << ams::LiDiff(postfareTime, prefareTime) * 1'000'000 / perfFreq<< " microseconds\n";
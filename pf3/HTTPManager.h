@@ -17,6 +17,7 @@ class HTTPManager
     uint64_t filesize;
     bool file;
     std::string filename;
+    bool loopbackPeer_;     // the connection is from this device - set by the server socket when it accepts
 	ProcessFareList fl;
     static const int64_t GetPerfFrequency()
     {
@@ -26,14 +27,18 @@ class HTTPManager
     }
     static int64_t perfFreq;
 public:
-    HTTPManager(BYTE* response, int length) : response(response), responseMaxLength(length), file(false)  {
+    HTTPManager(BYTE* response, int length) : response(response), responseMaxLength(length), file(false), loopbackPeer_(false)  {
     }
 
     virtual ~HTTPManager() {}
     bool PushData(std::vector<BYTE>& input);
     void ProcessCompleteRequest();
-    void GenerateJSON(std::string & json, uint64_t elapsed, const FareSearchParams & originalSearchParams, const FoundPlusBus & plusbusResultsMap, const FareResultsMap & fareResultsMap, const std::vector<TTTypes::Journey> journeys) const;
+    void GenerateJSON(std::string & json, uint64_t elapsed, const FareSearchParams & originalSearchParams, const PlusbusMap & plusbusResultsMap, const RailcardFareResultsMap & railcardFareResults, const std::vector<TTTypes::Journey> journeys) const;
+    void GenerateCalendarJSON(std::string & json, uint64_t elapsed, const FareSearchParams & originalSearchParams, const FareCalendar & calendar) const;
+    void GenerateToDestinationJSON(std::string & json, uint64_t elapsed, const FareSearchParams & originalSearchParams, const OriginFareResultsMap & originFareResults) const;
     void ProcessGet(std::string uri);
+    void SetLoopbackPeer(bool loopbackPeer) { loopbackPeer_ = loopbackPeer; }
+    bool IsAdminAllowed() const;
     bool IsFile() { return file; }
     std::string GetFilename() { return filename; }
     uint64_t GetFileSize() { return filesize; }
@@ -0,0 +1,208 @@
+#include "stdafx.h"
+#include "JourneyPlanStore.h"
+
+/* static */
+uint64_t JourneyPlanStore::GetKey(const CRSCode& origin, const CRSCode& destination)
+{
+    auto crs = origin.GetString() + destination.GetString();
+    uint64_t result = 0;
+    for (auto c : crs)
+    {
+        result = (result << 8) | static_cast<uint8_t>(c);
+    }
+    return result;
+}
+
+// process a single line from a jXXX.plan file. Each line contains an origin, a destination and a number of
+// plans. Each plan on the line is separated by a vertical bar character. Comment lines start with
+// two slashes as in C++. Comments are not allowed within plan lines. The first seven characters
+// of a line MUST be the origin and destination crs codes followed by the colon character. Returns
+// false for a comment or blank line:
+bool JourneyPlanStore::PlanFile::AddLine(std::string line)
+{
+    ams::Trim(line);
+
+    // allow blank lines and double-forward-slash comments:
+    if (line.empty() || line.compare(0, 2, "//") == 0)
+    {
+        return false;
+    }
+
+    // two CRS codes followed by a colon must be at the start of a line:
+    if (line.length() < 7 || line[6] != ':')
+    {
+        throw QException("colon expected at column 7");
+    }
+
+    // add an end of line marker - this is used in the line processing state machine below:
+    line += '\x1';
+
+    CRSCode origin(line);
+    CRSCode destination(line, 3);
+
+    // the plans are added to the file once the whole line has been read:
+    std::vector<Oneplan> plans;
+    Oneplan oneplan;
+    enum class States { Init, InCRS, GotCRS } state(States::Init);
+
+    std::string currentCRS;
+    for (auto i = 7u; i < line.length(); ++i)
+    {
+        auto c = line[i];
+        if (state == States::Init)
+        {
+            if (isupper(c))
+            {
+                state = States::InCRS;
+                currentCRS += c;
+            }
+            else if (!isspace(c))
+            {
+                if (c == 1)
+                {
+                    throw QException("unexpected end of line");
+                }
+                else
+                {
+                    throw QException("unexpected character: "s + c);
+                }
+            }
+        }
+        else if (state == States::InCRS)
+        {
+            if (isupper(c))
+            {
+                currentCRS += c;
+                if (currentCRS.length() > 3)
+                {
+                    throw QException("unexpected character: "s + c);
+                }
+            }
+            else if (currentCRS.length() != 3)
+            {
+                if (c == 1)
+                {
+                    throw QException("unexpected end of line");
+                }
+                else if (isspace(c))
+                {
+                    throw QException("unexpected space or tab");
+                }
+                else
+                {
+                    throw QException("unexpected character: "s + c);
+                }
+            }
+            else if (isspace(c))
+            {
+                oneplan.push_back(currentCRS);
+                currentCRS.clear();
+                state = States::GotCRS;
+            }
+            else if (c == '|')
+            {
+                oneplan.push_back(currentCRS);
+                currentCRS.clear();
+                plans.push_back(oneplan);
+                oneplan.clear();
+                state = States::Init;
+            }
+            else if (c == 1)
+            {
+                // end of line here and we must have a 3-character CRS
+                oneplan.push_back(currentCRS);
+                plans.push_back(oneplan);
+            }
+            else
+            {
+                throw QException("unexpected character: "s + c);
+            }
+        }
+        else if (state == States::GotCRS) // we have at least one CRS already and we have just had a separator
+        {
+            if (isupper(c))
+            {
+                currentCRS.push_back(c);
+                state = States::InCRS;
+            }
+            else if (c == '|')
+            {
+                plans.push_back(oneplan);
+                oneplan.clear();
+                state = States::Init;
+            }
+            else if (c == 1)
+            {
+                // end of line - a plan is only ended by a bar or a CRS code at the end of the line
+            }
+            else if (c != ' ')
+            {
+                throw QException("unexpected character: "s + c);
+            }
+        }
+    }
+
+    for (auto& plan : plans)
+    {
+        vias_.insert(vias_.end(), plan.begin(), plan.end());
+        planEnds_.push_back(static_cast<uint32_t>(vias_.size()));
+    }
+    lines_.push_back(Line{ GetKey(origin, destination), static_cast<uint32_t>(plans.size()) });
+    return true;
+}
+
+void JourneyPlanStore::Build()
+{
+    // a later line for the same origin and destination replaces an earlier one - find the last line for each so that
+    // only its plans are copied:
+    std::unordered_map<uint64_t, const PlanFile::Line*> lastLines;
+    size_t planCount = 0;
+    for (auto& file : files_)
+    {
+        for (auto& line : file.lines_)
+        {
+            auto& last = lastLines[line.key];
+            if (last != nullptr)
+            {
+                planCount -= last->planCount;
+            }
+            planCount += line.planCount;
+            last = &line;
+        }
+    }
+
+    vias_.clear();
+    planOffsets_.assign(1, 0);
+    planOffsets_.reserve(planCount + 1);
+    odPlans_.clear();
+    odPlans_.reserve(lastLines.size());
+    for (auto& file : files_)
+    {
+        size_t plan = 0;
+        for (auto& line : file.lines_)
+        {
+            if (lastLines[line.key] == &line)
+            {
+                odPlans_[line.key] = PlanRange{ static_cast<uint32_t>(planOffsets_.size() - 1), line.planCount };
+                for (uint32_t i = 0; i < line.planCount; ++i)
+                {
+                    auto first = plan + i == 0 ? 0 : file.planEnds_[plan + i - 1];
+                    vias_.insert(vias_.end(), file.vias_.begin() + first, file.vias_.begin() + file.planEnds_[plan + i]);
+                    planOffsets_.push_back(static_cast<uint32_t>(vias_.size()));
+                }
+            }
+            plan += line.planCount;
+        }
+    }
+    files_.clear();
+    vias_.shrink_to_fit();
+}
+
+size_t JourneyPlanStore::GetMemoryBytes() const
+{
+    // each entry of the hash table is a node on a list - its key, value and two pointers:
+    return vias_.capacity() * sizeof(CRSCode) +
+        planOffsets_.capacity() * sizeof(uint32_t) +
+        odPlans_.bucket_count() * sizeof(void*) +
+        odPlans_.size() * (sizeof(std::pair<const uint64_t, PlanRange>) + 2 * sizeof(void*));
+}
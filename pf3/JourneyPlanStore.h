@@ -0,0 +1,88 @@
+#pragma once
+#include <deque>
+
+// a single journey plan. This is simply a list of crs codes - intervening stations at which a change
+// must take place. This list does not contain the origin and final destination CRS codes, just
+// the intervening ones:
+typedef std::vector<CRSCode> Oneplan;
+
+// JourneyPlanStore - the journey plans from every jXXX.plan file, read with the dataset so that no plan file is read
+// while answering a request. The plans for all origins and destinations are held in two flat arrays - the via
+// stations of every plan one after another and the offset of each plan's first via - and an origin and destination
+// is found by hashing to its range of plans.
+//
+// The files are read in parallel by the reader threads: each file is parsed into its own PlanFile and Build merges
+// them once every file has been read.
+class JourneyPlanStore
+{
+public:
+    // the plans read from one file:
+    class PlanFile
+    {
+        struct Line
+        {
+            uint64_t key;               // the origin and destination (see GetKey)
+            uint32_t planCount;
+        };
+        std::vector<CRSCode> vias_;
+        std::vector<uint32_t> planEnds_;    // the end of each plan in vias_
+        std::vector<Line> lines_;
+        friend class JourneyPlanStore;
+    public:
+        // add a line of a plan file - a line that is not valid throws and adds nothing. Returns false for a comment
+        // or blank line:
+        bool AddLine(std::string line);
+    };
+
+private:
+    struct PlanRange
+    {
+        uint32_t firstPlan;
+        uint32_t planCount;
+    };
+
+    std::vector<CRSCode> vias_;
+    std::vector<uint32_t> planOffsets_;                 // the first via of each plan - one more entry for the end
+    std::unordered_map<uint64_t, PlanRange> odPlans_;   // by GetKey(origin, destination)
+    std::deque<PlanFile> files_;                        // read but not yet merged
+
+    static uint64_t GetKey(const CRSCode& origin, const CRSCode& destination);
+
+public:
+    // a file for a reader thread to read plans into - called before the file is queued:
+    PlanFile& AddFile()
+    {
+        files_.emplace_back();
+        return files_.back();
+    }
+
+    // merge the files read. A later line for the same origin and destination replaces an earlier one and its plans
+    // are dropped:
+    void Build();
+
+    size_t GetPlanCount(const CRSCode& origin, const CRSCode& destination) const
+    {
+        auto p = odPlans_.find(GetKey(origin, destination));
+        return p == odPlans_.end() ? 0 : p->second.planCount;
+    }
+
+    // call f for each plan from origin to destination with the first and last (one past the end) via station:
+    template <class F> void ForEachPlan(const CRSCode& origin, const CRSCode& destination, F f) const
+    {
+        auto p = odPlans_.find(GetKey(origin, destination));
+        if (p != odPlans_.end())
+        {
+            for (auto plan = p->second.firstPlan; plan < p->second.firstPlan + p->second.planCount; ++plan)
+            {
+                f(vias_.data() + planOffsets_[plan], vias_.data() + planOffsets_[plan + 1]);
+            }
+        }
+    }
+
+    // the number of origin and destination pairs and the memory they use:
+    size_t GetPairCount() const
+    {
+        return odPlans_.size();
+    }
+    size_t GetMemoryBytes() const;
+};
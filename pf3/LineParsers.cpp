@@ -1,18 +1,148 @@
 #include "stdafx.h"
+#include <numeric>
 #include "LineParsers.h"
 #include <ams/fileutils.h>
 #include "PrintProgress.h"
-#include "RJISMaps.h"
-#include "RJISTTMaps.h"
+#include "RJISDataset.h"
+#include "WorkerPool.h"
 
 namespace LineParsers
 {
 
-HANDLE AddPlusBusNLCFile(std::string filename)
+namespace {
+
+// the MCA file is read in chunks of whole trains - a chunk is cut at the first BS record after it reaches
+// chunkLines lines. Each chunk is parsed into its own part of the timetable and the chunks are parsed in batches on
+// the worker pool while the reader thread carries on reading:
+const size_t chunkLines = 50000;
+
+struct TimetableChunk
+{
+    int firstLine;                      // line number of the first line in the file (from 0)
+    std::vector<std::string> lines;
+};
+
+// parse the trains in a chunk - a train runs from its BS record to its LT record and never crosses the end of a
+// chunk. Returns the number of records stored:
+uint64_t ParseTimetableChunk(const TimetableChunk& chunk, const TiplocUpdates& tiplocUpdates, Timetable& part)
+{
+    TTTypes::TrainRun oneRun;
+    uint64_t records = 0;
+    for (size_t i = 0; i < chunk.lines.size(); ++i)
+    {
+        auto& line = chunk.lines[i];
+        int linenumber = chunk.firstLine + static_cast<int>(i);
+        try
+        {
+            if (line.length() > 15)
+            {
+                std::string recordType = line.substr(0, 2);
+                if (recordType == "BS")
+                {
+                    std::string trainUID = line.substr(3, 6);
+                    RJISDate::Range daterange = TTTypes::GetDateRangeFromBS(line);
+                    RJISDate::Dayset dayset(line.substr(21, 7));
+                    oneRun.runningDates = daterange;
+                    oneRun.runningDays = dayset;
+                    oneRun.trainUID = trainUID;
+                    oneRun.trainID = line.substr(32, 4);
+                    oneRun.stpIndicator = line[79];
+                    oneRun.linenumber = linenumber;
+
+                    // an STP cancellation has no calls - it is kept so that it can cancel the permanent schedule
+                    // on its dates (see ServiceCalendar):
+                    if (oneRun.stpIndicator == 'C')
+                    {
+                        oneRun.ClearCalls();
+                        part.Add(oneRun);
+                        ++records;
+                    }
+                }
+                if ((recordType == "LI" || recordType == "LO") && line.substr(10, 4) != "    ")
+                {
+                    TTTypes::TrainCall tc(line, tiplocUpdates);
+                    oneRun.AddCall(tc);
+                    ++records;
+                }
+                else if (recordType == "LT")
+                {
+                    // the departures and calls at each station are indexed once the whole timetable is read (see
+                    // TimetableIndex):
+                    TTTypes::TrainCall tc(line, tiplocUpdates);
+                    oneRun.AddCall(tc);
+                    ++records;
+                    part.Add(oneRun);
+                    oneRun.ClearCalls();
+                }
+            }
+        }
+        catch (std::exception ex)
+        {
+            std::ostringstream oss;
+            oss << "Problem at line " << linenumber + 1 << " " << ex.what();
+            throw QException(oss.str());
+        }
+    }
+    return records;
+}
+
+// TimetableReader - collects the lines of one MCA file into chunks and parses them. It belongs to the SourceReader
+// for the file and is only used on the reader thread, so it needs no lock:
+class TimetableReader
+{
+    const TiplocUpdates& tiplocUpdates_;
+    int linenumber_ = 0;
+    std::vector<TimetableChunk> chunks_;        // read but not yet parsed
+    std::vector<Timetable> parts_;              // one for each chunk parsed
+
+    // parse the chunks read so far on the worker pool:
+    void ParseChunks()
+    {
+        std::vector<Timetable> parts(chunks_.size());
+        std::vector<uint64_t> records(chunks_.size());
+        WorkerPool::GetInstance().ParallelFor(chunks_.size(), [this, &parts, &records](size_t i) {
+            records[i] = ParseTimetableChunk(chunks_[i], tiplocUpdates_, parts[i]);
+        });
+        SourceReader::CountRecord(std::accumulate(records.begin(), records.end(), uint64_t(0)));
+        std::move(parts.begin(), parts.end(), std::back_inserter(parts_));
+        chunks_.clear();
+    }
+
+public:
+    explicit TimetableReader(const TiplocUpdates& tiplocUpdates) : tiplocUpdates_(tiplocUpdates) {}
+
+    void AddLine(std::string line)
+    {
+        if (chunks_.empty() || (chunks_.back().lines.size() >= chunkLines && line.compare(0, 2, "BS") == 0))
+        {
+            // enough chunks to keep every worker busy:
+            if (chunks_.size() > WorkerPool::GetInstance().GetThreadCount())
+            {
+                ParseChunks();
+            }
+            chunks_.push_back({ linenumber_, {} });
+            chunks_.back().lines.reserve(chunkLines + 100);
+        }
+        chunks_.back().lines.push_back(std::move(line));
+        ++linenumber_;
+    }
+
+    // parse the last chunks and add the runs of every part to the timetable in file order:
+    void Finish(Timetable& timetable)
+    {
+        ParseChunks();
+        timetable.Append(parts_);
+        parts_.clear();
+    }
+};
+
+}
+
+HANDLE AddPlusBusNLCFile(RJISDataset& dataset, std::string filename, SourceStats* stats)
 {
     HANDLE event = CreateEvent(0, FALSE, FALSE, 0);
     FileReaderQueue& queue = FileReaderQueue::GetInstance();
-    queue.Add(ams::FastLineReader(filename, [](std::string line) {
+    queue.Add(SourceReader(filename, [&dataset](std::string line) {
         static PrintProgress& pp = PrintProgress::GetInstance();
         static int linenumber = 0;
         pp.Print();
@@ -24,23 +154,24 @@ HANDLE AddPlusBusNLCFile(std::string filename)
             }
             UNLC mainStationNLC(line, 0);
             UNLC plusbusNLC(line, 4);
-            if (RJISMaps::plusbusNLCMap.find(mainStationNLC) != RJISMaps::plusbusNLCMap.end())
+            if (dataset.plusbusNLCMap.find(mainStationNLC) != dataset.plusbusNLCMap.end())
             {
                 std::cout << mainStationNLC << ":" << plusbusNLC << "\n";
             }
-            RJISMaps::plusbusNLCMap[mainStationNLC] = plusbusNLC;
+            dataset.plusbusNLCMap[mainStationNLC] = plusbusNLC;
+            SourceReader::CountRecord();
         }
-    }, event));
+    }, event, stats));
 
     return event;
 }
 
 
-HANDLE AddPlusBusRestrictionsFile(std::string filename)
+HANDLE AddPlusBusRestrictionsFile(RJISDataset& dataset, std::string filename, SourceStats* stats)
 {
     HANDLE event = CreateEvent(0, FALSE, FALSE, 0);
     FileReaderQueue& queue = FileReaderQueue::GetInstance();
-    queue.Add(ams::FastLineReader(filename, [](std::string line) {
+    queue.Add(SourceReader(filename, [&dataset](std::string line) {
         static PrintProgress& pp = PrintProgress::GetInstance();
         static int linenumber = 0;
         pp.Print();
@@ -51,104 +182,102 @@ HANDLE AddPlusBusRestrictionsFile(std::string filename)
                 throw QException("plusbus restrictions file - line length not equal to 8");
             }
             UFlow flow(line, 0);
-            RJISMaps::plusbusRestrictionSet.insert(flow);
+            dataset.plusbusRestrictionSet.insert(flow);
+            SourceReader::CountRecord();
         }
-    }, event));
+    }, event, stats));
 
     return event;
 }
 
 
-HANDLE AddTicketTypeFile(std::string filename)
+HANDLE AddTicketTypeFile(RJISDataset& dataset, std::string filename, SourceStats* stats)
 {
     HANDLE event = CreateEvent(0, FALSE, FALSE, 0);
     FileReaderQueue& queue = FileReaderQueue::GetInstance();
-    queue.Add(ams::FastLineReader(filename, [](std::string line) {
+    queue.Add(SourceReader(filename, [&dataset](std::string line) {
         static PrintProgress& pp = PrintProgress::GetInstance();
         static int linenumber = 0;
         pp.Print();
-        if (line.length() == 113 && line[0] == 'R')
+        if (IsTicketTypeRecord(line))
         {
-            TicketCode key(line, 1);
-            RJISTypes::TicketTypeValue value(line, 4);
-            RJISMaps::ticketTypes.insert(std::make_pair(key, value));
+            AddTicketTypeRecord(dataset, line);
+            SourceReader::CountRecord();
         }
-    }, event));
+    }, event, stats));
 
     return event;
 }
 
-HANDLE AddNDFFile(std::string filename)
+HANDLE AddNDFFile(RJISDataset& dataset, std::string filename, SourceStats* stats)
 {
     HANDLE event = CreateEvent(0, FALSE, FALSE, 0);
     FileReaderQueue& queue = FileReaderQueue::GetInstance();
-    queue.Add(ams::FastLineReader(filename, [](std::string line) {
+    queue.Add(SourceReader(filename, [&dataset, linenumber = 0](std::string line) mutable {
         static PrintProgress& pp = PrintProgress::GetInstance();
-        static int linenumber = 0;
         pp.Print();
-        if (line.length() == 67 && line[0] == 'R')
+        if (IsNDFRecord(line))
         {
             UFlow flow;
             flow.Set(line, 1);
             RJISTypes::NDFMainValue value(line, 9);
             value.linenumber = linenumber; // AMS debug
-            RJISMaps::ndfMain.insert(std::make_pair(flow, value));
+            dataset.ndfMain.insert(std::make_pair(flow, value));
+            SourceReader::CountRecord();
         }
         linenumber++;
-    }, event));
+    }, event, stats));
     return event;
 }
 
 
-HANDLE AddNFOFile(std::string filename)
+HANDLE AddNFOFile(RJISDataset& dataset, std::string filename, SourceStats* stats)
 {
     HANDLE event = CreateEvent(0, FALSE, FALSE, 0);
     FileReaderQueue& queue = FileReaderQueue::GetInstance();
-    static int linenumber = 0;
-    queue.Add(ams::FastLineReader(filename, [](std::string line) {
+    queue.Add(SourceReader(filename, [&dataset, linenumber = 0](std::string line) mutable {
         static PrintProgress& pp = PrintProgress::GetInstance();
-        static int linenumber = 0;
         pp.Print();
-        if (line.length() == 67 && line[0] == 'R')
+        if (IsNDFRecord(line))
         {
             UFlow flow;
             flow.Set(line, 1);
             RJISTypes::NDFMainValue value(line, 9);
             value.linenumber = linenumber; // AMS debug
-            RJISMaps::nfoMain.insert(std::make_pair(flow, value));
+            dataset.nfoMain.insert(std::make_pair(flow, value));
+            SourceReader::CountRecord();
         }
         linenumber++;
-    }, event));
+    }, event, stats));
     return event;
 }
 
-HANDLE AddRailcardFile(std::string filename)
+HANDLE AddRailcardFile(RJISDataset& dataset, std::string filename, SourceStats* stats)
 {
     HANDLE event = CreateEvent(0, FALSE, FALSE, 0);
     FileReaderQueue& queue = FileReaderQueue::GetInstance();
-    queue.Add(ams::FastLineReader(filename, [](std::string line) {
+    queue.Add(SourceReader(filename, [&dataset](std::string line) {
         static PrintProgress& pp = PrintProgress::GetInstance();
         static int linenumber = 0;
         pp.Print();
-        if (line.length() == 127 && line[0] != '\\')
+        if (IsRailcardRecord(line))
         {
-            RailcardCode code(line, 0);
-            RJISTypes::RailcardValue value(line, 3);
-            RJISMaps::railcards.insert(std::make_pair(code, value));
+            AddRailcardRecord(dataset, line);
+            SourceReader::CountRecord();
         }
         linenumber++;
-    }, event));
+    }, event, stats));
     return event;
 }
 
 // railcard minimum fares file - normally ".RCM". Railcard minimum fares apply to adult
 // fares only and the use of the minimum fare is on certain trains only (marked by
 // the train restriction):
-HANDLE AddRailcardMinFaresFile(std::string filename)
+HANDLE AddRailcardMinFaresFile(RJISDataset& dataset, std::string filename, SourceStats* stats)
 {
     HANDLE event = CreateEvent(0, FALSE, FALSE, 0);
     FileReaderQueue& queue = FileReaderQueue::GetInstance();
-    queue.Add(ams::FastLineReader(filename, [](std::string line) {
+    queue.Add(SourceReader(filename, [&dataset](std::string line) {
         static PrintProgress& pp = PrintProgress::GetInstance();
         static int linenumber = 0;
         pp.Print();
@@ -158,35 +287,35 @@ HANDLE AddRailcardMinFaresFile(std::string filename)
             RJISTypes::RailcardMinValue value(line, 6);
         }
         linenumber++;
-    }, event));
+    }, event, stats));
     return event;
 }
 
 
-HANDLE AddFFLFile(std::string filename)
+HANDLE AddFFLFile(RJISDataset& dataset, std::string filename, SourceStats* stats)
 {
     HANDLE event = CreateEvent(0, FALSE, FALSE, 0);
     FileReaderQueue& queue = FileReaderQueue::GetInstance();
-    queue.Add(ams::FastLineReader(filename, [](std::string line) {
+    queue.Add(SourceReader(filename, [&dataset](std::string line) {
         static PrintProgress& pp = PrintProgress::GetInstance();
         static int linenumber = 0;
         pp.Print();
-        // RF indicates a Flow record - do not process usage_code = 'C'
-        if (line.length() == 49 && line[0] == 'R' && line[1] == 'F' && line[18] != 'C')
+        if (IsFlowRecord(line))
         {
             UFlow flow;
             flow.Set(line, 2);
             RJISTypes::FFLFlowMainValue value(line, 10);
-            RJISMaps::flowMainFlows.insert(std::make_pair(flow, value));
+            dataset.flowMainFlows.insert(std::make_pair(flow, value));
             // check if flow valid in both directions:
             if (line[19] == 'R')
             {
                 flow.Reverse();
-                RJISMaps::flowMainFlows.insert(std::make_pair(flow, value));
+                dataset.flowMainFlows.insert(std::make_pair(flow, value));
             }
+            SourceReader::CountRecord();
         }
         // else we probably have a Fare record:
-        else if (line.length() == 22 && line[0] == 'R' && line[1] == 'T')
+        else if (IsFareRecord(line))
         {
             int flowid = 0;
             for (auto i = 0u; i < 7; ++i)
@@ -194,17 +323,18 @@ HANDLE AddFFLFile(std::string filename)
                 flowid = flowid * 10 + line[2 + i] - '0';
             }
             RJISTypes::FFLFareMainValue value(line, 9);
-            RJISMaps::flowMainFares.insert(std::make_pair(flowid, value));
+            dataset.flowMainFares.insert(std::make_pair(flowid, value));
+            SourceReader::CountRecord();
         }
-    }, event));
+    }, event, stats));
     return event;
 }
 
-HANDLE AddClustersFile(std::string filename)
+HANDLE AddClustersFile(RJISDataset& dataset, std::string filename, SourceStats* stats)
 {
     HANDLE event = CreateEvent(0, FALSE, FALSE, 0);
     FileReaderQueue& queue = FileReaderQueue::GetInstance();
-    queue.Add(ams::FastLineReader(filename, [](std::string line) {
+    queue.Add(SourceReader(filename, [&dataset](std::string line) {
         static PrintProgress& pp = PrintProgress::GetInstance();
         static int linenumber = 0;
         pp.Print();
@@ -213,35 +343,37 @@ HANDLE AddClustersFile(std::string filename)
             UNLC clusterID(line, 1);
             UNLC stationNLC(line, 5);
             RJISDate::Range daterange(line, 9);
-            RJISMaps::clusters[stationNLC][clusterID].push_back(daterange);
-            RJISMaps::decluster[clusterID].push_back(stationNLC);
+            dataset.clusters[stationNLC][clusterID].push_back(daterange);
+            dataset.decluster[clusterID].push_back(stationNLC);
+            SourceReader::CountRecord();
         }
-    }, event));
+    }, event, stats));
     return event;
 }
 
-HANDLE AddNSDiscountsFile(std::string filename)
+HANDLE AddNSDiscountsFile(RJISDataset& dataset, std::string filename, SourceStats* stats)
 {
     HANDLE event = CreateEvent(0, FALSE, FALSE, 0);
     FileReaderQueue& queue = FileReaderQueue::GetInstance();
-    queue.Add(ams::FastLineReader(filename, [](std::string line) {
+    queue.Add(SourceReader(filename, [&dataset](std::string line) {
         static PrintProgress& pp = PrintProgress::GetInstance();
         static int linenumber = 0;
         pp.Print();
         if (line.length() == 68 && line[0] == 'R')
         {
             RJISTypes::NSDiscEntry nsd(line, 1);
-            RJISMaps::nonStandardDiscounts.push_back(nsd);
+            dataset.nonStandardDiscounts.push_back(nsd);
+            SourceReader::CountRecord();
         }
-    }, event));
+    }, event, stats));
     return event;
 };
 
-HANDLE AddStandardDiscountsFile(std::string filename)
+HANDLE AddStandardDiscountsFile(RJISDataset& dataset, std::string filename, SourceStats* stats)
 {
     HANDLE event = CreateEvent(0, FALSE, FALSE, 0);
     FileReaderQueue& queue = FileReaderQueue::GetInstance();
-    queue.Add(ams::FastLineReader(filename, [](std::string line) {
+    queue.Add(SourceReader(filename, [&dataset](std::string line) {
         static PrintProgress& pp = PrintProgress::GetInstance();
         static int linenumber = 0;
         pp.Print();
@@ -249,45 +381,31 @@ HANDLE AddStandardDiscountsFile(std::string filename)
         {
             RJISTypes::SDiscountKey key(line, 1);
             RJISTypes::SDiscountValue value(line, 4);
-            RJISMaps::standardDiscounts.insert(std::make_pair(key, value));
+            dataset.standardDiscounts.insert(std::make_pair(key, value));
+            SourceReader::CountRecord();
         }
         else if (line.length() == 99 && line[0] == 'S')
         {
             RJISTypes::StatusKey key(line, 1);
             RJISTypes::StatusValue value(line, 12);
-            RJISMaps::statusStandardDiscounts.insert(std::make_pair(key, value));
+            dataset.statusStandardDiscounts.insert(std::make_pair(key, value));
+            SourceReader::CountRecord();
         }
-    }, event));
+    }, event, stats));
     return event;
 };
 
-HANDLE AddLocationsFile(std::string filename)
+HANDLE AddLocationsFile(RJISDataset& dataset, std::string filename, SourceStats* stats)
 {
     HANDLE event = CreateEvent(0, FALSE, FALSE, 0);
     FileReaderQueue& queue = FileReaderQueue::GetInstance();
-    queue.Add(ams::FastLineReader(filename, [](std::string line) {
+    queue.Add(SourceReader(filename, [&dataset](std::string line) {
         static PrintProgress& pp = PrintProgress::GetInstance();
         pp.Print();
-        if (line.length() == 289 && line[0] == 'R' && line[1] == 'L' && line[2] == '7' && line[3] == '0')
+        if (IsLocationRecord(line))
         {
-            UNLC key(line, 36);
-            UNLC group(line, 69);
-            if (isalnum(line[75]) && isalnum(line[76]))
-            {
-                UNLC countyNLC;
-                countyNLC.SetCountyCode(line, 75);
-                RJISDate::Date enddate(2999, 12, 31);
-                RJISMaps::groups[key][countyNLC].push_back(enddate);
-                RJISMaps::degroup[countyNLC].push_back(key);
-            }
-            RJISTypes::LocationLValue value(line, 9);
-            RJISMaps::locations.insert(std::make_pair(key, value));
-            if (key != group)
-            {
-                RJISDate::Date enddate(2999, 12, 31);
-                RJISMaps::groups[key][group].push_back(enddate);
-                RJISMaps::degroup[group].push_back(key);
-            }
+            AddLocationRecord(dataset, line);
+            SourceReader::CountRecord();
         }
         else if (line.length() == 27 && line[0] == 'R' && line[1] == 'M')
         {
@@ -297,148 +415,161 @@ HANDLE AddLocationsFile(std::string filename)
             //             UNLC groupCode(line, 4);
             //             RJISDate::Date endDate(line, 9);
             //             UNLC memberStation(line, 19);
-            //             RJISMaps::groups[memberStation][groupCode].push_back(endDate);
-            //             RJISMaps::degroup[groupCode].push_back(memberStation);
+            //             dataset.groups[memberStation][groupCode].push_back(endDate);
+            //             dataset.degroup[groupCode].push_back(memberStation);
         }
-    }, event));
+    }, event, stats));
     return event;
 };
 
-HANDLE AddAuxGroupsFile(std::string filename)
+void AddTicketTypeRecord(RJISDataset& dataset, const std::string& line)
+{
+    TicketCode key(line, 1);
+    RJISTypes::TicketTypeValue value(line, 4);
+    dataset.ticketTypes.insert(std::make_pair(key, value));
+}
+
+void AddRailcardRecord(RJISDataset& dataset, const std::string& line)
+{
+    RailcardCode code(line, 0);
+    RJISTypes::RailcardValue value(line, 3);
+    dataset.railcards.insert(std::make_pair(code, value));
+}
+
+std::vector<UNLC> GetLocationGroups(const std::string& line)
+{
+    std::vector<UNLC> result;
+    UNLC key(line, 36);
+    UNLC group(line, 69);
+    if (isalnum(line[75]) && isalnum(line[76]))
+    {
+        UNLC countyNLC;
+        countyNLC.SetCountyCode(line, 75);
+        result.push_back(countyNLC);
+    }
+    if (key != group)
+    {
+        result.push_back(group);
+    }
+    return result;
+}
+
+// an L-record adds the location and makes it a member of its fare group and its county:
+void AddLocationRecord(RJISDataset& dataset, const std::string& line)
+{
+    UNLC key(line, 36);
+    RJISTypes::LocationLValue value(line, 9);
+    dataset.locations.insert(std::make_pair(key, value));
+    for (auto& group : GetLocationGroups(line))
+    {
+        RJISDate::Date enddate(2999, 12, 31);
+        dataset.groups[key][group].push_back(enddate);
+        dataset.degroup[group].push_back(key);
+    }
+}
+
+HANDLE AddAuxGroupsFile(RJISDataset& dataset, std::string filename, SourceStats* stats)
 {
     HANDLE event = CreateEvent(0, FALSE, FALSE, 0);
     FileReaderQueue& queue = FileReaderQueue::GetInstance();
-    queue.Add(ams::FastLineReader(filename, [](std::string line) {
+    queue.Add(SourceReader(filename, [&dataset](std::string line) {
         static PrintProgress& pp = PrintProgress::GetInstance();
         pp.Print();
         if (line.length() == 9 && line[0] == 'R')
         {
             UNLC station(line, 1);
             UNLC groupNLC(line, 5);
-            RJISMaps::auxGroups[station].insert(groupNLC);
+            dataset.auxGroups[station].insert(groupNLC);
+            SourceReader::CountRecord();
         }
-    }, event));
+    }, event, stats));
     return event;
 };
 
-HANDLE AddTimetableFile(std::string filename)
+HANDLE AddTimetableFile(RJISDataset& dataset, std::string filename, SourceStats* stats)
 {
     HANDLE event = CreateEvent(0, FALSE, FALSE, 0);
     FileReaderQueue& queue = FileReaderQueue::GetInstance();
-    queue.Add(ams::FastLineReader(filename, [](std::string line) {
-        static int movementNumber = 0;
-        static uint32_t currentIndex = 0;
-        static TTTypes::TrainRun oneRun;
+    auto reader = std::make_shared<TimetableReader>(dataset.tiplocUpdates);
+    queue.Add(SourceReader(filename, [reader](std::string line) {
+        static PrintProgress& pp = PrintProgress::GetInstance();
+        pp.Print();
+        reader->AddLine(std::move(line));
+    }, [reader, &dataset]() {
+        reader->Finish(dataset.fullTimetable);
+    }, event, stats));
+    return event;
+}
 
+// the timetable stations file (.MSN) - we only want the minimum connection time at each station. A station may
+// have several A-records (one for each TIPLOC) so the longest connection time is kept:
+HANDLE AddTimetableStationsFile(RJISDataset& dataset, std::string filename, SourceStats* stats)
+{
+    HANDLE event = CreateEvent(0, FALSE, FALSE, 0);
+    FileReaderQueue& queue = FileReaderQueue::GetInstance();
+    queue.Add(SourceReader(filename, [&dataset](std::string line) {
         static PrintProgress& pp = PrintProgress::GetInstance();
-        static int linenumber = 0;
         pp.Print();
+        if (line.length() >= 65 && line[0] == 'A' && isupper(line[49]) && isupper(line[50]) && isupper(line[51]) && isdigit(line[64]))
+        {
+            CRSCode crs(line, 49);
+            uint16_t minutes = static_cast<uint16_t>((isdigit(line[63]) ? 10 * (line[63] - '0') : 0) + line[64] - '0');
+            auto& changeTime = dataset.changeTimes[crs];
+            changeTime = std::max(changeTime, minutes);
+            SourceReader::CountRecord();
+        }
+    }, event, stats));
+    return event;
+}
 
+// a jXXX.plan file - a line in error is reported and ignored. Each file has its own part of the plan store so the
+// files can be read at once:
+HANDLE AddJourneyPlanFile(RJISDataset& dataset, std::string filename, SourceStats* stats)
+{
+    HANDLE event = CreateEvent(0, FALSE, FALSE, 0);
+    FileReaderQueue& queue = FileReaderQueue::GetInstance();
+    auto& planFile = dataset.journeyPlans.AddFile();
+    queue.Add(SourceReader(filename, [&planFile, filename, linenumber = 0](std::string line) mutable {
+        ++linenumber;
         try
         {
-            if (line.length() > 15)
+            if (planFile.AddLine(line))
             {
-                std::string recordType = line.substr(0, 2);
-                if (recordType == "BS")
-                {
-                    std::string trainUID = line.substr(3, 6);
-                    RJISDate::Range daterange = TTTypes::GetDateRangeFromBS(line);
-                    RJISDate::Dayset dayset(line.substr(21, 7));
-                    oneRun.runningDates = daterange;
-                    oneRun.runningDays = dayset;
-                    oneRun.trainUID = trainUID;
-                    oneRun.trainID = line.substr(32, 4);
-                    oneRun.stpIndicator = line[79];
-                    oneRun.linenumber = linenumber;
-                }
-                if ((recordType == "LI" || recordType == "LO") && line.substr(10, 4) != "    ")
-                {
-                    TTTypes::TrainCall tc(line);
-                    RJISTTMaps::crsMinuteMap[tc.crs][tc.GetDeparture()].push_back(currentIndex);
-                    oneRun.AddCall(tc);
-                }
-                else if (recordType == "LT")
-                {
-                    TTTypes::TrainCall tc(line);
-                    oneRun.AddCall(tc);
-                    RJISTTMaps::crsMinuteMap[tc.crs][tc.GetArrival()].push_back(currentIndex);
-                    RJISTTMaps::fullTimetable.push_back(oneRun);
-
-                    for (auto i = 0; i < oneRun.callingAt.size() - 1; i++)
-                    {
-                        for (auto j = i + 1; j < oneRun.callingAt.size(); j++)
-                        {
-                            TTTypes::CRSFlow crsflow(oneRun.callingAt[i].crs, oneRun.callingAt[j].crs);
-                            RJISTTMaps::crsFlowMap[crsflow].push_back(currentIndex);
-                        }
-                    }
-
-                    for (auto i = 0; i < oneRun.callingAt.size() - 1; i++)
-                    {
-                        for (auto j = i + 1; j < oneRun.callingAt.size(); j++)
-                        {
-                            auto mins = oneRun.callingAt[i].GetDeparture();
-                            auto crs = oneRun.callingAt[i].crs;
-                            auto destCRS = oneRun.callingAt[j].crs;
-                            if (mins == 640 && crs == "POO"s && destCRS == "PKS"s)
-                            {
-                               // std::cout << "POO->" << destCRS <<" at 10:40 " << linenumber + 1 << "\n";
-                            }
-                            TTTypes::CRSFlow crsflow(oneRun.callingAt[i].crs, oneRun.callingAt[j].crs);
-                            //if (crs == "POO"s && destCRS == "PKS"s)
-                            //{
-                            //    auto sz = RJISTTMaps::crsFlowMinutesMap[crsflow].size();
-                            //    std::cout << "sizeof vector for this flow (" << crsflow.GetString() << ") is " << sz << "\n";
-                            //    if (sz < 10)
-                            //    {
-                            //        std::cout << "line number for sz = " << sz << " is " << linenumber << "\n";
-                            //    }
-                            //}
-                            TTTypes::MinutesIndex mi{ oneRun.callingAt[i].GetDeparture(), currentIndex, static_cast<uint16_t>(i), static_cast<uint16_t>(j) };
-                            RJISTTMaps::crsFlowMinutesMap[crsflow].push_back(mi);
-                        }
-                    }
-
-                    currentIndex++;
-                    oneRun.ClearCalls();
-                }
+                SourceReader::CountRecord();
             }
-            linenumber++;
         }
-        catch (std::exception ex)
+        catch (std::exception& ex)
         {
-            std::ostringstream oss;
-            oss << "Problem at line " << linenumber + 1 << " " << ex.what();
-            throw QException(oss.str());
+            std::cerr << "ERROR: " << filename << " line " << linenumber << ": " << ex.what() << " - line ignored.\n";
         }
-    }, event));
+    }, event, stats));
     return event;
 }
 
-void ProcessRailcardRecord(const std::string& line)
+void ProcessRailcardRecord(RJISDataset& dataset, const std::string& line)
 {
-    RJISMaps::rrMap.emplace(RJISTypes::RestrictionsRRKey(line, 3), RJISTypes::RestrictionsRR(line, 7));
+    dataset.rrMap.emplace(RJISTypes::RestrictionsRRKey(line, 3), RJISTypes::RestrictionsRR(line, 7));
 }
 
-void ProcessTimeResRecord(const std::string& line)
+void ProcessTimeResRecord(RJISDataset& dataset, const std::string& line)
 {
-    RJISMaps::trMap.emplace(RJISTypes::RestrictionsKey(line, 3), RJISTypes::RestrictionsTR(line, 6));
+    dataset.trMap.emplace(RJISTypes::RestrictionsKey(line, 3), RJISTypes::RestrictionsTR(line, 6));
 }
 
 // HD record page 47
-void ProcessHeaderDateBandRecord(const std::string& line)
+void ProcessHeaderDateBandRecord(RJISDataset& dataset, const std::string& line)
 {
     RJISTypes::RestrictionsKey rkey(line, 3);
-    RJISMaps::hdMap.emplace(rkey, RJISTypes::RestrictionsHD(line, 6, rkey.cf_.IsFuture()));
+    dataset.hdMap.emplace(rkey, RJISTypes::RestrictionsHD(line, 6, rkey.cf_.IsFuture()));
 }
 
 
 
-HANDLE AddRestrictionsFile(std::string filename)
+HANDLE AddRestrictionsFile(RJISDataset& dataset, std::string filename, SourceStats* stats)
 {
     HANDLE event = CreateEvent(0, FALSE, FALSE, 0);
     FileReaderQueue& queue = FileReaderQueue::GetInstance();
-    queue.Add(ams::FastLineReader(filename, [](std::string line) {
+    queue.Add(SourceReader(filename, [&dataset](std::string line) {
         static PrintProgress& pp = PrintProgress::GetInstance();
         static int linenumber = 0;
         static int dateRecordCount = 0;
@@ -456,27 +587,31 @@ HANDLE AddRestrictionsFile(std::string filename)
                 }
                 if (line[3] == 'C')
                 {
-                    RJISMaps::currentDateRange.Set(line, 4, true);
+                    dataset.currentDateRange.Set(line, 4, true);
                 }
                 else if (line[3] == 'F')
                 {
-                    RJISMaps::futureDateRange.Set(line, 4, true);
+                    dataset.futureDateRange.Set(line, 4, true);
                 }
+                SourceReader::CountRecord();
             }
             else if (recordType == "RR") // railcard restriction record
             {
-                ProcessRailcardRecord(line);
+                ProcessRailcardRecord(dataset, line);
+                SourceReader::CountRecord();
             }
             else if (recordType == "TR") // time restriction record by two-character restriction code
             {
-                ProcessTimeResRecord(line);
+                ProcessTimeResRecord(dataset, line);
+                SourceReader::CountRecord();
             }
             else if (recordType == "HD")
             {
-                ProcessHeaderDateBandRecord(line);
+                ProcessHeaderDateBandRecord(dataset, line);
+                SourceReader::CountRecord();
             }
         }
-    }, event));
+    }, event, stats));
     return event;
 }
 
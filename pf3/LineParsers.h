@@ -1,19 +1,66 @@
 #pragma once
 #include "globals.h"
+#include "RJISDataset.h"
 namespace LineParsers
 {
-    HANDLE AddPlusBusNLCFile(std::string filename);
-    HANDLE AddPlusBusRestrictionsFile(std::string filename);
-    HANDLE AddTicketTypeFile(std::string filename);
-    HANDLE AddNDFFile(std::string filename);
-    HANDLE AddNFOFile(std::string filename);
-    HANDLE AddRailcardFile(std::string filename);
-    HANDLE AddFFLFile(std::string filename);
-    HANDLE AddClustersFile(std::string filename);
-    HANDLE AddNSDiscountsFile(std::string filename);
-    HANDLE AddStandardDiscountsFile(std::string filename);
-    HANDLE AddLocationsFile(std::string filename);
-    HANDLE AddAuxGroupsFile(std::string filename);
-    HANDLE AddTimetableFile(std::string filename);
-    HANDLE AddRestrictionsFile(std::string filename);
+    // each of these queues a file for the reader threads and returns an event that is set when the file has been
+    // read. If stats is given it is filled in with the cost of reading the file (see LoadReport):
+    HANDLE AddPlusBusNLCFile(RJISDataset& dataset, std::string filename, SourceStats* stats = nullptr);
+    HANDLE AddPlusBusRestrictionsFile(RJISDataset& dataset, std::string filename, SourceStats* stats = nullptr);
+    HANDLE AddTicketTypeFile(RJISDataset& dataset, std::string filename, SourceStats* stats = nullptr);
+    HANDLE AddNDFFile(RJISDataset& dataset, std::string filename, SourceStats* stats = nullptr);
+    HANDLE AddNFOFile(RJISDataset& dataset, std::string filename, SourceStats* stats = nullptr);
+    HANDLE AddRailcardFile(RJISDataset& dataset, std::string filename, SourceStats* stats = nullptr);
+    HANDLE AddRailcardMinFaresFile(RJISDataset& dataset, std::string filename, SourceStats* stats = nullptr);
+    HANDLE AddFFLFile(RJISDataset& dataset, std::string filename, SourceStats* stats = nullptr);
+    HANDLE AddClustersFile(RJISDataset& dataset, std::string filename, SourceStats* stats = nullptr);
+    HANDLE AddNSDiscountsFile(RJISDataset& dataset, std::string filename, SourceStats* stats = nullptr);
+    HANDLE AddStandardDiscountsFile(RJISDataset& dataset, std::string filename, SourceStats* stats = nullptr);
+    HANDLE AddLocationsFile(RJISDataset& dataset, std::string filename, SourceStats* stats = nullptr);
+    HANDLE AddAuxGroupsFile(RJISDataset& dataset, std::string filename, SourceStats* stats = nullptr);
+    HANDLE AddTimetableFile(RJISDataset& dataset, std::string filename, SourceStats* stats = nullptr);
+    HANDLE AddTimetableStationsFile(RJISDataset& dataset, std::string filename, SourceStats* stats = nullptr);
+    HANDLE AddRestrictionsFile(RJISDataset& dataset, std::string filename, SourceStats* stats = nullptr);
+    HANDLE AddJourneyPlanFile(RJISDataset& dataset, std::string filename, SourceStats* stats = nullptr);
+
+    // the tests for the records we load from each file - any other line in the file is ignored. These are shared
+    // with ChangeSet so that a change set covers exactly the records a full read would load:
+    inline bool IsNDFRecord(const std::string& line)
+    {
+        return line.length() == 67 && line[0] == 'R';
+    }
+
+    // RF indicates a Flow record - we do not load usage_code = 'C':
+    inline bool IsFlowRecord(const std::string& line)
+    {
+        return line.length() == 49 && line[0] == 'R' && line[1] == 'F' && line[18] != 'C';
+    }
+
+    inline bool IsFareRecord(const std::string& line)
+    {
+        return line.length() == 22 && line[0] == 'R' && line[1] == 'T';
+    }
+
+    inline bool IsTicketTypeRecord(const std::string& line)
+    {
+        return line.length() == 113 && line[0] == 'R';
+    }
+
+    inline bool IsRailcardRecord(const std::string& line)
+    {
+        return line.length() == 127 && line[0] != '\\';
+    }
+
+    inline bool IsLocationRecord(const std::string& line)
+    {
+        return line.length() == 289 && line[0] == 'R' && line[1] == 'L' && line[2] == '7' && line[3] == '0';
+    }
+
+    // add a single record to the dataset - the line must pass the corresponding test above:
+    void AddTicketTypeRecord(RJISDataset& dataset, const std::string& line);
+    void AddRailcardRecord(RJISDataset& dataset, const std::string& line);
+    void AddLocationRecord(RJISDataset& dataset, const std::string& line);
+
+    // the fare group and county an L-record makes its location a member of, in the order AddLocationRecord adds them:
+    std::vector<UNLC> GetLocationGroups(const std::string& line);
 };
@@ -0,0 +1,213 @@
+#include "stdafx.h"
+#include <Psapi.h>
+#include <ams/jsonutils.h>
+#include "LoadReport.h"
+
+namespace {
+
+// estimates of the allocation overheads of the standard containers (64 bit):
+const size_t blockOverhead = 16;                    // heap block header
+const size_t treeNodeOverhead = 3 * sizeof(void*) + 8 + blockOverhead;   // parent, left, right, colour
+
+// the heap memory owned by an element, not counting the element itself. Declared before they are defined so that
+// each can find the others for nested containers:
+template <class T> size_t OwnedBytes(const T&);
+size_t OwnedBytes(const std::string& s);
+template <class K, class V> size_t OwnedBytes(const std::pair<const K, V>& p);
+template <class T, class A> size_t OwnedBytes(const std::vector<T, A>& v);
+template <class T, class A> size_t OwnedBytes(const std::deque<T, A>& d);
+template <class K, class C, class A> size_t OwnedBytes(const std::set<K, C, A>& s);
+template <class K, class V, class C, class A> size_t OwnedBytes(const std::map<K, V, C, A>& m);
+template <class K, class V, class C, class A> size_t OwnedBytes(const std::multimap<K, V, C, A>& m);
+
+template <class T> size_t OwnedBytes(const T&)
+{
+    return 0;
+}
+
+size_t OwnedBytes(const std::string& s)
+{
+    // short strings are stored in the string itself:
+    return s.capacity() > 15 ? s.capacity() + 1 + blockOverhead : 0;
+}
+
+template <class Iterator> size_t ElementBytes(Iterator first, Iterator last)
+{
+    size_t result = 0;
+    for (; first != last; ++first)
+    {
+        result += OwnedBytes(*first);
+    }
+    return result;
+}
+
+template <class K, class V> size_t OwnedBytes(const std::pair<const K, V>& p)
+{
+    return OwnedBytes(p.first) + OwnedBytes(p.second);
+}
+
+template <class T, class A> size_t OwnedBytes(const std::vector<T, A>& v)
+{
+    return (v.capacity() == 0 ? 0 : v.capacity() * sizeof(T) + blockOverhead) + ElementBytes(v.begin(), v.end());
+}
+
+template <class T, class A> size_t OwnedBytes(const std::deque<T, A>& d)
+{
+    return d.size() * sizeof(T) + ElementBytes(d.begin(), d.end());
+}
+
+template <class K, class C, class A> size_t OwnedBytes(const std::set<K, C, A>& s)
+{
+    return s.size() * (sizeof(K) + treeNodeOverhead) + ElementBytes(s.begin(), s.end());
+}
+
+template <class K, class V, class C, class A> size_t OwnedBytes(const std::map<K, V, C, A>& m)
+{
+    return m.size() * (sizeof(typename std::map<K, V, C, A>::value_type) + treeNodeOverhead) + ElementBytes(m.begin(), m.end());
+}
+
+template <class K, class V, class C, class A> size_t OwnedBytes(const std::multimap<K, V, C, A>& m)
+{
+    return m.size() * (sizeof(typename std::multimap<K, V, C, A>::value_type) + treeNodeOverhead) + ElementBytes(m.begin(), m.end());
+}
+
+// the lines that gave no record. A line may give more than one record (see SourceReader::CountRecord) so this is a
+// lower bound - and zero rather than wrapping round when a file has more records than lines:
+uint64_t RejectedLines(const SourceStats& file)
+{
+    return file.records < file.lines ? file.lines - file.records : 0;
+}
+
+double PerSecond(uint64_t count, double seconds)
+{
+    return seconds > 0 ? count / seconds : 0;
+}
+
+}
+
+SourceStats* LoadReport::AddFile(const std::string& type, const std::string& filename)
+{
+    files_.emplace_back();
+    files_.back().type = type;
+    files_.back().filename = filename;
+    return &files_.back();
+}
+
+template <class Container> void LoadReport::AddContainer(const std::string& name, const Container& container)
+{
+    containers_.push_back({ name, container.size(), OwnedBytes(container) });
+}
+
+void LoadReport::Complete(const RJISDataset& dataset, double seconds)
+{
+    seconds_ = seconds;
+
+    containers_.clear();
+    AddContainer("ndfMain", dataset.ndfMain);
+    AddContainer("nfoMain", dataset.nfoMain);
+    AddContainer("flowMainFlows", dataset.flowMainFlows);
+    AddContainer("flowMainFares", dataset.flowMainFares);
+    AddContainer("ticketTypes", dataset.ticketTypes);
+    AddContainer("clusters", dataset.clusters);
+    AddContainer("decluster", dataset.decluster);
+    AddContainer("railcards", dataset.railcards);
+    AddContainer("railcardMinFares", dataset.railcardMinFares);
+    AddContainer("standardDiscounts", dataset.standardDiscounts);
+    AddContainer("statusStandardDiscounts", dataset.statusStandardDiscounts);
+    AddContainer("locations", dataset.locations);
+    AddContainer("groups", dataset.groups);
+    AddContainer("auxGroups", dataset.auxGroups);
+    AddContainer("degroup", dataset.degroup);
+    AddContainer("nonStandardDiscounts", dataset.nonStandardDiscounts);
+    AddContainer("nsdOriginIndex", dataset.nsdOriginIndex);
+    AddContainer("nsdDestinationIndex", dataset.nsdDestinationIndex);
+    AddContainer("plusbusNLCMap", dataset.plusbusNLCMap);
+    AddContainer("plusbusRestrictionSet", dataset.plusbusRestrictionSet);
+    AddContainer("activeStations", dataset.activeStations);
+    AddContainer("flowDestinationIndex", dataset.flowDestinationIndex);
+    AddContainer("ndfDestinationIndex", dataset.ndfDestinationIndex);
+    AddContainer("nfoDestinationIndex", dataset.nfoDestinationIndex);
+    AddContainer("rrMap", dataset.rrMap);
+    AddContainer("trMap", dataset.trMap);
+    AddContainer("hdMap", dataset.hdMap);
+    containers_.push_back({ "fullTimetable", dataset.fullTimetable.GetRunCount(), dataset.fullTimetable.GetMemoryBytes() });
+    containers_.push_back({ "timetableIndex", dataset.timetableIndex.GetEventCount(), dataset.timetableIndex.GetMemoryBytes() });
+    AddContainer("changeTimes", dataset.changeTimes);
+    containers_.push_back({ "raptorPlanner", dataset.timetableIndex.GetStationCount(), dataset.raptorPlanner.GetMemoryBytes() });
+    containers_.push_back({ "connectionScan", dataset.timetableIndex.GetStationCount(), dataset.connectionScan.GetMemoryBytes() });
+    containers_.push_back({ "journeyPlans", dataset.journeyPlans.GetPairCount(), dataset.journeyPlans.GetMemoryBytes() });
+
+    PROCESS_MEMORY_COUNTERS_EX counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&counters, sizeof(counters)))
+    {
+        privateBytes_ = counters.PrivateUsage;
+    }
+}
+
+void LoadReport::Print(std::ostream& os) const
+{
+    os << std::dec << std::setfill(' ') << std::fixed << std::setprecision(2);
+    os << "type        bytes      lines    records   rejected  queue(s)   read(s)   records/s\n";
+    for (auto& file : files_)
+    {
+        os << std::left << std::setw(4) << file.type << std::right <<
+            std::setw(13) << file.bytes <<
+            std::setw(11) << file.lines <<
+            std::setw(11) << file.records <<
+            std::setw(11) << RejectedLines(file) <<
+            std::setw(10) << file.queueSeconds <<
+            std::setw(10) << file.readSeconds <<
+            std::setw(12) << static_cast<uint64_t>(PerSecond(file.records, file.readSeconds)) << "  " <<
+            file.filename << "\n";
+    }
+
+    os << "container                  elements      MBytes (est.)\n";
+    size_t totalBytes = 0;
+    for (auto& container : containers_)
+    {
+        if (container.elements > 0)
+        {
+            os << std::left << std::setw(24) << container.name << std::right <<
+                std::setw(11) << container.elements <<
+                std::setw(12) << container.bytes / 1048576.0 << "\n";
+        }
+        totalBytes += container.bytes;
+    }
+    os << "containers total " << totalBytes / 1048576.0 << " MB (est.), process private memory " <<
+        privateBytes_ / 1048576.0 << " MB, load time " << seconds_ << " seconds\n";
+    os.unsetf(std::ios::floatfield);
+}
+
+std::string LoadReport::GetJSON() const
+{
+    std::string json = "{" + ams::JSON::NVPair("seconds", seconds_, true) +
+        ams::JSON::NVPair("privateBytes", privateBytes_, true) + ams::JSON::Key("files") + "[";
+    for (auto& file : files_)
+    {
+        json += "{" + ams::JSON::NVPair("type", file.type, true) +
+            ams::JSON::NVPair("bytes", file.bytes, true) +
+            ams::JSON::NVPair("lines", file.lines, true) +
+            ams::JSON::NVPair("records", file.records, true) +
+            ams::JSON::NVPair("rejected", RejectedLines(file), true) +
+            ams::JSON::NVPair("queueSeconds", file.queueSeconds, true) +
+            ams::JSON::NVPair("readSeconds", file.readSeconds, true) +
+            ams::JSON::NVPair("recordsPerSecond", PerSecond(file.records, file.readSeconds)) + "},";
+    }
+    if (json.back() == ',')
+    {
+        json.pop_back();
+    }
+    json += "]," + ams::JSON::Key("containers") + "[";
+    for (auto& container : containers_)
+    {
+        json += "{" + ams::JSON::NVPair("name", container.name, true) +
+            ams::JSON::NVPair("elements", container.elements, true) +
+            ams::JSON::NVPair("bytes", container.bytes) + "},";
+    }
+    if (json.back() == ',')
+    {
+        json.pop_back();
+    }
+    json += "]}";
+    return json;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "SourceReader.h"
+#include "RJISDataset.h"
+
+// LoadReport - what a load of the RJIS files cost. For each file: the bytes and lines read, the records stored and
+// rejected, the time the file waited on the file reader queue and the time taken to read and parse it. For each
+// container in the dataset: the number of elements and an estimate of the memory it uses. This tells us which file
+// and which container to work on next.
+//
+// The memory for a container is estimated from the size of its elements and the usual node and heap block overheads,
+// including the memory owned by its elements (nested containers and strings). It is not measured.
+class LoadReport
+{
+public:
+    struct ContainerStats
+    {
+        std::string name;
+        size_t elements;
+        size_t bytes;
+    };
+
+private:
+    std::deque<SourceStats> files_;                 // a deque so that the reader threads can hold pointers into it
+    std::vector<ContainerStats> containers_;
+    double seconds_ = 0;                            // the whole load including building the indexes
+    uint64_t privateBytes_ = 0;                     // the private memory of the process at the end of the load
+
+    template <class Container> void AddContainer(const std::string& name, const Container& container);
+
+public:
+    // add a file to the report - the stats are filled in by the reader thread that reads the file:
+    SourceStats* AddFile(const std::string& type, const std::string& filename);
+
+    // record the containers of the loaded dataset and the time taken for the whole load:
+    void Complete(const RJISDataset& dataset, double seconds);
+
+    void Print(std::ostream& os) const;
+    std::string GetJSON() const;
+};
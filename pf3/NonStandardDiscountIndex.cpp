@@ -0,0 +1,92 @@
+#include "stdafx.h"
+#include "NonStandardDiscountIndex.h"
+
+// build the index from the non-standard discounts table. This must be called once all the RJIS files are loaded
+// since the index holds iterators into the table:
+void NonStandardDiscountIndex::Build(const std::deque<RJISTypes::NSDiscEntry>& nonStandardDiscounts)
+{
+    anyRoute_ = "*****"s;
+    anyRailcard_ = "***"s;
+    anyTicket_ = "***"s;
+    origins_.clear();
+    destinations_.clear();
+
+    for (auto p = nonStandardDiscounts.cbegin(); p != nonStandardDiscounts.cend(); ++p)
+    {
+        int pattern = (p->route_ != anyRoute_ ? 0b100 : 0) | (p->railcard_ != anyRailcard_ ? 0b10 : 0) | (p->ticketCode_ != anyTicket_ ? 1 : 0);
+        Key key(p->route_, p->railcard_, p->ticketCode_);
+        origins_[p->originCode_][pattern][key].push_back(p);
+        destinations_[p->destinationCode_][pattern][key].push_back(p);
+    }
+}
+
+void NonStandardDiscountIndex::AddStation(StationSet& stations, Side side, const UNLC& nlc, bool isStation) const
+{
+    auto& sideStations = side == Side::Origin ? origins_ : destinations_;
+    auto station = sideStations.find(nlc);
+    if (station != sideStations.end())
+    {
+        stations.stations_.emplace_back(&station->second, isStation);
+    }
+}
+
+int NonStandardDiscountIndex::FindBest(
+    NSDIterator& result,
+    const StationSet& stations,
+    const RouteCode& route,
+    const RailcardCode& railcard,
+    const TicketCode& ticketcode,
+    const RJISDate::Date& queryDate,
+    const RJISDate::Date& travelDate) const
+{
+    int bestQuality = -1;
+    for (auto& station : stations.stations_)
+    {
+        NSDIterator found;
+        int quality = FindBest(found, *station.first, route, railcard, ticketcode, queryDate, travelDate);
+        if (quality >= 0 && station.second)
+        {
+            quality |= 0b1000;
+        }
+        if (quality > bestQuality)
+        {
+            bestQuality = quality;
+            result = found;
+        }
+    }
+    return bestQuality;
+}
+
+int NonStandardDiscountIndex::FindBest(
+    NSDIterator& result,
+    const StationPatterns& patterns,
+    const RouteCode& route,
+    const RailcardCode& railcard,
+    const TicketCode& ticketcode,
+    const RJISDate::Date& queryDate,
+    const RJISDate::Date& travelDate) const
+{
+    // try the most specific pattern first:
+    for (int pattern = patternCount - 1; pattern >= 0; --pattern)
+    {
+        auto& entries = patterns[pattern];
+        if (entries.empty())
+        {
+            continue;
+        }
+        Key key((pattern & 0b100) ? route : anyRoute_, (pattern & 0b10) ? railcard : anyRailcard_, (pattern & 1) ? ticketcode : anyTicket_);
+        auto p = entries.find(key);
+        if (p != entries.end())
+        {
+            for (auto& nsd : p->second)
+            {
+                if (nsd->dates_.AreDatesValid(queryDate, travelDate))
+                {
+                    result = nsd;
+                    return pattern;
+                }
+            }
+        }
+    }
+    return -1;
+}
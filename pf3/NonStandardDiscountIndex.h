@@ -0,0 +1,77 @@
+#pragma once
+#include "RJISTypes.h"
+
+// NonStandardDiscountIndex - the non-standard discounts from the RJIS .FNS file compiled for lookup by station, route,
+// railcard and ticket code. Each of route, railcard and ticket code in an FNS record is either a value or a wildcard
+// ("*****" or "***"), giving eight wildcard patterns. The records for each station are partitioned by pattern at load
+// time so that finding the best match for a station is a probe of each pattern from most specific to least specific -
+// the first pattern with a record valid for the dates given is the best match, and within a pattern the first record
+// (in file order) wins, as it does when every candidate is compared with GetMatchQuality.
+//
+// A search is for a station and its related stations (groups, zones and counties). These are resolved against the index
+// once into a StationSet, which holds only the stations that have FNS records - usually none or one - so a lookup for a
+// (set, route, railcard, ticket code) probes only those stations.
+class NonStandardDiscountIndex
+{
+public:
+    typedef std::deque<RJISTypes::NSDiscEntry>::const_iterator NSDIterator;
+
+private:
+    // the pattern of a record is the match quality it gives when it matches: bit 2 set if the route is given, bit 1 if the
+    // railcard is given and bit 0 if the ticket code is given:
+    static const int patternCount = 8;
+    typedef std::tuple<RouteCode, RailcardCode, TicketCode> Key;
+    typedef std::array<std::map<Key, std::vector<NSDIterator>>, patternCount> StationPatterns;
+
+public:
+    // the end of the flow at which a station is matched against the FNS record:
+    enum class Side { Origin, Destination };
+
+    // the stations of one end of a flow that have FNS records, in the order they were added, each with a flag set if
+    // it is the searched station itself rather than one of its related stations. Sets compare equal when they hold
+    // the same stations, so they can be used as keys:
+    class StationSet
+    {
+        friend class NonStandardDiscountIndex;
+        std::vector<std::pair<const StationPatterns*, bool>> stations_;
+    public:
+        bool operator<(const StationSet& other) const { return stations_ < other.stations_; }
+        bool operator==(const StationSet& other) const { return stations_ == other.stations_; }
+        bool empty() const { return stations_.empty(); }
+    };
+
+    void Build(const std::deque<RJISTypes::NSDiscEntry>& nonStandardDiscounts);
+
+    // add a station to a set if it has any FNS records at the given end of the flow:
+    void AddStation(StationSet& stations, Side side, const UNLC& nlc, bool isStation) const;
+
+    // find the best match over a set of stations. The match quality is route 0b100, railcard 0b10 and ticket 1 for each
+    // field matched by value rather than by wildcard, plus 0b1000 for a match at the searched station itself so that it
+    // trumps a match at a related station. The first station with the highest quality wins. Returns the quality, or -1
+    // if no station has a match valid on the dates given:
+    int FindBest(
+        NSDIterator& result,
+        const StationSet& stations,
+        const RouteCode& route,
+        const RailcardCode& railcard,
+        const TicketCode& ticketcode,
+        const RJISDate::Date& queryDate,
+        const RJISDate::Date& travelDate) const;
+
+private:
+    // the best match at a single station - the quality without the 0b1000 for the station itself:
+    int FindBest(
+        NSDIterator& result,
+        const StationPatterns& patterns,
+        const RouteCode& route,
+        const RailcardCode& railcard,
+        const TicketCode& ticketcode,
+        const RJISDate::Date& queryDate,
+        const RJISDate::Date& travelDate) const;
+
+    std::map<UNLC, StationPatterns> origins_;
+    std::map<UNLC, StationPatterns> destinations_;
+    RouteCode anyRoute_;
+    RailcardCode anyRailcard_;
+    TicketCode anyTicket_;
+};
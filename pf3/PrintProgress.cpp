@@ -1,4 +1,39 @@
 #include "stdafx.h"
 #include "PrintProgress.h"
 
-long PrintProgress::globalLineNumber_ = 0;
+/* static */
+thread_local PrintProgress::Counter* PrintProgress::counter_ = nullptr;
+
+PrintProgress::Counter* PrintProgress::AddCounter()
+{
+    AcquireSRWLockExclusive(&lock_);
+    counters_.emplace_back();
+    Counter* result = &counters_.back();
+    ReleaseSRWLockExclusive(&lock_);
+    return result;
+}
+
+long PrintProgress::GetLinenumber()
+{
+    long result = 0;
+    AcquireSRWLockShared(&lock_);
+    for (auto& counter : counters_)
+    {
+        result += counter.lines;
+    }
+    ReleaseSRWLockShared(&lock_);
+    return result;
+}
+
+// print the total if it has passed another million lines since it was last printed:
+void PrintProgress::PrintTotal()
+{
+    long total = GetLinenumber();
+    EnterCriticalSection(&cs_);
+    if (total / interval > printed_)
+    {
+        printed_ = total / interval;
+        std::cout << std::dec << std::setfill(' ') << std::setw(10) << printed_ * interval << " lines\r";
+    }
+    LeaveCriticalSection(&cs_);
+}
@@ -1,12 +1,29 @@
 #pragma once
+
+// PrintProgress - count the lines read by the reader threads and print the total every million lines. Each thread
+// counts in its own counter on its own cache line so that counting a line never contends with another thread - the
+// counters are only added up every so often to see whether the total has passed another million.
 class PrintProgress
 {
     static const int interval = 1'000'000;
-    static long globalLineNumber_;
+    static const int checkInterval = 1 << 16;      // the lines a thread counts between looking at the total
+
+    struct alignas(64) Counter
+    {
+        volatile long lines = 0;    // only written by the thread the counter belongs to
+    };
+
+    SRWLOCK lock_ = SRWLOCK_INIT;
+    std::deque<Counter> counters_;  // one for each thread that has counted a line - a deque so that they never move
     CRITICAL_SECTION cs_;
+    long printed_ = 0;              // the millions of lines last printed - guarded by cs_
+    static thread_local Counter* counter_;
+
     PrintProgress() {
         InitializeCriticalSection(&cs_);
     }
+    Counter* AddCounter();
+    void PrintTotal();
 public:
     PrintProgress(PrintProgress&) = delete;
 
@@ -18,22 +35,20 @@ public:
 
     void Print()
     {
-        int i = InterlockedIncrement(&globalLineNumber_);
-        if (i % interval == interval - 1)
+        if (counter_ == nullptr)
         {
-            DWORD procnum = GetCurrentProcessorNumber();
-            DWORD threadid = GetCurrentThreadId();
-            std::ostringstream oss;
-            oss << std::dec << std::setfill(' ') << std::setw(10) << i + 1 << " lines\r";
-            std::string s = oss.str();
-            EnterCriticalSection(&cs_);
-            std::cout << s;
-            LeaveCriticalSection(&cs_);
+            counter_ = AddCounter();
+        }
+        long i = counter_->lines + 1;
+        counter_->lines = i;
+        if (i % checkInterval == 0)
+        {
+            PrintTotal();
         }
     }
-    long GetLinenumber()
-    {
-        return globalLineNumber_;
-    }
+
+    // the total number of lines counted by every thread:
+    long GetLinenumber();
+
     virtual ~PrintProgress(){}
 };
@@ -2,21 +2,24 @@
 #include "ams/fileutils.h"
 #include "ams/jsutils.h"
 #include "ProcessFareList.h"
-#include "RJISMaps.h"
+#include "RJISDataset.h"
 #include "FareDebug.h"
 #include "config.h"
 #include "RelatedStations.h"
+#include "FareKernel.h"
+#include "WorkerPool.h"
 
 struct NDFFoundKey
 {
+    RailcardCode railcard_;             // three letter RJIS railcard code - we may search for several railcards at once
     RouteCode route_;					// five digit route code
     TicketCode ticketCode_;				// three letter RJIS ticket code
     NDFFoundKey() = default;
-    NDFFoundKey(RouteCode route, TicketCode ticketcode) : route_(route), ticketCode_(ticketcode) {}
+    NDFFoundKey(RailcardCode railcard, RouteCode route, TicketCode ticketcode) : railcard_(railcard), route_(route), ticketCode_(ticketcode) {}
     bool operator<(const NDFFoundKey& other) const
     {
-        return std::forward_as_tuple(route_, ticketCode_) <
-            std::forward_as_tuple(other.route_, other.ticketCode_);
+        return std::forward_as_tuple(railcard_, route_, ticketCode_) <
+            std::forward_as_tuple(other.railcard_, other.route_, other.ticketCode_);
     }
 };
 
@@ -40,148 +43,53 @@ std::string JSONAddNV(std::string name, unsigned int value)
 }
 
 
-// given an RJIS percentage 0-999 reprenting 0-99.9% calculate the final price. We round UP to the nearest penny THEN round to the nearest 5p:
-unsigned Rounding(unsigned x, unsigned  percent)
-{
-	return ((x * (1000 - percent) + 999) / 1000 + 2) / 5 * 5;
-}
+using FareKernel::Rounding;
 
 
-// returns a match from a list of non-standard discounts - everything (route, railcard, ticketcode) has to match, but an
-// exact match is always a "better quality" match than a wildcard match. A non-match returns -1
-int GetMatchQuality(const RJISTypes::NSDiscEntry& fns,
-                    const RouteCode& route,
-                    const RailcardCode& railcard,
-                    const TicketCode& ticketcode
-    )
+// resolve one end of the search flow against the non-standard discounts index. We must search on the station itself
+// and any station groups, counties and zones (but DEFINITELY NOT CLUSTERS):
+void GetNSDStationSet(
+    NonStandardDiscountIndex::StationSet& stations,     // OUTPUT. The stations with records in the FNS file
+    NonStandardDiscountIndex::Side side,                // the end of the flow the station is at
+    const UNLC& station,                                // the origin or destination of the search
+    const RJISDate::Date& travelDate)
 {
-    uint32_t matchQuality = 0;
-    if (route == fns.route_)
-    {
-        matchQuality |= 0b100;
-    }
-    else if (fns.route_ != "*****"s)
-    {
-        // mark a non-match:
-        matchQuality = -1;
-    }
-
-    // if we can still match
-    if (matchQuality >= 0)
-    {
-        if (railcard == fns.railcard_)
-        {
-            matchQuality |= 0b10;
-        }
-        else if (fns.railcard_ != "***"s)
-        {
-            // mark a non-match:
-            matchQuality = -1;
-        }
-    }
-
-    // if we can still match
-    if (matchQuality >= 0)
+    auto& index = RJISDataset::Get().nsdDecisionIndex;
+    ArenaVector<UNLC> allFNSStations;
+    // add the station itself to the list
+    allFNSStations.push_back(station);
+    GetRelatedStations(allFNSStations, station, travelDate);
+    for (auto& nlc : allFNSStations)
     {
-        if (ticketcode == fns.ticketCode_)
-        {
-            matchQuality |= 1;
-        }
-        else if (fns.ticketCode_ != "***"s)
-        {
-            // mark a non-match:
-            matchQuality = -1;
-        }
+        index.AddStation(stations, side, nlc, nlc == station);
     }
-    return matchQuality;
 }
 
 // return an iterator into the NSD deque representing the best match. If there is no possible match then
-// return RJISMaps::nonStandardDiscounts.end():
-decltype(RJISMaps::nonStandardDiscounts)::iterator GetNonStandardDiscount(
+// return the end of the non-standard discounts table. Everything (route, railcard, ticketcode) has to match, but an
+// exact match is always a "better quality" match than a wildcard match and a match on the station itself
+// trumps a match on one of its groups, zones or counties:
+RJISDataset::NSDIterator GetNonStandardDiscount(
+    const NonStandardDiscountIndex::StationSet& originStations,        // the origin of the search - see GetNSDStationSet
+    const NonStandardDiscountIndex::StationSet& destinationStations,   // the destination of the search
     RouteCode route,                            // 5 digit route code - the one that we found, not a route code we are searching for
     TicketCode ticketcode,                      // 3 character ticket code - the one that we found, not a ticket code we are searching for
-    const FareSearchParams& searchParams        // used for the railcard code we are actually calculating with
+    RailcardCode railcard,                      // the railcard code we are actually calculating with
+    const FareSearchParams& searchParams        // used for the dates
     )
 {
-    // get the complete set of stations to search for in the non-standard discounts table.
-    // We must search on the station itself and any station groups, counties and zones (but DEFINITELY NOT CLUSTERS)
-    std::deque<UNLC> allFNSStations;
-    // add the station itself to the list
-    allFNSStations.push_back(searchParams.flow_.origin);
-    GetRelatedStations(allFNSStations, searchParams.flow_.origin, searchParams.travelDate_);
-
-    // set the maximum match quality found to zero - we then try to find some discount that matches in some way:
-    int maxMatchQuality = 0;
-
-    // this is the best match we found so far - we set it to the end of the non-standard discount map if we don't 
-    // find anything
-    decltype(RJISMaps::nonStandardDiscounts)::iterator bestMatch = std::end(RJISMaps::nonStandardDiscounts);
-
-    // for each station in the origin list (i.e. individual nlc plus group plus travelcard zone plus county)
-    for (auto nlc : allFNSStations)
+    auto& dataset = RJISDataset::Get();
+    auto& index = dataset.nsdDecisionIndex;
+
+    // a match at the origin is used in preference to one at the destination. A match must be better than a wildcard
+    // match on every field at a related station (quality zero) to be used:
+    RJISDataset::NSDIterator bestMatch;
+    if (index.FindBest(bestMatch, originStations, route, railcard, ticketcode, searchParams.queryDate_, searchParams.travelDate_) > 0 ||
+        index.FindBest(bestMatch, destinationStations, route, railcard, ticketcode, searchParams.queryDate_, searchParams.travelDate_) > 0)
     {
-        auto ofound = RJISMaps::nsdOriginIndex.equal_range(nlc);
-
-        for (auto p = ofound.first; p != ofound.second; ++p)
-        {
-            // get a reference to the non-standard discount stored in the deque
-            auto& fns = *(p->second);
-            if (fns.dates_.AreDatesValid(searchParams.queryDate_, searchParams.travelDate_))
-            {
-                auto matchQuality = GetMatchQuality(fns, route, searchParams.railcard_, ticketcode);
-                // ensure that a match for the individual station nlc trumps a group nlc match:
-                if (matchQuality >= 0 && nlc == searchParams.flow_.origin)
-                {
-                    matchQuality |= 0b1000;
-                }
-                if (matchQuality > maxMatchQuality)
-                {
-                    maxMatchQuality = matchQuality;
-                    bestMatch = p->second;
-                }
-            }
-        }
+        return bestMatch;
     }
-    // if we didn't find a match, then look at the destinations
-    if (maxMatchQuality < 1)
-    {
-        allFNSStations.clear();
-        allFNSStations.push_back(searchParams.flow_.destination);
-        GetRelatedStations(allFNSStations, searchParams.flow_.destination, searchParams.travelDate_);
-
-        for (auto nlc : allFNSStations)
-        {
-            auto dfound = RJISMaps::nsdDestinationIndex.equal_range(nlc);
-            for (auto p = dfound.first; p != dfound.second; ++p)
-            {
-                // get a reference to the non-standard discount stored in the deque
-                auto& fns = *(p->second);
-                if (fns.dates_.AreDatesValid(searchParams.queryDate_, searchParams.travelDate_))
-                {
-                    auto matchQuality = GetMatchQuality(fns, route, searchParams.railcard_, ticketcode);
-                    if (matchQuality >= 0 && nlc == searchParams.flow_.destination)
-                    {
-                        matchQuality |= 0b1000;
-                    }
-                    if (matchQuality > maxMatchQuality)
-                    {
-                        maxMatchQuality = matchQuality;
-                        bestMatch = p->second;
-                    }
-                }
-            }
-        }
-    }
-    if (maxMatchQuality < 1)
-    {
-//        std::cout << "nothing found\n";
-    }
-    else
-    {
-//        std::cout << bestMatch->originCode_ << bestMatch->destinationCode_ << bestMatch->route_ << bestMatch->railcard_ << bestMatch->ticketCode_ << "\n";
-    }
-    return bestMatch;
+    return std::end(dataset.nonStandardDiscounts);
 }
 
 
@@ -193,19 +101,27 @@ std::string GetNDFDetailsAsString(const RJISTypes::NDFMainValue& ndf)
 	return oss.str();
 }
 
-// Suppression set is a non-multiset since once we have found all NDFs for a given flow, railcard and date, the combo of route and ticket
-// code will be unique:
-typedef std::set<NDFFoundKey> SuppressionSet;
+// Suppression set is a non-multiset since once we have found all NDFs for a given flow, railcard and date, the combo of railcard,
+// route and ticket code will be unique:
+typedef ArenaSet<NDFFoundKey> SuppressionSet;
 
 // list of NDFs found - this is a multimap since for each flow there may be several ticket code, route combos:
-typedef std::multimap<UFlow, RJISTypes::NDFMainValue> NDFFoundMap;
+typedef ArenaMultimap<UFlow, RJISTypes::NDFMainValue> NDFFoundMap;
 
-// a secondary index by route and ticket code into the found map - there should only be one entry for the
-// combination of route and ticket code:
-typedef std::map<NDFFoundKey, NDFFoundMap::iterator> FoundMapIndex;
+// a secondary index by railcard, route and ticket code into the found map - there should only be one entry for the
+// combination of railcard, route and ticket code:
+typedef ArenaMap<NDFFoundKey, NDFFoundMap::iterator> FoundMapIndex;
 
-void ProcessNDFs(NDFResultsMap& results, UFlow flow, const FareSearchParams& searchParams, bool useReturnDate = false)
+inline bool IsRailcardWanted(const std::vector<RailcardCode>& railcards, const RailcardCode& railcard)
+{
+    return std::find(railcards.begin(), railcards.end(), railcard) != railcards.end();
+}
+
+// Find the NDFs (after applying NFO additions, replacements and suppressions) for a single flow. The NDF and NFO entries
+// for the flow are scanned once for all the railcards given - the results are keyed by railcard.
+void ProcessNDFs(NDFResultsMap& results, UFlow flow, const FareSearchParams& searchParams, const std::vector<RailcardCode>& railcards, bool useReturnDate = false)
 {
+    auto& dataset = RJISDataset::Get();
 	NDFFoundMap foundNDFs;
 	FoundMapIndex foundMapIndex;
 	SuppressionSet suppressionSet;
@@ -214,7 +130,7 @@ void ProcessNDFs(NDFResultsMap& results, UFlow flow, const FareSearchParams& sea
     auto searchDate = useReturnDate ? searchParams.returnDate_ : searchParams.travelDate_;
 
 	// first build the list of matching NDFs for this flow and railcard combination for the travel date and query date given:
-	auto ndfIters = RJISMaps::ndfMain.equal_range(flow);
+	auto ndfIters = dataset.ndfMain.equal_range(flow);
 
 	for (auto ndfEntry = ndfIters.first; ndfEntry != ndfIters.second; ++ndfEntry)
 	{
@@ -222,7 +138,7 @@ void ProcessNDFs(NDFResultsMap& results, UFlow flow, const FareSearchParams& sea
 		// if the NDF is valid for travel on the travel date and the quote date allows querying on this date,
 		// insert it into the NDF found map:
 		if (ndf.seqDates_.AreDatesValid(searchParams.queryDate_, searchDate) &&
-            ndf.railcardCode_ == searchParams.railcard_ &&
+            IsRailcardWanted(railcards, ndf.railcardCode_) &&
             (searchParams.route_.IsEmpty() || searchParams.route_ == ndf.route_) &&
             (searchParams.ticketCode_.IsEmpty() || searchParams.ticketCode_ == ndf.ticketCode_)
             )
@@ -232,11 +148,11 @@ void ProcessNDFs(NDFResultsMap& results, UFlow flow, const FareSearchParams& sea
 		}
 	}
 
-	// index all found NDFs by (route, ticket code). We have already matched just a single railcard code so there
-    // should be only one matching entry for each combination of (route, ticket type) for the NDFs found.
+	// index all found NDFs by (railcard, route, ticket code). There should be only one matching entry for each combination
+    // of (railcard, route, ticket type) for the NDFs found.
 	for (auto ndfEntry = std::begin(foundNDFs); ndfEntry != std::end(foundNDFs); ++ndfEntry)
 	{
-		NDFFoundKey key(ndfEntry->second.route_, ndfEntry->second.ticketCode_);
+		NDFFoundKey key(ndfEntry->second.railcardCode_, ndfEntry->second.route_, ndfEntry->second.ticketCode_);
 		foundMapIndex.insert(std::make_pair(key, ndfEntry));
 	}
 
@@ -244,7 +160,7 @@ void ProcessNDFs(NDFResultsMap& results, UFlow flow, const FareSearchParams& sea
 	// suppress an NDF between the NFOs start and end dates
 
 //	std::cout << "searching for NFOs\n";
-	auto nfoIters = RJISMaps::nfoMain.equal_range(flow);
+	auto nfoIters = dataset.nfoMain.equal_range(flow);
 	for (auto nfoEntry = nfoIters.first; nfoEntry != nfoIters.second; ++nfoEntry)
 	{
 		auto &nfo = nfoEntry->second;
@@ -254,7 +170,7 @@ void ProcessNDFs(NDFResultsMap& results, UFlow flow, const FareSearchParams& sea
 			// can the suppression be used today? Only store it if it can suppress based on the query date (usually today)
 			// and the intended date of travel. We store it since we might use it to replace an NFO
 			if (nfo.seqDates_.AreDatesValid(searchParams.queryDate_, searchDate) &&
-                nfo.railcardCode_ == searchParams.railcard_ &&
+                IsRailcardWanted(railcards, nfo.railcardCode_) &&
                 (searchParams.route_.IsEmpty() || searchParams.route_ == nfo.route_) &&
                 (searchParams.ticketCode_.IsEmpty() || searchParams.ticketCode_ == nfo.ticketCode_)
                 )
@@ -262,6 +178,7 @@ void ProcessNDFs(NDFResultsMap& results, UFlow flow, const FareSearchParams& sea
 //				std::cout << "NFO suppression stored - line " << nfo.linenumber + 1 << " " << GetNDFDetailsAsString(nfo) << "\n";
 				// store this suppression for route and ticket code comparison later - this is case 3:
 				NDFFoundKey suppression;
+				suppression.railcard_ = nfo.railcardCode_;
 				suppression.route_ = nfo.route_;
 				suppression.ticketCode_ = nfo.ticketCode_;
 				suppressionSet.insert(suppression);
@@ -272,12 +189,12 @@ void ProcessNDFs(NDFResultsMap& results, UFlow flow, const FareSearchParams& sea
 			// this NFO is like an NDF, so do the same date comparison and if it passes
 			// check to see if there is an existing NDF with the same route and ticket code:
 			if (nfo.seqDates_.AreDatesValid(searchParams.queryDate_, searchDate) && 
-                nfo.railcardCode_ == searchParams.railcard_ &&
+                IsRailcardWanted(railcards, nfo.railcardCode_) &&
                 (searchParams.route_.IsEmpty() || searchParams.route_ == nfo.route_) &&
                 (searchParams.ticketCode_.IsEmpty() || searchParams.ticketCode_ == nfo.ticketCode_)
                 )
 			{
-				auto existingNDF =  foundMapIndex.find(NDFFoundKey(nfo.route_, nfo.ticketCode_));
+				auto existingNDF =  foundMapIndex.find(NDFFoundKey(nfo.railcardCode_, nfo.route_, nfo.ticketCode_));
 				if (existingNDF == foundMapIndex.end())
 				{
 //					std::cout << "NFO addition - line number " << nfo.linenumber + 1 << "\n";
@@ -314,34 +231,21 @@ void ProcessNDFs(NDFResultsMap& results, UFlow flow, const FareSearchParams& sea
 	}
 }
 
-bool GetRailcardEntry(RJISTypes::RailcardValue& railcardEntry, const FareSearchParams& searchParams)
+void ProcessNDFs(NDFResultsMap& results, UFlow flow, const FareSearchParams& searchParams, bool useReturnDate = false)
 {
-    bool found = false;
-    auto matchingRailcards = RJISMaps::railcards.equal_range(searchParams.railcard_);
-    for (auto p = matchingRailcards.first; p != matchingRailcards.second && !found; ++p)
-    {
-        if (p->second.seqDates_.AreDatesValid(searchParams.queryDate_, searchParams.travelDate_))
-        {
-            found = true;
-            railcardEntry = p->second;
-        }
-    }
-    return found;
+    ProcessNDFs(results, flow, searchParams, std::vector<RailcardCode>{ searchParams.railcard_ }, useReturnDate);
 }
 
-bool GetTicketTypeEntry(RJISTypes::TicketTypeValue& ticketTypeEntry, TicketCode tty, const FareSearchParams& searchParams)
+// get the railcard record valid for the query and travel dates - returns nullptr if there is none:
+const RailcardHot* GetRailcardEntry(const FareSearchParams& searchParams)
 {
-    bool found = false;
-    auto matchingTickets = RJISMaps::ticketTypes.equal_range(tty);
-    for (auto ttyRangeIterator = matchingTickets.first; ttyRangeIterator != matchingTickets.second && !found; ++ttyRangeIterator)
-    {
-        if (ttyRangeIterator->second.seqDates_.AreDatesValid(searchParams.queryDate_, searchParams.travelDate_))
-        {
-            found = true;
-            ticketTypeEntry = ttyRangeIterator->second;
-        }
-    }
-    return found;
+    return RJISDataset::Get().railcardIndex.Find(searchParams.railcard_, searchParams.queryDate_, searchParams.travelDate_);
+}
+
+// get the ticket type record valid for the query and travel dates - returns nullptr if there is none:
+const TicketTypeHot* GetTicketTypeEntry(TicketCode tty, const FareSearchParams& searchParams)
+{
+    return RJISDataset::Get().ticketTypeIndex.Find(tty, searchParams.queryDate_, searchParams.travelDate_);
 }
 
 bool GetStandardDiscount(
@@ -350,37 +254,165 @@ bool GetStandardDiscount(
     const DiscountCategory& discountCategory,
     const FareSearchParams& searchParams)
 {
-    bool found = false;
-    RJISTypes::SDiscountKey key(statusCode, discountCategory);
-    auto matchingDiscounts = RJISMaps::standardDiscounts.equal_range(key);
-    for (auto p = matchingDiscounts.first; p != matchingDiscounts.second && !found; ++p)
+    auto& table = RJISDataset::Get().standardDiscountTable;
+    return table.GetDiscount(percentage, table.GetStatusIndex(statusCode),
+        FareKernel::GetCategoryIndex(discountCategory), searchParams.travelDate_);
+}
+
+// the RJIS status codes of an adult and a child travelling without a railcard:
+const StatusCode noRailcardAdultStatus("000"s, 0);
+const StatusCode noRailcardChildStatus("001"s, 0);
+
+// the statuses the railcard of a search is priced with on its travel date - those of the railcard record valid on the
+// date, or the no-railcard statuses for a blank railcard or one with no valid record:
+void GetRailcardStatuses(
+    StatusCode& adultStatus,                    // OUTPUT
+    StatusCode& childStatus,                    // OUTPUT
+    const FareSearchParams& searchParams)
+{
+    auto railcardEntry = GetRailcardEntry(searchParams);
+    if (railcardEntry)
+    {
+        adultStatus = railcardEntry->adultStatus_;
+        childStatus = railcardEntry->childStatus_;
+    }
+    else
+    {
+        adultStatus = noRailcardAdultStatus;
+        childStatus = noRailcardChildStatus;
+    }
+}
+
+// every status GetRailcardStatuses can give for a railcard on any date - the statuses of each of its records and the
+// no-railcard statuses, since its records need not cover every date:
+void GetPossibleRailcardStatuses(std::set<StatusCode>& statuses, const RailcardCode& railcard)
+{
+    statuses.insert(noRailcardAdultStatus);
+    statuses.insert(noRailcardChildStatus);
+    auto matchingRailcards = RJISDataset::Get().railcards.equal_range(railcard);
+    for (auto p = matchingRailcards.first; p != matchingRailcards.second; ++p)
     {
-        if (p->second.endDate_ >= searchParams.travelDate_)
+        statuses.insert(p->second.adultStatus_);
+        statuses.insert(p->second.childStatus_);
+    }
+}
+
+// Values for a single railcard that are resolved once per query rather than once per fare: the adult and child
+// status codes from the railcard file and the standard discount percentages for every discount category for those
+// statuses on the travel date - these are the tables used by the batch fare kernel:
+struct RailcardDiscounts
+{
+    RailcardCode railcard_;
+    StatusCode adultstatus_;
+    StatusCode childstatus_;
+    FareKernel::PercentageTable adultTable_;
+    FareKernel::PercentageTable childTable_;
+    FareKernel::PercentageTable noDiscountTable_;
+
+    // the non-standard discount station sets of the origins and destinations searched, each resolved once. Sets are
+    // numbered as they are first seen and the memo is keyed on the numbers, so stations with the same set (most often
+    // no FNS records at all) share their results:
+    mutable ArenaVector<NonStandardDiscountIndex::StationSet> nsdStationSets_;
+    mutable ArenaMap<NonStandardDiscountIndex::StationSet, size_t> nsdStationSetIds_;
+    mutable ArenaMap<UNLC, size_t> nsdOriginSetIds_;
+    mutable ArenaMap<UNLC, size_t> nsdDestinationSetIds_;
+    mutable ArenaMap<std::tuple<size_t, size_t, RouteCode, TicketCode>, RJISDataset::NSDIterator> nsdMemo_;
+
+    RailcardDiscounts(const FareSearchParams& searchParams, const RailcardCode& railcard) :
+        railcard_(railcard)
+    {
+        // the statuses in searchParams are those of the first railcard in the query so they cannot be used here:
+        FareSearchParams railcardParams(searchParams);
+        railcardParams.railcard_ = railcard;
+        GetRailcardStatuses(adultstatus_, childstatus_, railcardParams);
+
+        auto& table = RJISDataset::Get().standardDiscountTable;
+        table.FillPercentageTable(adultTable_, table.GetStatusIndex(adultstatus_), searchParams.travelDate_);
+        table.FillPercentageTable(childTable_, table.GetStatusIndex(childstatus_), searchParams.travelDate_);
+        noDiscountTable_.fill(FareKernel::noDiscount);
+    }
+
+    bool IsRailcard() const
+    {
+        return railcard_ != "   "s;
+    }
+
+    // the best non-standard discount for this railcard - the same (stations, route, ticket) is usually asked for many
+    // times in a query (for example by several fares on the same route) so results are remembered for the query:
+    RJISDataset::NSDIterator GetNonStandardDiscount(
+        const RouteCode& route, const TicketCode& ticketcode, const FareSearchParams& searchParams) const
+    {
+        typedef NonStandardDiscountIndex::Side Side;
+        auto key = std::make_tuple(
+            GetNSDStationSetId(nsdOriginSetIds_, Side::Origin, searchParams.flow_.origin, searchParams.travelDate_),
+            GetNSDStationSetId(nsdDestinationSetIds_, Side::Destination, searchParams.flow_.destination, searchParams.travelDate_),
+            route, ticketcode);
+        auto p = nsdMemo_.find(key);
+        if (p == nsdMemo_.end())
         {
-            found = true;
-            percentage = p->second.percentage_;
+            auto nsd = ::GetNonStandardDiscount(nsdStationSets_[std::get<0>(key)], nsdStationSets_[std::get<1>(key)],
+                route, ticketcode, railcard_, searchParams);
+            p = nsdMemo_.insert(std::make_pair(key, nsd)).first;
         }
+        return p->second;
     }
-    return found;
-}
 
-// ProcessFareEntry - process a single T record from the FFL file - these records are stored in the map RJISMaps::flowMainFares
-void ProcessFareEntry(
-    FareResultsMap& allFareResults,                 // OUTPUT. Mapping (flow, route, railcard, ticketcode)->(adult fare, child fare)
-    UFlow flow,                                     // INPUT. The flow found
+    bool GetAdultDiscount(int& percentage, const DiscountCategory& discountCategory) const
+    {
+        return GetTableDiscount(adultTable_, percentage, discountCategory);
+    }
+
+    bool GetChildDiscount(int& percentage, const DiscountCategory& discountCategory) const
+    {
+        return GetTableDiscount(childTable_, percentage, discountCategory);
+    }
+
+    // the adult table used by the batch kernel - adult fares are only discounted when we are using a railcard:
+    const FareKernel::PercentageTable& GetAdultTable() const { return IsRailcard() ? adultTable_ : noDiscountTable_; }
+    const FareKernel::PercentageTable& GetChildTable() const { return childTable_; }
+
+private:
+    // the number of the station set for one end of the search flow, resolving the set the first time the station is seen:
+    size_t GetNSDStationSetId(ArenaMap<UNLC, size_t>& setIds, NonStandardDiscountIndex::Side side, const UNLC& station,
+        const RJISDate::Date& travelDate) const
+    {
+        auto p = setIds.find(station);
+        if (p == setIds.end())
+        {
+            NonStandardDiscountIndex::StationSet stations;
+            GetNSDStationSet(stations, side, station, travelDate);
+            auto id = nsdStationSetIds_.insert(std::make_pair(stations, nsdStationSets_.size()));
+            if (id.second)
+            {
+                nsdStationSets_.push_back(stations);
+            }
+            p = setIds.insert(std::make_pair(station, id.first->second)).first;
+        }
+        return p->second;
+    }
+
+    static bool GetTableDiscount(const FareKernel::PercentageTable& table, int& percentage, const DiscountCategory& discountCategory)
+    {
+        uint16_t tablePercentage = table[FareKernel::GetCategoryIndex(discountCategory)];
+        if (tablePercentage == FareKernel::noDiscount)
+        {
+            return false;
+        }
+        percentage = tablePercentage;
+        return true;
+    }
+};
+
+// CalculateFareEntry - calculate the adult and child prices for a single T record from the FFL file - these records are
+// stored in the dataset's flowMainFares map
+FoundFareValue CalculateFareEntry(
     const RJISTypes::FFLFlowMainValue& flowValue,   // INPUT. The value (of the key-value pair) for the flow
     const RJISTypes::FFLFareMainValue& fareEntry,   // INPUT. The value (of the key-value pair) from the fare map
-    const FareSearchParams& searchParams       // values to possibly match
+    const TicketTypeHot& ttypeEntry,                // INPUT. The ticket type entry for the fare's ticket code
+    const RailcardDiscounts& discounts,             // INPUT. The railcard we are calculating for
+    const FareSearchParams& searchParams            // values to possibly match
  )
 {
-    // we need to look in the ticket type file to get the discount category:
-    RJISTypes::TicketTypeValue ttypeEntry;
-    bool ticketTypeFound = GetTicketTypeEntry(ttypeEntry, fareEntry.ticketCode_, searchParams);
-    if (!ticketTypeFound)
-    {
-        throw FareException(std::string() + "Cannot find ticket type " + fareEntry.ticketCode_.GetString() + " in ticket type file.");
-    }
-
     int adultfare, childfare;
     if (flowValue.IsStandardDiscount())
     {
@@ -388,18 +420,21 @@ void ProcessFareEntry(
         // to obtain the discount percentage:
         auto& discountCategory = ttypeEntry.discountCategory_; 
 
+        // a fare with no child discount for its category is sold to children at the undiscounted price - the batch kernel
+        // (FareKernel::DiscountFares) does the same. Before the kernel the child price was left unset in this case:
         adultfare = fareEntry.fare_;
+        childfare = fareEntry.fare_;
         int percentage;
-        bool childDiscountFound = GetStandardDiscount(percentage, searchParams.childstatus_, discountCategory, searchParams);
+        bool childDiscountFound = discounts.GetChildDiscount(percentage, discountCategory);
         if (childDiscountFound)
         {
             childfare = Rounding(adultfare, percentage);
         }
 
         // only discount and round adult fare if we are using a railcard:
-        if (searchParams.railcard_ != "   ")
+        if (discounts.IsRailcard())
         {
-            bool adultDiscountFound = GetStandardDiscount(percentage, searchParams.adultstatus_, discountCategory, searchParams);
+            bool adultDiscountFound = discounts.GetAdultDiscount(percentage, discountCategory);
             if (adultDiscountFound)
             {
                 adultfare = Rounding(adultfare, percentage);
@@ -409,11 +444,11 @@ void ProcessFareEntry(
     else // non-standard discount:
     {
         // get non-standard discount using original flows and not 
-        auto nsd = GetNonStandardDiscount(flowValue.route_, fareEntry.ticketCode_, searchParams);
+        auto nsd = discounts.GetNonStandardDiscount(flowValue.route_, fareEntry.ticketCode_, searchParams);
         adultfare = fareEntry.fare_;
         childfare = fareEntry.fare_;
         // only discount the adult fare if the railcard is not all spaces:
-        if (searchParams.railcard_ != "   "s)
+        if (discounts.IsRailcard())
         {
             if (nsd->adultNoDis_ == "N"s)
             {
@@ -422,7 +457,7 @@ void ProcessFareEntry(
                 auto& discountCategory = ttypeEntry.discountCategory_;
 
                 int percentage;
-                bool adultDiscountFound = GetStandardDiscount(percentage, searchParams.adultstatus_, discountCategory, searchParams);
+                bool adultDiscountFound = discounts.GetAdultDiscount(percentage, discountCategory);
                 if (adultDiscountFound)
                 {
                     adultfare = Rounding(adultfare, percentage);
@@ -450,7 +485,7 @@ void ProcessFareEntry(
             auto& discountCategory = ttypeEntry.discountCategory_;
 
             int percentage;
-            bool childDiscountFound = GetStandardDiscount(percentage, searchParams.childstatus_, discountCategory, searchParams);
+            bool childDiscountFound = discounts.GetChildDiscount(percentage, discountCategory);
             if (childDiscountFound)
             {
                 childfare = Rounding(childfare, percentage);
@@ -471,15 +506,25 @@ void ProcessFareEntry(
             std::cout << "RECALCULATE ADULT--------------------------\n";
         }
     }
-    FoundFareKey fk(flow, flowValue.route_, flowValue.nsDiscInd_, flowValue.flowid_);
-    FoundFareValue fv(adultfare, childfare, fareEntry.ticketCode_, fareEntry.rescode_, ttypeEntry.ticketClass_, ttypeEntry.ticketType_);
-    allFareResults[fk].push_back(fv);
+    return FoundFareValue(adultfare, childfare, fareEntry.ticketCode_, fareEntry.rescode_, ttypeEntry.ticketClass_, ttypeEntry.ticketType_);
+}
+
+// get the ticket type entry for a fare - every fare must have a ticket type:
+const TicketTypeHot& GetFareTicketType(const RJISTypes::FFLFareMainValue& fareEntry, const FareSearchParams& searchParams)
+{
+    auto ttypeEntry = GetTicketTypeEntry(fareEntry.ticketCode_, searchParams);
+    if (!ttypeEntry)
+    {
+        throw FareException(std::string() + "Cannot find ticket type " + fareEntry.ticketCode_.GetString() + " in ticket type file.");
+    }
+    return *ttypeEntry;
 }
 
 std::string GetCRSFromNLC(UNLC nlc)
 {
+    auto& dataset = RJISDataset::Get();
     std::string crs;
-    auto p = RJISMaps::locations.equal_range(nlc);
+    auto p = dataset.locations.equal_range(nlc);
     if (p.first != p.second)
     {
         crs = p.first->second.crsCode_.GetString();
@@ -495,123 +540,84 @@ std::string GetCRSFromNLC(UNLC nlc)
 void GetParamsDerivedFields(const FareSearchParams& searchParams)
 {
     // get the adult and child statuses for the railcard passed in:
-    RJISTypes::RailcardValue railcardEntry;
-    bool railcardFound = GetRailcardEntry(railcardEntry, searchParams);
-    if (railcardFound)
+    auto railcardEntry = GetRailcardEntry(searchParams);
+    if (railcardEntry)
     {
-        searchParams.adultstatus_ = railcardEntry.adultStatus_;
-        searchParams.childstatus_ = railcardEntry.childStatus_;
+        searchParams.adultstatus_ = railcardEntry->adultStatus_;
+        searchParams.childstatus_ = railcardEntry->childStatus_;
     }
     searchParams.crsOrigin_ = GetCRSFromNLC(searchParams.flow_.origin);
     searchParams.crsDestination_ = GetCRSFromNLC(searchParams.flow_.destination);
 }
 
-// We are a journey-plan consumer and as such we don't do primary journey planning. We consume pre-produced .plan 
-// files.
-// This function opens a journey plan file and reads all possible journey plans for this origin - we can cachehint this file
-// if necessary by implementing some form of cache-hinting. A hint would be given after the user enters
-// his origin. The output from this function is a vector of TrainCalls - there will ALWAY be an EVEN number
-// of the vector will consist of arrival departure pairs of TrainCalls
-void ProcessFareList::GetJourneyPlan(std::vector<TTTypes::TrainCall>, FareSearchParams & searchParams)
-{
-    // we look in the auxiliary directory for the .plan files.
-    auto& configuration = Config::Config::GetInstance();
-    auto dir = Config::directories.GetDirectory("aux");
-    dir += "/jp";
-    // filename cannot be the CRS as DOS device names are not permitted (e.g. PRN.plan, CON.plan, AUX.plan)
-    // so we prefix the CRS code with j:
-    std::string filename = dir + "/j" + searchParams.crsOrigin_.GetString() + ".plan";
-
-    typedef std::vector<CRSCode> Oneplan;
-    std::map<CRSCode, std::vector<Oneplan>> planlist;
-    try
-    {
-        ams::FastLineReader(filename, [&planlist, &searchParams](std::string line) {
-            ams::Trim(line);
-            static int linenumber = 0;
-            // allow double-forward-slash comments:
-            if (line.length() > 2 && line[0] != '/' && line[1] != '/')
-            {
-                if (line[3] != 0)
-                {
-                    std::cerr << "error at line " << linenumber + 1 << " colon expected at column 4 - line ignored\n";
-                }
-                CRSCode crs(line, 0);
-                Oneplan oneplan;
-                enum class States { Init, InCRS, GotCRS } state(States::Init);
+// check that each railcard in a query with several railcards is discounted with its own statuses - in particular
+// that a blank railcard (or one with no record) gets the no-railcard statuses rather than those of the first railcard
+// in the list. A dataset with a single railcard record is made for the test. Returns true if the statuses are right:
+bool RailcardSelfTest(std::ostream& os)
+{
+    RJISDataset dataset;
+    RJISTypes::RailcardValue young;
+    young.seqDates_.Set("31122999" "01011990" "01011990"s, 0);
+    young.adultStatus_ = StatusCode("201"s, 0);
+    young.childStatus_ = StatusCode("202"s, 0);
+    dataset.railcards.emplace(RailcardCode("YNG"s, 0), young);
+    dataset.railcardIndex.Build(dataset.railcards);
+    RJISDataset::Scope datasetScope(dataset);
+
+    // the statuses in the search params come from the first railcard in the list:
+    FareSearchParams searchParams("1072", "5268", "YNG");
+    GetParamsDerivedFields(searchParams);
 
-                std::string currentCRS;
-                for (auto i = 4u; i < line.length(); ++i)
-                {
-                    auto c = line[i];
-                    if (state == States::Init)
-                    {
-                        if (isupper(c))
-                        {
-                            state = States::InCRS;
-                            currentCRS += c;
-                        }
-                        else if (!isspace(c))
-                        {
-                            // ERROR
-                        }
-                    }
-                    else if (state == States::InCRS)
-                    {
-                        if (isupper(c))
-                        {
-                            currentCRS += c;
-                        }
-                        else if (currentCRS.length() != 3)
-                        {
-                            // ERROR - crs too short
-                        }
-                        else if (isspace(c))
-                        {
-                            oneplan.push_back(currentCRS);
-                            currentCRS.clear();
-                            state = States::GotCRS;  
-                        }
-                        else if (c == '|')
-                        {
-                            oneplan.push_back(currentCRS);
-                            planlist[searchParams.crsOrigin_].push_back(oneplan);
-                            currentCRS.clear();
-                            state = States::Init;
-                        }
-                    }
-                    else if (state == States::GotCRS) // we have at least one CRS already and we have just had a separator
-                    {
-                        if (isupper(c))
-                        {
-                            currentCRS.push_back(c);
-                            state = States::InCRS;
-                        }
-                        else if (c == '|')
-                        {
-                            oneplan.push_back(currentCRS);
-                            planlist[searchParams.crsOrigin_].push_back(oneplan);
-                            currentCRS.clear();
-                            state = States::Init;
-                        }
-                        else if (c != ' ')
-                        {
-                            // ERROR - unexpected character
-                        }
-                    }
-                }
-            }
-            linenumber++;
-        });
+    struct Expected
+    {
+        const char* railcard;
+        StatusCode adultStatus;
+        StatusCode childStatus;
+    };
+    const Expected expected[] = {
+        { "YNG", young.adultStatus_, young.childStatus_ },
+        { "   ", noRailcardAdultStatus, noRailcardChildStatus },
+        { "ZZZ", noRailcardAdultStatus, noRailcardChildStatus },
+        { "YNG", young.adultStatus_, young.childStatus_ },
+    };
+
+    int errors = 0;
+    for (auto& e : expected)
+    {
+        RailcardDiscounts discounts(searchParams, RailcardCode(e.railcard, 0));
+        if (discounts.adultstatus_ != e.adultStatus || discounts.childstatus_ != e.childStatus)
+        {
+            os << "Railcard statuses mismatch for \"" << e.railcard << "\": expected " << e.adultStatus << "/" <<
+                e.childStatus << " got " << discounts.adultstatus_ << "/" << discounts.childstatus_ << "\n";
+            ++errors;
+        }
     }
-    catch (std::exception ex)
+
+    if (errors == 0)
+    {
+        os << "Railcard self test passed\n";
+    }
+    else
     {
-        std::cerr << "ERROR: " << ex.what() << std::endl;
+        os << "Railcard self test FAILED with " << errors << " mismatches\n";
     }
+    return errors == 0;
+}
+
+// We are a journey-plan consumer and as such we don't do primary journey planning. We consume pre-produced .plan
+// files, which are read with the dataset (see JourneyPlanStore) so no file is read here. The output from this
+// function is the plans from the origin to the destination - each the stations at which to change:
+void ProcessFareList::GetJourneyPlan(std::vector<Oneplan>& plans, const FareSearchParams& searchParams)
+{
+    auto& dataset = RJISDataset::Get();
+    dataset.journeyPlans.ForEachPlan(searchParams.crsOrigin_, searchParams.crsDestination_, [&plans](const CRSCode* first, const CRSCode* last) {
+        plans.emplace_back(first, last);
+    });
 }
 
 void ProcessFareList::GetPlusbusFares(FoundPlusBus& plusbusResult, FareSearchParams& searchParams)
 {
+    auto& dataset = RJISDataset::Get();
     // determine group stations, county codes and London zone codes - we use these to search in the
     // NDF and NFO files - BUT we do not use clusters to search in the NDF or NFO files
 
@@ -638,7 +644,7 @@ void ProcessFareList::GetPlusbusFares(FoundPlusBus& plusbusResult, FareSearchPar
     bool restrictionFound = false;
     for (auto& flow : allPlusbusFlows)
     {
-        if (RJISMaps::plusbusRestrictionSet.find(flow) != RJISMaps::plusbusRestrictionSet.end())
+        if (dataset.plusbusRestrictionSet.find(flow) != dataset.plusbusRestrictionSet.end())
         {
             restrictionFound = true;
         }
@@ -656,8 +662,8 @@ void ProcessFareList::GetPlusbusFares(FoundPlusBus& plusbusResult, FareSearchPar
         for (auto p : allOrigins)
         {
 //            std::cout << "searching for origin " << p << "\n";
-            auto res = RJISMaps::plusbusNLCMap.find(p);
-            if (res != RJISMaps::plusbusNLCMap.end())
+            auto res = dataset.plusbusNLCMap.find(p);
+            if (res != dataset.plusbusNLCMap.end())
             {
                 plusbusOrigin = res->second;
 //                std::cout << "found plusbus origin " << plusbusOrigin << std::endl;
@@ -695,8 +701,8 @@ void ProcessFareList::GetPlusbusFares(FoundPlusBus& plusbusResult, FareSearchPar
         // is available, try to obtain a plusbus NLC:
         for (auto p : allDestinations)
         {
-            auto res = RJISMaps::plusbusNLCMap.find(p);
-            if (res != RJISMaps::plusbusNLCMap.end())
+            auto res = dataset.plusbusNLCMap.find(p);
+            if (res != dataset.plusbusNLCMap.end())
             {
                 plusbusDestination = res->second;
                 // break out of loop since we found a plusbus origin and there should be only one - a rare useful use of
@@ -800,20 +806,168 @@ void ProcessFareList::GetPlusbusFares(FoundPlusBus& plusbusResult, FareSearchPar
 
 }
 
-// Get all fares matching the searchparams
-void ProcessFareList::GetAllFares(
-    FareResultsMap& allFareResults,
+// the number of flow permutations in one worker pool chunk. Queries with no more flows than this are evaluated
+// on the request thread alone:
+const size_t flowsPerChunk = 64;
+
+inline size_t GetFlowChunkCount(size_t flowCount)
+{
+    return (flowCount + flowsPerChunk - 1) / flowsPerChunk;
+}
+
+// call func(chunk, first, last) for each chunk of at most flowsPerChunk flows on the worker pool. func must put its
+// results somewhere private to the chunk - the caller merges them in chunk order once all the chunks have finished:
+template <class Flows, class F> void ParallelForFlowChunks(const Flows& flows, F func)
+{
+    // the worker threads must use the same dataset as the calling thread even if a new one is published meanwhile:
+    auto& dataset = RJISDataset::Get();
+    WorkerPool::GetInstance().ParallelFor(GetFlowChunkCount(flows.size()), [&flows, &func, &dataset](size_t chunk)
+    {
+        RJISDataset::Scope datasetScope(dataset);
+        auto first = flows.begin() + chunk * flowsPerChunk;
+        auto last = flows.begin() + std::min(flows.size(), (chunk + 1) * flowsPerChunk);
+        func(chunk, first, last);
+    });
+}
+
+// Price the fares on the flows [first, last) for each railcard, adding them to the corresponding element of results.
+// Fares for which there is an NDF in ndfResults are skipped as the NDF overrides them:
+template <class FlowIterator> void AddFlowFares(
+    const ArenaVector<FareResults*>& results,
+    FlowIterator first,
+    FlowIterator last,
+    const ArenaVector<RailcardDiscounts>& railcardDiscounts,
+    const NDFResultsMap& ndfResults,
     const FareSearchParams& searchParams)
+{
+    auto& dataset = RJISDataset::Get();
+    // the T records for a single flow and the arrays passed to the discount kernel - reused for each flow:
+    ArenaVector<const RJISTypes::FFLFareMainValue*> batchEntries;
+    ArenaVector<const TicketTypeHot*> batchTypes;
+    ArenaVector<uint32_t> batchFares, adultPrices, childPrices;
+    ArenaVector<uint8_t> batchCategories;
+
+    for (; first != last; ++first)
+    {
+        auto& flow = *first;
+        // std::cout << "flow : " << flow << std::endl;
+        // there can be several flow entries for each flow permutation. These will either have different end dates or link via a 
+        // different flow ID to a different set of fares:
+        auto matchingFlowEntries = dataset.flowMainFlows.equal_range(flow);
+        for (auto p = matchingFlowEntries.first; p != matchingFlowEntries.second; ++p)
+        {
+            auto& matchingFlowKey = p->first;
+            auto& matchingFlowValue = p->second;
+            if (matchingFlowValue.daterange_.IsDateInRange(searchParams.travelDate_))
+            {
+                // we might be searching for a particular route - however, we include all routes if the route code is empty:
+                if (searchParams.route_.IsEmpty() || searchParams.route_ == matchingFlowValue.route_)
+                {
+                    FoundFareKey fk(matchingFlowKey, matchingFlowValue.route_, matchingFlowValue.nsDiscInd_, matchingFlowValue.flowid_);
+
+                    // get all the fare entries for this flow (they correspond to T records in the FFL file) along with their
+                    // ticket types - we need the ticket type to get the discount category and it is the same for all railcards:
+                    batchEntries.clear();
+                    batchTypes.clear();
+                    auto matchingFareEntries = dataset.flowMainFares.equal_range(matchingFlowValue.flowid_);
+                    for (auto fareEntry = matchingFareEntries.first; fareEntry != matchingFareEntries.second; ++fareEntry)
+                    {
+                        // we might be searching for a particular ticket - however, we include all tickets if the ticket code is empty:
+                        if (searchParams.ticketCode_.IsEmpty() || searchParams.ticketCode_ == fareEntry->second.ticketCode_)
+                        {
+                            batchEntries.push_back(&fareEntry->second);
+                            batchTypes.push_back(&GetFareTicketType(fareEntry->second, searchParams));
+                        }
+                    }
+
+                    size_t count = batchEntries.size();
+                    if (matchingFlowValue.IsStandardDiscount())
+                    {
+                        // standard discounts are pure arithmetic once the percentages are known, so discount all the
+                        // fares for the flow as a batch. A fare with no discount for its category keeps its undiscounted
+                        // price (see CalculateFareEntry):
+                        batchFares.resize(count);
+                        batchCategories.resize(count);
+                        adultPrices.resize(count);
+                        childPrices.resize(count);
+                        for (size_t i = 0; i < count; ++i)
+                        {
+                            batchFares[i] = static_cast<uint32_t>(batchEntries[i]->fare_);
+                            batchCategories[i] = batchTypes[i]->categoryIndex_;
+                        }
+                        for (size_t r = 0; r < railcardDiscounts.size(); ++r)
+                        {
+                            auto& discounts = railcardDiscounts[r];
+                            FareKernel::DiscountFares(adultPrices.data(), childPrices.data(), batchFares.data(), batchCategories.data(),
+                                count, discounts.GetAdultTable(), discounts.GetChildTable());
+
+                            for (size_t i = 0; i < count; ++i)
+                            {
+                                // if (from the NDFs we found earlier) we find a matching NDF for this flow, route, railcard and fareEntry then we must use it 
+                                // instead of the flow found here - therefore do not process this fare entry if we have already found an NDF:
+                                auto ndf = ndfResults.find(FoundNDFKey(matchingFlowKey, matchingFlowValue.route_,
+                                    discounts.railcard_, batchEntries[i]->ticketCode_));
+                                if (ndf == ndfResults.end()) // (if we didn't find an NDF)
+                                {
+                                    results[r]->Add(fk, FoundFareValue(adultPrices[i], childPrices[i],
+                                        batchEntries[i]->ticketCode_, batchEntries[i]->rescode_, batchTypes[i]->ticketClass_, batchTypes[i]->ticketType_));
+                                }
+                            }
+                        }
+                    }
+                    else
+                    {
+                        for (size_t r = 0; r < railcardDiscounts.size(); ++r)
+                        {
+                            auto& discounts = railcardDiscounts[r];
+                            for (size_t i = 0; i < count; ++i)
+                            {
+                                auto ndf = ndfResults.find(FoundNDFKey(matchingFlowKey, matchingFlowValue.route_,
+                                    discounts.railcard_, batchEntries[i]->ticketCode_));
+                                if (ndf == ndfResults.end())
+                                {
+                                    results[r]->Add(fk,
+                                        CalculateFareEntry(matchingFlowValue, *batchEntries[i], *batchTypes[i], discounts, searchParams));
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+}
+
+// Get all fares matching the searchparams for each of the railcards given. The flow permutations, the NDF and NFO scans,
+// the flow and T-record scans and the ticket type lookups are done once for all railcards - only the discounting (and the
+// check for an overriding NDF, which is railcard specific) is done per railcard. The railcard in searchParams is ignored.
+void ProcessFareList::GetAllFares(
+    RailcardFareResultsMap& allFareResults,
+    const FareSearchParams& searchParams,
+    const std::vector<RailcardCode>& railcards)
 {
     // fill in the search params derived fields - e.g. conversion of railcards to status codes:
     GetParamsDerivedFields(searchParams);
 
+    // resolve the status codes for each railcard once up front. There is always an entry in the output
+    // map for each railcard even if no fares are found:
+    ArenaVector<RailcardDiscounts> railcardDiscounts;
+    railcardDiscounts.reserve(railcards.size());
+    ArenaVector<FareResults*> railcardResults;
+    railcardResults.reserve(railcards.size());
+    for (auto& railcard : railcards)
+    {
+        railcardDiscounts.emplace_back(searchParams, railcard);
+        railcardResults.push_back(&allFareResults[railcard]);
+    }
+
     UNLC origin(searchParams.flow_.origin);
     UNLC destination(searchParams.flow_.destination);
 
     // determine group stations, county codes and London zone codes - we use these to search in the
     // NDF and NFO files - BUT we do not use clusters to search in the NDF or NFO files
-    std::deque<UNLC> allOrigins, allDestinations;
+    ArenaDeque<UNLC> allOrigins, allDestinations;
     GetRelatedStations(allOrigins, origin, searchParams.travelDate_);
     GetRelatedStations(allDestinations, destination, searchParams.travelDate_);
     // include the origin and destination stations themselves:
@@ -822,69 +976,480 @@ void ProcessFareList::GetAllFares(
 
     // Generated a list of flows from any station in the flow list to any other station in the flow list.
     // This is for NDFs and NFOs so it does not include clusters:
-    std::deque<UFlow> allNDFFlows;
+    ArenaDeque<UFlow> allNDFFlows;
     PermuteNLCs(allNDFFlows, allOrigins, allDestinations);
 
     // get a list of matching NDFs for every flow combination - each call to ProcessNDFs will
     // APPEND to the container specified in the first parameter:
 
-    // store NDFs in their own container for now - we will combine the NDF with the FFL container later:
+    // store NDFs in their own container for now - we will combine the NDF with the FFL container later. Large flow lists
+    // are scanned in chunks on the worker pool - ProcessNDFs keeps the first NDF found for each key so merging
+    // the chunk results in chunk order gives the same NDFs as scanning the flows in order:
     NDFResultsMap ndfResults;
-    for (auto& flow : allNDFFlows)
+    size_t ndfChunks = GetFlowChunkCount(allNDFFlows.size());
+    if (ndfChunks <= 1)
     {
-//        std::cout << "searching for NDF for " << flow << std::endl;
-        ProcessNDFs(ndfResults, flow, searchParams);
+        for (auto& flow : allNDFFlows)
+        {
+//            std::cout << "searching for NDF for " << flow << std::endl;
+            ProcessNDFs(ndfResults, flow, searchParams, railcards);
+        }
+    }
+    else
+    {
+        std::vector<std::unique_ptr<NDFResultsMap>> chunkResults(ndfChunks);
+        ParallelForFlowChunks(allNDFFlows, [&](size_t chunk, auto first, auto last)
+        {
+            auto results = std::make_unique<NDFResultsMap>();
+            for (auto p = first; p != last; ++p)
+            {
+                ProcessNDFs(*results, *p, searchParams, railcards);
+            }
+            chunkResults[chunk] = std::move(results);
+        });
+        for (auto& results : chunkResults)
+        {
+            ndfResults.insert(results->begin(), results->end());
+        }
     }
-
-    // print found NDFs for debugging purposes:
-
- //   DEBUGDumpNDFs(allFareResults);
- //   
- //   for (auto p : allNDFs)
-    //{
- //       std::cout << p.first.origin << " " << p.first.destination << " " << p.second.route_ << " " <<
-    //		p.second.ticketCode_ << " " << p.second.adultFare_ << " " << p.second.childFare_ << " line " << p.second.linenumber + 1 << "\n";
-    //}
-
 
     // add the clusters to the origin and destination lists for searching in the flow maps - these are
     // generate FROM the existing lists and added TO the existing lists.
     AddClusters(allOrigins, allOrigins, searchParams.travelDate_);
     AddClusters(allDestinations, allDestinations, searchParams.travelDate_);
 
-    std::deque<UFlow> permutedFlowlist;
+    ArenaDeque<UFlow> permutedFlowlist;
     PermuteNLCs(permutedFlowlist, allOrigins, allDestinations);
 
-    bool first = true;
-    for (auto flow : permutedFlowlist)
+    // evaluate the flows in chunks. Each chunk has its own copy of the railcard discounts (their memo of
+    // non-standard discounts is not shared between threads) and its own results. The results are appended in chunk
+    // order so that the fares for each railcard are in exactly the order a single pass over the flows gives:
+    size_t chunks = GetFlowChunkCount(permutedFlowlist.size());
+    if (chunks <= 1)
     {
-        // std::cout << "flow : " << flow << std::endl;
-        // there can be several flow entries for each flow permutation. These will either have different end dates or link via a 
-        // different flow ID to a different set of fares:
-        auto matchingFlowEntries = RJISMaps::flowMainFlows.equal_range(flow);
+        AddFlowFares(railcardResults, permutedFlowlist.begin(), permutedFlowlist.end(), railcardDiscounts, ndfResults, searchParams);
+    }
+    else
+    {
+        std::vector<std::unique_ptr<std::vector<FareResults>>> chunkResults(chunks);
+        ParallelForFlowChunks(permutedFlowlist, [&](size_t chunk, auto first, auto last)
+        {
+            ArenaVector<RailcardDiscounts> discounts(railcardDiscounts);
+            auto results = std::make_unique<std::vector<FareResults>>(railcards.size());
+            ArenaVector<FareResults*> resultPointers;
+            for (auto& fareResults : *results)
+            {
+                resultPointers.push_back(&fareResults);
+            }
+            AddFlowFares(resultPointers, first, last, discounts, ndfResults, searchParams);
+            chunkResults[chunk] = std::move(results);
+        });
+        for (auto& results : chunkResults)
+        {
+            for (size_t r = 0; r < railcardResults.size(); ++r)
+            {
+                railcardResults[r]->Append((*results)[r]);
+            }
+        }
+    }
+
+    // merge NDF results and normal fare results:
+    for (auto p : ndfResults)
+    {
+        FoundFareKey farekey(p.first.flow_, p.first.route_, -1, -1);
+        auto ttvalue = GetTicketTypeEntry(p.first.ticketcode_, searchParams);
+        int ticketClass = 0;
+        char ticketType = ' '; // S, R or N (single, return or season)
+        if (ttvalue)
+        {
+            ticketClass = ttvalue->ticketClass_;
+            ticketType = ttvalue->ticketType_;
+        }
+        FoundFareValue farevalue(p.second.adultPrice_, p.second.childPrice_, p.first.ticketcode_, p.second.restrictionCode_, ticketClass, ticketType);
+        allFareResults[p.first.railcard_].Add(farekey, farevalue);
+    }
+
+    // sort the fares for each railcard by flow:
+    for (auto results : railcardResults)
+    {
+        results->Group();
+    }
+}
+
+// Get all fares matching the searchparams for the single railcard in searchParams.railcard_
+void ProcessFareList::GetAllFares(
+    FareResults& allFareResults,
+    const FareSearchParams& searchParams)
+{
+    RailcardFareResultsMap railcardResults;
+    GetAllFares(railcardResults, searchParams, std::vector<RailcardCode>{ searchParams.railcard_ });
+    allFareResults.Append(railcardResults[searchParams.railcard_]);
+    allFareResults.Group();
+}
+
+// add the travel dates on which a record with the given validity starts and stops applying:
+inline void AddDateBoundaries(std::set<RJISDate::Date>& boundaries, const RJISDate::Date& startDate, const RJISDate::Date& endDate)
+{
+    boundaries.insert(startDate);
+    boundaries.insert(endDate + 1);
+}
+
+// GetFareDateBoundaries - find every travel date on which any record that could take part in a fare search for the given
+// search params starts or stops being valid. Between two consecutive boundaries the result of GetAllFares cannot change
+// so we need only evaluate it once per interval. Records are found WITHOUT checking dates so the set of boundaries
+// covers any date - it is up to the caller to ignore the boundaries outside the range of interest.
+void GetFareDateBoundaries(std::set<RJISDate::Date>& boundaries, const FareSearchParams& searchParams)
+{
+    auto& dataset = RJISDataset::Get();
+    UNLC origin(searchParams.flow_.origin);
+    UNLC destination(searchParams.flow_.destination);
+
+    // the location L-records for the origin and destination determine which groups, zones and counties are used:
+    for (auto& nlc : { origin, destination })
+    {
+        auto p = dataset.locations.equal_range(nlc);
+        for (auto loc = p.first; loc != p.second; ++loc)
+        {
+            AddDateBoundaries(boundaries, loc->second.seqDates_.GetStartDate(), loc->second.seqDates_.GetEndDate());
+        }
+    }
+
+    // all the stations that might be related on any date:
+    std::set<UNLC> allOrigins{ origin }, allDestinations{ destination };
+    GetRelatedStations(allOrigins, origin, searchParams.travelDate_, false);
+    GetRelatedStations(allDestinations, destination, searchParams.travelDate_, false);
+
+    std::deque<UFlow> allNDFFlows;
+    PermuteNLCs(allNDFFlows, allOrigins, allDestinations);
+
+    std::set<TicketCode> ticketCodes;
+    for (auto& flow : allNDFFlows)
+    {
+        for (auto ndfmap : { &dataset.ndfMain, &dataset.nfoMain })
+        {
+            auto p = ndfmap->equal_range(flow);
+            for (auto ndf = p.first; ndf != p.second; ++ndf)
+            {
+                AddDateBoundaries(boundaries, ndf->second.seqDates_.GetStartDate(), ndf->second.seqDates_.GetEndDate());
+                ticketCodes.insert(ndf->second.ticketCode_);
+            }
+        }
+    }
+
+    // cluster memberships change on their own dates:
+    for (auto stations : { &allOrigins, &allDestinations })
+    {
+        for (auto& nlc : *stations)
+        {
+            auto clusterIDEntry = dataset.clusters.find(nlc);
+            if (clusterIDEntry != dataset.clusters.end())
+            {
+                for (auto& clusterID : clusterIDEntry->second)
+                {
+                    for (auto& daterange : clusterID.second)
+                    {
+                        AddDateBoundaries(boundaries, daterange.GetStartDate(), daterange.GetEndDate());
+                    }
+                }
+            }
+        }
+    }
+
+    // non-standard discounts are searched by the origin and destination related stations:
+    for (auto& nlc : allOrigins)
+    {
+        auto p = dataset.nsdOriginIndex.equal_range(nlc);
+        for (auto nsd = p.first; nsd != p.second; ++nsd)
+        {
+            AddDateBoundaries(boundaries, nsd->second->dates_.GetStartDate(), nsd->second->dates_.GetEndDate());
+        }
+    }
+    for (auto& nlc : allDestinations)
+    {
+        auto p = dataset.nsdDestinationIndex.equal_range(nlc);
+        for (auto nsd = p.first; nsd != p.second; ++nsd)
+        {
+            AddDateBoundaries(boundaries, nsd->second->dates_.GetStartDate(), nsd->second->dates_.GetEndDate());
+        }
+    }
+
+    AddClusters(allOrigins, allOrigins, searchParams.travelDate_, false);
+    AddClusters(allDestinations, allDestinations, searchParams.travelDate_, false);
+
+    std::deque<UFlow> permutedFlowlist;
+    PermuteNLCs(permutedFlowlist, allOrigins, allDestinations);
+    for (auto& flow : permutedFlowlist)
+    {
+        auto matchingFlowEntries = dataset.flowMainFlows.equal_range(flow);
         for (auto p = matchingFlowEntries.first; p != matchingFlowEntries.second; ++p)
         {
-            auto& matchingFlowKey = p->first;
-            auto& matchingFlowValue = p->second;
-            if (matchingFlowValue.daterange_.IsDateInRange(searchParams.travelDate_))
+            AddDateBoundaries(boundaries, p->second.daterange_.GetStartDate(), p->second.daterange_.GetEndDate());
+            auto matchingFareEntries = dataset.flowMainFares.equal_range(p->second.flowid_);
+            for (auto fareEntry = matchingFareEntries.first; fareEntry != matchingFareEntries.second; ++fareEntry)
             {
-                // we might be searching for a particular route - however, we include all routes if the route code is empty:
-                if (searchParams.route_.IsEmpty() || searchParams.route_ == matchingFlowValue.route_)
+                ticketCodes.insert(fareEntry->second.ticketCode_);
+            }
+        }
+    }
+
+    // ticket types give the discount category, class and ticket type for each fare:
+    for (auto& ticketCode : ticketCodes)
+    {
+        auto p = dataset.ticketTypes.equal_range(ticketCode);
+        for (auto tty = p.first; tty != p.second; ++tty)
+        {
+            AddDateBoundaries(boundaries, tty->second.seqDates_.GetStartDate(), tty->second.seqDates_.GetEndDate());
+        }
+    }
+
+    // the railcard's records, every status it can be priced with (see RailcardDiscounts) and the standard discounts
+    // for those statuses:
+    auto matchingRailcards = dataset.railcards.equal_range(searchParams.railcard_);
+    for (auto p = matchingRailcards.first; p != matchingRailcards.second; ++p)
+    {
+        AddDateBoundaries(boundaries, p->second.seqDates_.GetStartDate(), p->second.seqDates_.GetEndDate());
+    }
+    std::set<StatusCode> statuses;
+    GetPossibleRailcardStatuses(statuses, searchParams.railcard_);
+    for (auto& discount : dataset.standardDiscounts)
+    {
+        if (statuses.find(discount.first.statusCode_) != statuses.end())
+        {
+            boundaries.insert(discount.second.endDate_ + 1);
+        }
+    }
+}
+
+// Get the fares for every travel date from searchParams.travelDate_ for the number of days given. Rather than
+// running a full search for each day we find the dates on which any relevant record changes validity and run
+// the search once for each interval between those dates - typically a handful of searches for a 90 day calendar.
+void ProcessFareList::GetFareCalendar(
+    FareCalendar& calendar,
+    const FareSearchParams& searchParams,
+    int days)
+{
+    calendar.intervalStarts_.clear();
+    calendar.intervals_.clear();
+    calendar.days_.clear();
+    if (days <= 0)
+    {
+        return;
+    }
+
+    RJISDate::Date firstDate = searchParams.travelDate_;
+    RJISDate::Date lastDate = firstDate + (days - 1);
+
+    std::set<RJISDate::Date> boundaries;
+    GetFareDateBoundaries(boundaries, searchParams);
+
+    // the first interval always starts on the first day - other intervals start on boundaries within the calendar:
+    calendar.intervalStarts_.push_back(firstDate);
+    for (auto p = boundaries.upper_bound(firstDate); p != boundaries.end() && *p <= lastDate; ++p)
+    {
+        calendar.intervalStarts_.push_back(*p);
+    }
+
+    // evaluate the fare engine once per interval, recording the cheapest adult and child fares:
+    std::vector<std::pair<int, int>> cheapest;
+    for (auto& intervalStart : calendar.intervalStarts_)
+    {
+        FareSearchParams intervalParams(searchParams);
+        intervalParams.travelDate_ = intervalStart;
+
+        calendar.intervals_.emplace_back();
+        auto& fares = calendar.intervals_.back();
+        GetAllFares(fares, intervalParams);
+
+        int cheapestAdult, cheapestChild;
+        fares.GetCheapest(cheapestAdult, cheapestChild);
+        cheapest.push_back(std::make_pair(cheapestAdult, cheapestChild));
+    }
+
+    // expand the intervals to every day in the calendar:
+    calendar.days_.reserve(days);
+    size_t interval = 0;
+    RJISDate::Date date = firstDate;
+    for (int i = 0; i < days; ++i, ++date)
+    {
+        while (interval + 1 < calendar.intervalStarts_.size() && calendar.intervalStarts_[interval + 1] <= date)
+        {
+            ++interval;
+        }
+        calendar.days_.push_back(FareCalendarDay{ date, interval, cheapest[interval].first, cheapest[interval].second });
+    }
+}
+
+// check that a change to the standard discounts for the no-railcard statuses splits the calendar - for a blank
+// railcard, one with no record and one whose record need not cover every date. A dataset with a single railcard
+// record and a single no-railcard discount ending within the calendar is made for the test. Returns true if the
+// discount's end gives a boundary for each:
+bool CalendarSelfTest(std::ostream& os)
+{
+    RJISDataset dataset;
+    RJISTypes::RailcardValue young;
+    young.seqDates_.Set("31122999" "01011990" "01011990"s, 0);
+    young.adultStatus_ = StatusCode("201"s, 0);
+    young.childStatus_ = StatusCode("202"s, 0);
+    dataset.railcards.emplace(RailcardCode("YNG"s, 0), young);
+    dataset.railcardIndex.Build(dataset.railcards);
+    RJISDataset::Scope datasetScope(dataset);
+
+    // a D record for the adult no-railcard status ending 30 days from today:
+    auto endDate = RJISDate::Date::Today() + 30;
+    int y, m, d;
+    endDate.GetYMD(y, m, d);
+    std::ostringstream oss;
+    oss << std::setfill('0') << std::setw(2) << d << std::setw(2) << m << std::setw(4) << y << "  N050";
+    dataset.standardDiscounts.emplace(RJISTypes::SDiscountKey(noRailcardAdultStatus, DiscountCategory("01"s, 0)),
+        RJISTypes::SDiscountValue(oss.str(), 0));
+
+    int errors = 0;
+    for (auto railcard : { "   ", "ZZZ", "YNG" })
+    {
+        FareSearchParams searchParams("1072", "5268", railcard);
+        GetParamsDerivedFields(searchParams);
+        std::set<RJISDate::Date> boundaries;
+        GetFareDateBoundaries(boundaries, searchParams);
+        if (boundaries.find(endDate + 1) == boundaries.end())
+        {
+            os << "Calendar has no boundary at the end of a no-railcard discount for \"" << railcard << "\"\n";
+            ++errors;
+        }
+    }
+
+    if (errors == 0)
+    {
+        os << "Calendar self test passed\n";
+    }
+    else
+    {
+        os << "Calendar self test FAILED with " << errors << " mismatches\n";
+    }
+    return errors == 0;
+}
+
+// Get the fares from every station in the origins set to the single destination in searchParams.flow_.destination. The
+// origin in searchParams is ignored. Rather than running GetAllFares once per origin (which would scan every flow from 
+// every origin), we expand the destination once and walk the destination-major indexes of the dataset, distributing
+// each flow found to all the origin stations whose related stations (groups, counties, zones and clusters) include
+// the flow's origin. NDFs and standard-discount fares do not depend on the origin station searched for so they
+// are calculated once per flow and shared. Non-standard discounts DO depend on the station searched for so these
+// are calculated per origin station.
+void ProcessFareList::GetAllFaresToDestination(
+    OriginFareResultsMap& allFareResults,
+    const std::set<UNLC>& origins,
+    const FareSearchParams& searchParams)
+{
+    auto& dataset = RJISDataset::Get();
+    GetParamsDerivedFields(searchParams);
+
+    UNLC destination(searchParams.flow_.destination);
+
+    // expand the destination once - NDF destinations do not include clusters, flow destinations do:
+    std::set<UNLC> ndfDestinations{ destination }, flowDestinations;
+    GetRelatedStations(ndfDestinations, destination, searchParams.travelDate_);
+    flowDestinations = ndfDestinations;
+    AddClusters(flowDestinations, flowDestinations, searchParams.travelDate_);
+
+    // for each NLC that may appear as the origin of a flow (station, group, county, zone or cluster), get the list of 
+    // origin stations whose expansion includes that NLC:
+    std::map<UNLC, std::vector<UNLC>> ndfOriginOwners, flowOriginOwners;
+    for (auto origin : origins)
+    {
+        std::set<UNLC> allOrigins{ origin };
+        GetRelatedStations(allOrigins, origin, searchParams.travelDate_);
+        for (auto nlc : allOrigins)
+        {
+            ndfOriginOwners[nlc].push_back(origin);
+        }
+        AddClusters(allOrigins, allOrigins, searchParams.travelDate_);
+        for (auto nlc : allOrigins)
+        {
+            flowOriginOwners[nlc].push_back(origin);
+        }
+    }
+
+    // find every distinct NDF/NFO flow to the destination from an origin we are interested in and process it once:
+    std::set<UFlow> ndfFlows;
+    for (auto nlc : ndfDestinations)
+    {
+        auto ndfIters = dataset.ndfDestinationIndex.equal_range(nlc);
+        for (auto p = ndfIters.first; p != ndfIters.second; ++p)
+        {
+            if (ndfOriginOwners.find(p->second->first.origin) != ndfOriginOwners.end())
+            {
+                ndfFlows.insert(p->second->first);
+            }
+        }
+        auto nfoIters = dataset.nfoDestinationIndex.equal_range(nlc);
+        for (auto p = nfoIters.first; p != nfoIters.second; ++p)
+        {
+            if (ndfOriginOwners.find(p->second->first.origin) != ndfOriginOwners.end())
+            {
+                ndfFlows.insert(p->second->first);
+            }
+        }
+    }
+
+    NDFResultsMap ndfResults;
+    for (auto& flow : ndfFlows)
+    {
+        ProcessNDFs(ndfResults, flow, searchParams);
+    }
+
+    // resolve the railcard's status codes once - the discount lookups are then shared by every origin station:
+    RailcardDiscounts discounts(searchParams, searchParams.railcard_);
+
+    // search parameters for non-standard discounts - we change the origin for each station:
+    FareSearchParams nsdSearchParams(searchParams);
+
+    for (auto nlc : flowDestinations)
+    {
+        auto flowIters = dataset.flowDestinationIndex.equal_range(nlc);
+        for (auto p = flowIters.first; p != flowIters.second; ++p)
+        {
+            auto& matchingFlowKey = p->second->first;
+            auto& matchingFlowValue = p->second->second;
+
+            auto owners = flowOriginOwners.find(matchingFlowKey.origin);
+            if (owners == flowOriginOwners.end() || !matchingFlowValue.daterange_.IsDateInRange(searchParams.travelDate_))
+            {
+                continue;
+            }
+
+            if (searchParams.route_.IsEmpty() || searchParams.route_ == matchingFlowValue.route_)
+            {
+                FoundFareKey fk(matchingFlowKey, matchingFlowValue.route_, matchingFlowValue.nsDiscInd_, matchingFlowValue.flowid_);
+                auto matchingFareEntries = dataset.flowMainFares.equal_range(matchingFlowValue.flowid_);
+                for (auto fareEntry = matchingFareEntries.first; fareEntry != matchingFareEntries.second; ++fareEntry)
                 {
-                    // get all the fare entries for this flow (they correspond to T records in the FFL file)
-                    auto matchingFareEntries = RJISMaps::flowMainFares.equal_range(matchingFlowValue.flowid_);
-                    for (auto fareEntry = matchingFareEntries.first; fareEntry != matchingFareEntries.second; ++fareEntry)
+                    if (searchParams.ticketCode_.IsEmpty() || searchParams.ticketCode_ == fareEntry->second.ticketCode_)
                     {
-                        // we might be searching for a particular ticket - however, we include all tickets if the ticket code is empty:
-                        if (searchParams.ticketCode_.IsEmpty() || searchParams.ticketCode_ == fareEntry->second.ticketCode_)
+                        // an NDF for the same flow, route, railcard and ticket code takes precedence over the flow fare:
+                        auto ndf = ndfResults.find(FoundNDFKey(matchingFlowKey, matchingFlowValue.route_,
+                            searchParams.railcard_, fareEntry->second.ticketCode_));
+                        if (ndf != ndfResults.end())
                         {
-                            // if (from the NDFs we found earlier) we find a matching NDF for this flow, route, railcard and fareEntry then we must use it 
-                            // instead of the flow found here - therefore do not process this fare entry if we have already found an NDF:
-                            auto ndf = ndfResults.find(FoundNDFKey(matchingFlowKey, matchingFlowValue.route_,
-                                searchParams.railcard_, fareEntry->second.ticketCode_));
-                            if (ndf == ndfResults.end()) // (if we didn't find an NDF)
+                            continue;
+                        }
+
+                        auto& ttypeEntry = GetFareTicketType(fareEntry->second, searchParams);
+
+                        if (matchingFlowValue.IsStandardDiscount())
+                        {
+                            // calculate once and share with every origin station:
+                            auto fv = CalculateFareEntry(matchingFlowValue, fareEntry->second, ttypeEntry, discounts, searchParams);
+                            for (auto origin : owners->second)
                             {
-                                ProcessFareEntry(allFareResults, matchingFlowKey, matchingFlowValue, fareEntry->second, searchParams);
+                                allFareResults[origin].Add(fk, fv);
+                            }
+                        }
+                        else
+                        {
+                            for (auto origin : owners->second)
+                            {
+                                nsdSearchParams.flow_.origin = origin;
+                                allFareResults[origin].Add(fk, CalculateFareEntry(matchingFlowValue, fareEntry->second, ttypeEntry, discounts, nsdSearchParams));
                             }
                         }
                     }
@@ -894,19 +1459,32 @@ void ProcessFareList::GetAllFares(
     }
 
     // merge NDF results and normal fare results:
-    for (auto p : ndfResults)
+    for (auto& p : ndfResults)
     {
+        auto owners = ndfOriginOwners.find(p.first.flow_.origin);
+        if (owners == ndfOriginOwners.end())
+        {
+            continue;
+        }
         FoundFareKey farekey(p.first.flow_, p.first.route_, -1, -1);
-        RJISTypes::TicketTypeValue ttvalue;
-        bool found = GetTicketTypeEntry(ttvalue, p.first.ticketcode_, searchParams);
+        auto ttvalue = GetTicketTypeEntry(p.first.ticketcode_, searchParams);
         int ticketClass = 0;
-        char ticketType; // S, R or N (single, return or season)
-        if (found)
+        char ticketType = ' '; // S, R or N (single, return or season)
+        if (ttvalue)
         {
-            ticketClass = ttvalue.ticketClass_;
-            ticketType = ttvalue.ticketType_;
+            ticketClass = ttvalue->ticketClass_;
+            ticketType = ttvalue->ticketType_;
         }
         FoundFareValue farevalue(p.second.adultPrice_, p.second.childPrice_, p.first.ticketcode_, p.second.restrictionCode_, ticketClass, ticketType);
-        allFareResults[farekey].push_back(farevalue);
+        for (auto origin : owners->second)
+        {
+            allFareResults[origin].Add(farekey, farevalue);
+        }
+    }
+
+    // sort the fares for each origin by flow:
+    for (auto& p : allFareResults)
+    {
+        p.second.Group();
     }
 }
@@ -1,8 +1,8 @@
 #pragma once
-#include "RJISMaps.h"
-#include "RJISTTMaps.h"
+#include "RJISDataset.h"
 #include "TTTypes.h"
 #include "FareSearchParams.h"
+#include "RequestArena.h"
 
 struct FareException : public QException
 {
@@ -59,25 +59,97 @@ struct FoundFareKey
     }
 };
 
+// a single fare - 16 bytes:
 struct FoundFareValue
 {
     int adultPrice_;
     int childPrice_;
     TicketCode ticketcode_;             // three letter ticket code from the FFL F records like 7DF or SOR
     RestrictionCode restrictionCode_;   // two letter restriction code from the FFL T records like BE
-    int ticketClass_;                   // 1, 2 or 9. This is the ticket class from the ticket types file
-    char ticketType_;                    // S, R, or N (single, return or season)
+    uint8_t ticketClass_;               // 1, 2 or 9. This is the ticket class from the ticket types file
+    char ticketType_;                   // S, R, or N (single, return or season)
     FoundFareValue(int adultPrice, int childPrice, const TicketCode &ticketCode,
         const RestrictionCode restrictionCode, const int ticketClass, char ticketType) :
         adultPrice_(adultPrice),
         childPrice_(childPrice),
         ticketcode_(ticketCode),
         restrictionCode_(restrictionCode),
-        ticketClass_(ticketClass),
+        ticketClass_(static_cast<uint8_t>(ticketClass)),
         ticketType_(ticketType)
     {}
 };
 
+// a fare together with the flow it was found on:
+struct FareRow
+{
+    FoundFareKey key_;
+    FoundFareValue fare_;
+};
+
+// FareResults - the fares found by a search as a flat, append-only array of rows. Fares are added in the order they are
+// found and Group is called once at the end to sort the rows by flow key (flow, route, flowid, discount indicator) so
+// that the fares for each flow are contiguous. The sort is stable so fares for the same flow stay in the order they
+// were found.
+class FareResults
+{
+    ArenaVector<FareRow> rows_;
+
+public:
+    void Add(const FoundFareKey& key, const FoundFareValue& fare)
+    {
+        rows_.push_back(FareRow{ key, fare });
+    }
+
+    void Append(const FareResults& other)
+    {
+        rows_.insert(rows_.end(), other.rows_.begin(), other.rows_.end());
+    }
+
+    void Group()
+    {
+        std::stable_sort(rows_.begin(), rows_.end(), [](const FareRow& r1, const FareRow& r2) { return r1.key_ < r2.key_; });
+    }
+
+    // call f(key, first, last) for each run of rows with the same flow key - the rows must have been grouped:
+    template <class F> void ForEachFlow(F f) const
+    {
+        for (auto first = rows_.begin(); first != rows_.end();)
+        {
+            auto last = first + 1;
+            while (last != rows_.end() && !(first->key_ < last->key_))
+            {
+                ++last;
+            }
+            f(first->key_, first, last);
+            first = last;
+        }
+    }
+
+    // the cheapest adult and child fares, or -1 if there are none. 99999999 is the "no fare" indicator and is never the
+    // cheapest fare:
+    void GetCheapest(int& cheapestAdult, int& cheapestChild) const
+    {
+        const int noFare = 99999999;
+        cheapestAdult = cheapestChild = -1;
+        for (auto& row : rows_)
+        {
+            auto& fare = row.fare_;
+            if (fare.adultPrice_ >= 0 && fare.adultPrice_ != noFare && (cheapestAdult < 0 || fare.adultPrice_ < cheapestAdult))
+            {
+                cheapestAdult = fare.adultPrice_;
+            }
+            if (fare.childPrice_ >= 0 && fare.childPrice_ != noFare && (cheapestChild < 0 || fare.childPrice_ < cheapestChild))
+            {
+                cheapestChild = fare.childPrice_;
+            }
+        }
+    }
+
+    const ArenaVector<FareRow>& GetRows() const { return rows_; }
+    bool empty() const { return rows_.empty(); }
+    size_t size() const { return rows_.size(); }
+};
+
 struct FoundPlusBus
 {
     bool valid_ = false;        // set to true when ANY plusbus fares are found
@@ -88,20 +160,68 @@ struct FoundPlusBus
     std::map<std::string, std::pair<int, int>> pbFares_; // plusbus fares - key is the fare type and is one of B0, B1, B2, B3, SW0, SW1, SM0, SM1, SQ0, SQ1, SA0, SA1
 };
 
-typedef std::map<FoundFareKey, std::vector<FoundFareValue>> FareResultsMap;
-typedef std::map<FoundNDFKey, FoundNDFValue> NDFResultsMap;
+// results are request-scoped so they are allocated from the thread's request arena (when there is one):
+typedef ArenaMap<FoundNDFKey, FoundNDFValue> NDFResultsMap;
+
+// results for an all-to-one query - map origin station to the fares found from that station:
+typedef ArenaMap<UNLC, FareResults> OriginFareResultsMap;
 
 // map railcard to a plusbus structure - normally there will be only one railcard
 typedef std::map<std::string, FoundPlusBus> PlusbusMap;
 
+// map railcard to the fares found for that railcard - used when several railcards are searched in one pass:
+typedef ArenaMap<RailcardCode, FareResults> RailcardFareResultsMap;
+
+// one day of a fare calendar query - the fares themselves are shared by every day in the same interval:
+struct FareCalendarDay
+{
+    RJISDate::Date travelDate_;
+    size_t interval_;               // index into FareCalendar::intervals_
+    int cheapestAdult_;             // cheapest adult fare for this day or -1 if there are no fares
+    int cheapestChild_;             // cheapest child fare for this day or -1 if there are no fares
+};
+
+// results for a range of travel dates. The fare engine is evaluated once for each interval of dates over which no
+// flow, fare, NDF, NFO, ticket type, railcard, discount, location or cluster record changes validity:
+struct FareCalendar
+{
+    std::vector<RJISDate::Date> intervalStarts_;    // first travel date of each interval - in date order
+    std::vector<FareResults> intervals_;            // fares found for each interval
+    std::vector<FareCalendarDay> days_;             // one entry for each day in the calendar
+};
+
+// fill in the fields of a search derived from the others - the statuses of the railcard and the CRS codes of the
+// origin and destination:
+void GetParamsDerivedFields(const FareSearchParams& searchParams);
+
+// check the statuses used for each railcard of a query with several railcards, including blank and unknown ones.
+// Returns true if they are right - mismatches are reported to the stream given:
+bool RailcardSelfTest(std::ostream& os);
+
+// check that the fare calendar is split where the discounts for the statuses a railcard is priced with change,
+// including the no-railcard statuses. Returns true if it is - mismatches are reported to the stream given:
+bool CalendarSelfTest(std::ostream& os);
+
 class ProcessFareList
 {
 public:
     ProcessFareList() {}
-    void GetJourneyPlan(std::vector<TTTypes::TrainCall>, FareSearchParams& searchParams);
+    void GetJourneyPlan(std::vector<Oneplan>& plans, const FareSearchParams& searchParams);
     void GetPlusbusFares(FoundPlusBus& plusbusResult, FareSearchParams & searchParams);
     void ProcessFareList::GetAllFares(
-        FareResultsMap& result,
+        FareResults& result,
+        const FareSearchParams& searchParams);
+    void GetAllFares(
+        RailcardFareResultsMap& result,
+        const FareSearchParams& searchParams,
+        const std::vector<RailcardCode>& railcards);
+    void GetFareCalendar(
+        FareCalendar& calendar,
+        const FareSearchParams& searchParams,
+        int days);
+    void GetAllFaresToDestination(
+        OriginFareResultsMap& result,
+        const std::set<UNLC>& origins,
         const FareSearchParams& searchParams);
 
     virtual ~ProcessFareList(){}
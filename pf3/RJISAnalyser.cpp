@@ -1,5 +1,6 @@
 #include "stdafx.h"
 #include "RJISAnalyser.h"
+#include "ZipArchive.h"
 
 namespace {
 	const std::set<std::string> s_validExtensions = {
@@ -39,6 +40,15 @@ std::string GetExtension(std::string filename)
 
 RJISAnalyser::RJISAnalyser()
 {
+	Rescan();
+}
+
+void RJISAnalyser::Rescan()
+{
+	rjisfilemap_.clear();
+	rjistypemap_.clear();
+	rjispathmap_.clear();
+
 	WIN32_FIND_DATA fdata;
 	HANDLE h = FindFirstFile("RJFAF*", &fdata);
 
@@ -52,19 +62,74 @@ RJISAnalyser::RJISAnalyser()
 				int setnumber = GetSetNumberFromFilename(filename);
 				if (setnumber != -1)
 				{
-					std::string ext = GetExtension(filename);
-                    ams::MakeUpper(ext);
-					// store the set number for each extension if the extension is in the set of 
-					// valid extensions:
-					if (s_validExtensions.find(ext) != s_validExtensions.end())
+					AddFile(filename, MakeRJISFilename(setnumber, GetExtension(filename)));
+				}
+			}
+		} while (FindNextFile(h, &fdata));
+		FindClose(h);
+	}
+
+	// the members of any zip archives - these are read straight from the archive:
+	std::string directory = GetCurrentDirectoryPath();
+	h = FindFirstFile("*.zip", &fdata);
+	if (h != INVALID_HANDLE_VALUE)
+	{
+		do
+		{
+			if (!(fdata.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+			{
+				std::string archiveName = directory + fdata.cFileName;
+				try
+				{
+					ZipArchive archive(archiveName);
+					for (auto& member : archive.GetMembers())
 					{
-						rjisfilemap_[setnumber]++;
-						ams::MakeUpper(ext);
-						rjistypemap_[ext] = setnumber; 
+						// members may be in folders in the archive:
+						auto slash = member.name.find_last_of("/\\");
+						std::string filename = slash == std::string::npos ? member.name : member.name.substr(slash + 1);
+						std::string prefix = filename.substr(0, 5);
+						ams::MakeUpper(prefix);
+						if (prefix == "RJFAF" && member.supported)
+						{
+							AddFile(filename, ZipArchive::MakeMemberPath(archiveName, member.name));
+						}
 					}
 				}
+				catch (std::exception& ex)
+				{
+					// an archive we cannot read is not an RJIS distribution:
+					std::cerr << "Ignoring " << archiveName << ": " << ex.what() << "\n";
+				}
 			}
 		} while (FindNextFile(h, &fdata));
 		FindClose(h);
 	}
-}
\ No newline at end of file
+}
+
+// store the set number and the path for a file if its extension is in the set of valid extensions. A file from a set
+// that we already have a file of that type for is not counted again. Files on disk are added before archive members -
+// an archive member replaces a file on disk from a different set (an old set left unpacked) which is then no longer
+// counted:
+void RJISAnalyser::AddFile(const std::string& filename, const std::string& path)
+{
+	int setnumber = GetSetNumberFromFilename(filename);
+	std::string ext = GetExtension(filename);
+	ams::MakeUpper(ext);
+	if (setnumber != -1 && s_validExtensions.find(ext) != s_validExtensions.end())
+	{
+		auto p = rjistypemap_.find(ext);
+		if (p == rjistypemap_.end() || p->second != setnumber)
+		{
+			if (p != rjistypemap_.end() && ZipArchive::IsMemberPath(path) && !ZipArchive::IsMemberPath(rjispathmap_[ext]))
+			{
+				if (--rjisfilemap_[p->second] == 0)
+				{
+					rjisfilemap_.erase(p->second);
+				}
+			}
+			rjisfilemap_[setnumber]++;
+			rjistypemap_[ext] = setnumber;
+			rjispathmap_[ext] = path;
+		}
+	}
+}
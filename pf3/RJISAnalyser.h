@@ -5,7 +5,9 @@ class RJISAnalyser
 {
 	std::map<int, int> rjisfilemap_;			// count of number of files for each RJIS file set number in the specified folder
 	std::map<std::string, int> rjistypemap_;	// for each RJIS file extension, store the set number in the map
+	std::map<std::string, std::string> rjispathmap_;	// for each RJIS file extension, the file - on disk or in a zip archive
     RJISAnalyser();
+	void AddFile(const std::string& filename, const std::string& path);
 public:
 
     static RJISAnalyser& GetInstance()
@@ -16,6 +18,11 @@ public:
 
 	virtual ~RJISAnalyser() {}
 
+	// scan the current directory for RJIS files again - the results of the previous scan are discarded. RJIS files
+	// are found on disk and in zip archives (an RJIS distribution). A file on disk is used in preference to the same
+	// file of the same set in an archive, but a file in an archive replaces one on disk from a different set:
+	void Rescan();
+
 	int GetNumberOfFilesInSet(int set)
 	{
 		auto result = 0;
@@ -63,20 +70,21 @@ public:
 		return result;
 	}
 
+    // get the file for an extension - either a full path or archive|member for a file in a zip archive (see
+    // SourceReader):
     std::string GetFilename(std::string ext)
     {
         std::string result;
         ams::MakeUpper(ext);
 
-        // get the set number:
-        auto p = rjistypemap_.find(ext);
-        if (p == rjistypemap_.end())
+        auto p = rjispathmap_.find(ext);
+        if (p == rjispathmap_.end())
         {
             result = "";
         }
         else
         {
-            result = MakeRJISFilename(p->second, ext);
+            result = p->second;
         }
         return result;
     }
@@ -88,6 +96,17 @@ public:
             throw QException("Cannot make RJIS filename from integer " +
                 std::to_string(rjisSetNumber) + " (Must be from 0 to 999)");
         }
+        std::string sDir = GetCurrentDirectoryPath();
+
+        std::ostringstream oss;
+        std::string sep = ext.empty() ? "" : ".";
+        oss << sDir << "RJFAF" << std::dec << std::setfill('0') << std::setw(3) << rjisSetNumber << sep << ext;
+        return oss.str();
+    }
+
+    // the current directory ending in a backslash:
+    static std::string GetCurrentDirectoryPath()
+    {
         std::vector<char> currentDirectory(_MAX_PATH + 1);
         DWORD dirLength = GetCurrentDirectory(static_cast<DWORD>(currentDirectory.size()), currentDirectory.data());
         std::string sDir(currentDirectory.begin(), currentDirectory.begin() + dirLength);
@@ -95,11 +114,7 @@ public:
         {
             sDir += '\\';
         }
-
-        std::ostringstream oss;
-        std::string sep = ext.empty() ? "" : ".";
-        oss << sDir << "RJFAF" << std::dec << std::setfill('0') << std::setw(3) << rjisSetNumber << sep << ext;
-        return oss.str();
+        return sDir;
     }
 
 };
@@ -0,0 +1,207 @@
+#include "stdafx.h"
+#include "RJISDataset.h"
+
+SRWLOCK RJISDataset::publishLock_ = SRWLOCK_INIT;
+std::shared_ptr<const RJISDataset> RJISDataset::published_;
+unsigned RJISDataset::lastVersion_ = 0;
+thread_local const RJISDataset* RJISDataset::current_ = nullptr;
+
+// get the earliest possible date in one of the date ranges given a month and a year and a range in which the date
+// must be present. This means y is either the year of the earliest date in the range or the following year. If there is no
+// valid date within the range at all this is an error WHICH WE DO NOT DETECT
+inline RJISDate::Date GetEarliestDateInRange(int min, int din, const RJISDate::Range& range)
+{
+    std::cout << "date range (end date first)... ";
+    range.DumpDates(std::cout);
+    std::cout.put('\n');
+    std::cout << "getting earliest date for month " << min << " day " << din << "\n";
+    RJISDate::Date result;
+    int y, m, d;
+    range.GetStartDate().GetYMD(y, m, d);
+    if (range.IsDateInRange(y, min, din))
+    {
+        result = RJISDate::Date(y, min, din);
+    }
+    else
+    {
+        result = RJISDate::Date(y + 1, min, din);
+        if (!range.IsDateInRange(result))
+        {
+            throw QException("Cannot find (M,D)=(" + std::to_string(min) + ", " + std::to_string(din) + ") in current or future date range");
+        }
+    }
+    return result;
+}
+
+void RJISDataset::BuildIndexes()
+{
+    // create additional indices for the non-standard discounts table. We need these since the table can
+    // include wildcards:
+    nsdOriginIndex.clear();
+    nsdDestinationIndex.clear();
+    for (auto p = nonStandardDiscounts.cbegin(); p != nonStandardDiscounts.cend(); ++p)
+    {
+        nsdOriginIndex.insert(std::make_pair(p->originCode_, p));
+        nsdDestinationIndex.insert(std::make_pair(p->destinationCode_, p));
+    }
+    nsdDecisionIndex.Build(nonStandardDiscounts);
+
+    // remove flow records for which there are no fares:
+    for (auto p = std::begin(flowMainFlows); p != std::end(flowMainFlows);)
+    {
+        if (flowMainFares.find(p->second.flowid_) == flowMainFares.end())
+        {
+            flowMainFlows.erase(p++);
+        }
+        else
+        {
+            p++;
+        }
+    }
+
+    // index flows, NDFs and NFOs by destination for all-to-one ("where can I travel from") queries:
+    BuildDestinationIndexes();
+
+    // standard discounts as a dense table indexed by status code and discount category:
+    standardDiscountTable.Build(standardDiscounts);
+
+    // ticket types and railcards by code and date - only the fields used to price fares:
+    BuildValidityIndexes();
+
+    // departures and calls at each station:
+    fullTimetable.ShrinkToFit();
+    timetableIndex.Build(fullTimetable);
+    serviceCalendar.Build(fullTimetable);
+    raptorPlanner.Build(fullTimetable, timetableIndex, changeTimes);
+    connectionScan.Build(fullTimetable, timetableIndex, serviceCalendar, changeTimes);
+
+    // the plans read from each plan file in one flat store:
+    journeyPlans.Build();
+}
+
+// build the destination-major indexes - this must be called after all the fares files are loaded and after
+// any flows without fares have been removed from flowMainFlows:
+void RJISDataset::BuildDestinationIndexes()
+{
+    flowDestinationIndex.clear();
+    ndfDestinationIndex.clear();
+    nfoDestinationIndex.clear();
+    for (auto p = flowMainFlows.cbegin(); p != flowMainFlows.cend(); ++p)
+    {
+        flowDestinationIndex.insert(std::make_pair(p->first.destination, p));
+    }
+    for (auto p = ndfMain.cbegin(); p != ndfMain.cend(); ++p)
+    {
+        ndfDestinationIndex.insert(std::make_pair(p->first.destination, p));
+    }
+    for (auto p = nfoMain.cbegin(); p != nfoMain.cend(); ++p)
+    {
+        nfoDestinationIndex.insert(std::make_pair(p->first.destination, p));
+    }
+}
+
+// build the ticket type and railcard validity indexes - these point into the ticketTypes and railcards maps so
+// must be built after those are loaded:
+void RJISDataset::BuildValidityIndexes()
+{
+    ticketTypeIndex.Build(ticketTypes);
+    railcardIndex.Build(railcards);
+}
+
+void RJISDataset::AdjustHDRecords()
+{
+    int y, m, d;
+    for (auto& p : hdMap)
+    {
+        bool future = p.first.cf_.IsFuture();
+        try
+        {
+            if (future)
+            {
+                std::cout << "future\n    start date\n";
+                p.second.dateRange_.GetStartDate().GetYMD(y, m, d);
+                p.second.dateRange_.SetStartDate(GetEarliestDateInRange(m, d, futureDateRange));
+                std::cout << "    end date\n";
+                p.second.dateRange_.GetEndDate().GetYMD(y, m, d);
+                p.second.dateRange_.SetEndDate(GetEarliestDateInRange(m, d, futureDateRange));
+            }
+            else
+            {
+                std::cout << "current\n    start date\n";
+                p.second.dateRange_.GetStartDate().GetYMD(y, m, d);
+                p.second.dateRange_.SetStartDate(GetEarliestDateInRange(m, d, currentDateRange));
+                std::cout << "    end date\n";
+                p.second.dateRange_.GetEndDate().GetYMD(y, m, d);
+                p.second.dateRange_.SetEndDate(GetEarliestDateInRange(m, d, currentDateRange));
+            }
+        }
+        catch (QException qe)
+        {
+            std::cout << (future ? "future\n" : "current\n");
+            p.second.dateRange_.DumpDates(std::cout);
+        }
+    }
+}
+
+/* static */
+unsigned RJISDataset::Publish(std::shared_ptr<RJISDataset> dataset)
+{
+    std::shared_ptr<const RJISDataset> previous;
+    AcquireSRWLockExclusive(&publishLock_);
+    dataset->version_ = ++lastVersion_;
+    unsigned version = dataset->version_;
+    previous = std::move(published_);
+    published_ = std::move(dataset);
+    ReleaseSRWLockExclusive(&publishLock_);
+
+    // the previous dataset (if no request is still using it) is deleted here, outside the lock, when previous goes
+    // out of scope:
+    return version;
+}
+
+/* static */
+std::shared_ptr<const RJISDataset> RJISDataset::GetPublished()
+{
+    AcquireSRWLockShared(&publishLock_);
+    auto result = published_;
+    ReleaseSRWLockShared(&publishLock_);
+    return result;
+}
+
+/* static */
+const RJISDataset& RJISDataset::Get()
+{
+    if (current_)
+    {
+        return *current_;
+    }
+    // outside any scope nothing keeps the dataset alive - this is only for code that runs when no reload can be in
+    // progress, for example in main before the server starts:
+    AcquireSRWLockShared(&publishLock_);
+    auto result = published_.get();
+    ReleaseSRWLockShared(&publishLock_);
+    if (!result)
+    {
+        throw QException("No RJIS dataset has been published.");
+    }
+    return *result;
+}
+
+RJISDataset::Scope::Scope() : pinned_(GetPublished()), previous_(current_)
+{
+    if (!pinned_)
+    {
+        throw QException("No RJIS dataset has been published.");
+    }
+    current_ = pinned_.get();
+}
+
+RJISDataset::Scope::Scope(const RJISDataset& dataset) : previous_(current_)
+{
+    current_ = &dataset;
+}
+
+RJISDataset::Scope::~Scope()
+{
+    current_ = previous_;
+}
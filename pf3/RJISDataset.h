@@ -0,0 +1,136 @@
+#pragma once
+#include "RJISTypes.h"
+#include "TTTypes.h"
+#include "StandardDiscountTable.h"
+#include "NonStandardDiscountIndex.h"
+#include "ValidityIndex.h"
+#include "TimetableIndex.h"
+#include "ServiceCalendar.h"
+#include "RaptorPlanner.h"
+#include "ConnectionScan.h"
+#include "JourneyPlanStore.h"
+
+// RJISDataset - a complete set of RJIS fares data (and the timetable) together with the indexes built from it. A dataset
+// is filled by the line parsers, its indexes are built by BuildIndexes once every file is loaded and it is then published.
+// A published dataset is frozen: query code only ever gets a const reference to it (see Get) so any number of request
+// threads can read it without locks and none of them can change it - in particular no query can insert into one of the
+// maps by using operator[]. Use find, equal_range or the Find functions below.
+//
+// A new dataset can be published while requests are running (see DatasetLoader). A request pins the dataset that is
+// published when it starts with a Scope and sees only that dataset until it finishes, even if a newer one is published
+// meanwhile. A dataset is deleted when it is no longer published and the last request using it has finished.
+class RJISDataset
+{
+public:
+    typedef NonStandardDiscountIndex::NSDIterator NSDIterator;
+
+    std::multimap<UFlow, RJISTypes::NDFMainValue> ndfMain;
+    std::multimap<UFlow, RJISTypes::NDFMainValue> nfoMain;
+    std::multimap<UFlow, RJISTypes::FFLFlowMainValue> flowMainFlows;         // multi as several flows for the same date
+    std::multimap<int, RJISTypes::FFLFareMainValue> flowMainFares;           // T-records from the FFL file
+    std::multimap<TicketCode, RJISTypes::TicketTypeValue> ticketTypes;       // .TTY file
+    std::map<UNLC, std::map<UNLC, std::vector<RJISDate::Range>>> clusters;   // given a station, get a list of clusters with dateranges for each membership
+    std::map<UNLC, std::vector<UNLC>> decluster;                             // given an cluster, get a list of stations:
+    std::multimap<RailcardCode, RJISTypes::RailcardValue> railcards;
+    std::multimap<RJISTypes::RailcardMinKey, RJISTypes::RailcardMinValue> railcardMinFares;
+    std::multimap<RJISTypes::SDiscountKey, RJISTypes::SDiscountValue> standardDiscounts;
+    StandardDiscountTable standardDiscountTable;                             // dense [status][category] form of standardDiscounts
+    std::multimap<RJISTypes::StatusKey, RJISTypes::StatusValue> statusStandardDiscounts;
+    std::multimap<UNLC, RJISTypes::LocationLValue> locations;
+    std::map<UNLC, std::map<UNLC, std::vector<RJISDate::Date>>> groups;      // given a station, get a list of groups with dateranges for each station
+    std::map<UNLC, std::set<UNLC>> auxGroups;                                // given a station, get a list of aux groups to which the station belongs
+    std::map<UNLC, std::vector<UNLC>> degroup;                               // given a group station, e.g. a group like 1072, find all the stations in the group
+    std::deque<RJISTypes::NSDiscEntry> nonStandardDiscounts;
+
+    // non-standard discounts are double-keyed (by origin and destination), so we create two
+    // multimaps which are indexes into the above container. If we give an origin, we will get a
+    // range of indices into the nonStandardDiscounts
+    std::multimap<UNLC, NSDIterator> nsdOriginIndex, nsdDestinationIndex;
+    NonStandardDiscountIndex nsdDecisionIndex;                               // best-match index by station, route, railcard and ticket
+
+    std::map<UNLC, UNLC> plusbusNLCMap;                                      // given an NLC get a corresponding plusbus NLC
+    std::set<UFlow> plusbusRestrictionSet;                                   // flows for which PB is not allowed
+    std::set<UNLC> activeStations;                                           // stations for which fares can be quoted (see ActiveStations)
+
+    // destination-major secondary indexes into the flow, NDF and NFO maps. Reversed ('R' direction) flows are
+    // already stored in flowMainFlows in both directions so they are covered by the flow index:
+    std::multimap<UNLC, decltype(flowMainFlows)::const_iterator> flowDestinationIndex;
+    std::multimap<UNLC, decltype(ndfMain)::const_iterator> ndfDestinationIndex, nfoDestinationIndex;
+
+    // date-banded hot fields of the ticket types and railcards for the fare engine:
+    ValidityIndex<TicketCode, TicketTypeHot> ticketTypeIndex;
+    ValidityIndex<RailcardCode, RailcardHot> railcardIndex;
+
+    // restrictions - 19 different record types:
+    RJISDate::Range currentDateRange, futureDateRange;
+    std::multimap<RJISTypes::RestrictionsRRKey, RJISTypes::RestrictionsRR> rrMap;
+    std::multimap<RJISTypes::RestrictionsKey, RJISTypes::RestrictionsTR> trMap;
+    std::multimap<RJISTypes::RestrictionsKey, RJISTypes::RestrictionsHD> hdMap;
+
+    // the timetable (as columns - see Timetable) and the departures and calls at each station - the trains between two
+    // stations are found from the index (see TimetableIndex::ForEachLeg):
+    Timetable fullTimetable;
+    TimetableIndex timetableIndex;
+    ServiceCalendar serviceCalendar;                                         // the runs running on each date
+    std::map<CRSCode, uint16_t> changeTimes;                                 // minimum connection times from the MSN file
+    TiplocUpdates tiplocUpdates;                                             // the IDMS TIPLOCs the timetable is read with
+    RaptorPlanner raptorPlanner;                                             // journeys with changes (see RaptorPlanner)
+    ConnectionScan connectionScan;                                           // journeys in a window (see ConnectionScan)
+
+    // the plans from the jXXX.plan files - the stations to change at for each origin and destination:
+    JourneyPlanStore journeyPlans;
+
+    // the RJIS set numbers the dataset was loaded from and the number of the dataset - datasets are numbered from 1 in
+    // the order they are published so the number identifies the data a result was calculated from:
+    int fflSetNumber_ = -1;
+    int ndfSetNumber_ = -1;
+    unsigned version_ = 0;
+
+    RJISDataset() = default;
+    // the indexes hold iterators into the maps so a dataset cannot be copied:
+    RJISDataset(const RJISDataset&) = delete;
+    RJISDataset& operator=(const RJISDataset&) = delete;
+
+    // build the derived indexes and remove flows without fares - this must be called once all the files are loaded
+    // and before the dataset is published:
+    void BuildIndexes();
+    void AdjustHDRecords();
+
+    // build the ticket type and railcard validity indexes again after a change to those tables (see ChangeSet):
+    void BuildValidityIndexes();
+
+    // build the flow, NDF and NFO destination indexes again after a change to those maps (see ChangeSet):
+    void BuildDestinationIndexes();
+
+    // make a fully built dataset available to queries, replacing the dataset currently published. The dataset is
+    // const from then on. Returns the version given to the dataset:
+    static unsigned Publish(std::shared_ptr<RJISDataset> dataset);
+
+    // the dataset currently published - null if nothing has been published yet:
+    static std::shared_ptr<const RJISDataset> GetPublished();
+
+    // the dataset for this thread - the one pinned by the innermost Scope on this thread or, outside any scope, the one
+    // currently published. Throws if nothing has been published yet:
+    static const RJISDataset& Get();
+
+    // Scope - make a dataset the current one for this thread until the end of the scope. The default constructor pins the
+    // dataset currently published, keeping it alive for the scope. The other constructor is for running part of a
+    // request on another thread - the dataset must be kept alive by a Scope on the requesting thread:
+    class Scope
+    {
+        std::shared_ptr<const RJISDataset> pinned_;
+        const RJISDataset* previous_;
+    public:
+        Scope();
+        explicit Scope(const RJISDataset& dataset);
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+        ~Scope();
+    };
+
+private:
+    static SRWLOCK publishLock_;
+    static std::shared_ptr<const RJISDataset> published_;   // guarded by publishLock_
+    static unsigned lastVersion_;                           // guarded by publishLock_
+    static thread_local const RJISDataset* current_;
+};
@@ -0,0 +1,429 @@
+#include "stdafx.h"
+#include <numeric>
+#include "RaptorPlanner.h"
+
+namespace {
+
+const uint16_t noTime = 0xFFFF;
+const uint32_t none = 0xFFFFFFFF;
+}
+
+//----------------------------------------------------------------------------
+//
+// Name: RaptorSearch
+//
+// Description: The labels for one search. For each round and station the
+//              earliest arrival with at most that many trains and the leg
+//              that arrived there. A label copied from the round before
+//              keeps the round its leg was found in.
+//
+//----------------------------------------------------------------------------
+class RaptorSearch
+{
+    struct Label
+    {
+        uint16_t arrival = noTime;
+        uint16_t round = 0;
+        uint32_t route = none;
+        uint32_t trip = none;
+        uint16_t board = 0;
+        uint16_t alight = 0;
+    };
+
+    const RaptorPlanner& planner_;
+    const ServiceCalendar::ServiceDay& day_;
+    size_t stationCount_;
+    int rounds_;
+    uint32_t origin_, destination_;
+    std::vector<Label> labels_;                 // round by round
+    std::vector<uint8_t> marked_, nextMarked_;  // the stations improved in the last round
+    std::vector<uint32_t> routeStart_;          // the first stop to scan each route from
+    std::vector<uint32_t> queue_;               // the routes to scan
+
+    Label& GetLabel(int round, uint32_t station)
+    {
+        return labels_[round * stationCount_ + station];
+    }
+    void ScanRoute(int round, uint32_t routeIndex);
+
+public:
+    RaptorSearch(const RaptorPlanner& planner, const ServiceCalendar::ServiceDay& day, uint32_t origin, uint32_t destination, int maxChanges) :
+        planner_(planner),
+        day_(day),
+        stationCount_(planner.index_->GetStationCount()),
+        rounds_(maxChanges + 1),
+        origin_(origin),
+        destination_(destination),
+        labels_((rounds_ + 1) * stationCount_),
+        marked_(stationCount_),
+        nextMarked_(stationCount_),
+        routeStart_(planner.routes_.size(), none)
+    {
+    }
+
+    // search from the origin at a time. The labels from an earlier search from a later time are kept - they are
+    // still journeys from the origin - so a search only finds journeys better than those:
+    void Run(uint16_t departAfter);
+
+    // the arrival at the destination with at most a number of trains and whether that journey needs exactly that
+    // many trains:
+    uint16_t GetArrival(int round)
+    {
+        return GetLabel(round, destination_).arrival;
+    }
+    bool IsFoundInRound(int round)
+    {
+        auto& label = GetLabel(round, destination_);
+        return label.arrival != noTime && label.round == round;
+    }
+
+    RaptorPlanner::Journey GetJourney(int round);
+};
+
+void RaptorSearch::Run(uint16_t departAfter)
+{
+    GetLabel(0, origin_).arrival = departAfter;
+    std::fill(marked_.begin(), marked_.end(), 0);
+    marked_[origin_] = 1;
+    for (int round = 1; round <= rounds_; ++round)
+    {
+        // a journey with fewer trains is also a journey with at most this many:
+        for (uint32_t station = 0; station < stationCount_; ++station)
+        {
+            if (GetLabel(round - 1, station).arrival < GetLabel(round, station).arrival)
+            {
+                GetLabel(round, station) = GetLabel(round - 1, station);
+            }
+        }
+
+        // each route through a station improved in the last round, from the first such station on the route:
+        queue_.clear();
+        for (uint32_t station = 0; station < stationCount_; ++station)
+        {
+            if (marked_[station])
+            {
+                for (auto i = planner_.stationRouteOffsets_[station]; i < planner_.stationRouteOffsets_[station + 1]; ++i)
+                {
+                    auto& routeStop = planner_.stationRoutes_[i];
+                    if (routeStart_[routeStop.route] == none)
+                    {
+                        queue_.push_back(routeStop.route);
+                        routeStart_[routeStop.route] = routeStop.stop;
+                    }
+                    else
+                    {
+                        routeStart_[routeStop.route] = std::min(routeStart_[routeStop.route], routeStop.stop);
+                    }
+                }
+            }
+        }
+        if (queue_.empty())
+        {
+            break;
+        }
+
+        std::fill(nextMarked_.begin(), nextMarked_.end(), 0);
+        for (auto route : queue_)
+        {
+            ScanRoute(round, route);
+            routeStart_[route] = none;
+        }
+        marked_.swap(nextMarked_);
+    }
+}
+
+void RaptorSearch::ScanRoute(int round, uint32_t routeIndex)
+{
+    auto& route = planner_.routes_[routeIndex];
+    int trip = -1;
+    uint32_t board = 0;
+    for (auto stop = routeStart_[routeIndex]; stop < route.stopCount; ++stop)
+    {
+        auto station = planner_.routeStops_[route.firstStop + stop];
+
+        // alight here if that is better than any journey with as many trains to here or to the destination:
+        if (trip >= 0)
+        {
+            auto arrival = planner_.GetStopTime(route, trip, stop).arrival;
+            auto& label = GetLabel(round, station);
+            if (arrival < label.arrival && arrival < GetLabel(round, destination_).arrival)
+            {
+                label.arrival = arrival;
+                label.round = static_cast<uint16_t>(round);
+                label.route = routeIndex;
+                label.trip = route.firstTrip + trip;
+                label.board = static_cast<uint16_t>(board);
+                label.alight = static_cast<uint16_t>(stop);
+                nextMarked_[station] = 1;
+            }
+        }
+
+        // board here if we can catch an earlier trip than the one we are on. Changing trains takes the connection
+        // time for the station but starting the journey does not:
+        auto previous = GetLabel(round - 1, station).arrival;
+        if (previous != noTime)
+        {
+            uint16_t ready = previous + (station == origin_ ? 0 : planner_.changeTimes_[station]);
+            if (trip < 0 || ready <= planner_.GetStopTime(route, trip, stop).departure)
+            {
+                auto earlier = planner_.FindTrip(route, stop, ready, day_);
+                if (earlier >= 0 && (trip < 0 || earlier < trip))
+                {
+                    trip = earlier;
+                    board = stop;
+                }
+            }
+        }
+    }
+}
+
+RaptorPlanner::Journey RaptorSearch::GetJourney(int round)
+{
+    RaptorPlanner::Journey result;
+    auto station = destination_;
+    while (round > 0)
+    {
+        auto& label = GetLabel(round, station);
+        auto& route = planner_.routes_[label.route];
+        auto trip = label.trip - route.firstTrip;
+        result.legs.push_back(RaptorPlanner::Leg{
+            planner_.tripRuns_[label.trip],
+            label.board,
+            label.alight,
+            planner_.GetStopTime(route, trip, label.board).departure,
+            label.arrival });
+        station = planner_.routeStops_[route.firstStop + label.board];
+        round = label.round - 1;
+    }
+    std::reverse(result.legs.begin(), result.legs.end());
+    return result;
+}
+
+void RaptorPlanner::Build(const Timetable& timetable, const TimetableIndex& index, const std::map<CRSCode, uint16_t>& changeTimes)
+{
+    index_ = &index;
+    routes_.clear();
+    routeStops_.clear();
+    tripRuns_.clear();
+    stopTimes_.clear();
+
+    // the runs with each sequence of stations:
+    std::map<std::vector<uint32_t>, std::vector<uint32_t>> sequences;
+    for (uint32_t i = 0; i < timetable.GetRunCount(); ++i)
+    {
+        auto run = timetable[i];
+        if (run.GetCallCount() >= 2)
+        {
+            std::vector<uint32_t> stations;
+            for (size_t position = 0; position < run.GetCallCount(); ++position)
+            {
+                stations.push_back(static_cast<uint32_t>(index.FindStation(run.GetCRS(position))));
+            }
+            sequences[stations].push_back(i);
+        }
+    }
+
+    for (auto& sequence : sequences)
+    {
+        auto& stations = sequence.first;
+        std::vector<std::pair<uint32_t, std::vector<std::pair<uint16_t, uint16_t>>>> trips;
+        for (auto run : sequence.second)
+        {
+            trips.emplace_back(run, timetable[run].GetCallTimes());
+        }
+        std::sort(trips.begin(), trips.end(), [](const auto& x, const auto& y) {return x.second < y.second;});
+
+        // split the runs into routes in which no train overtakes another - each run goes in the first route whose
+        // last run it is never earlier than:
+        std::vector<std::vector<size_t>> splits;
+        for (size_t i = 0; i < trips.size(); ++i)
+        {
+            auto split = std::find_if(splits.begin(), splits.end(), [&](const std::vector<size_t>& routeTrips) {
+                auto& last = trips[routeTrips.back()].second;
+                auto& times = trips[i].second;
+                for (size_t stop = 0; stop < times.size(); ++stop)
+                {
+                    if (times[stop].first < last[stop].first || times[stop].second < last[stop].second)
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            });
+            if (split == splits.end())
+            {
+                splits.emplace_back();
+                split = splits.end() - 1;
+            }
+            split->push_back(i);
+        }
+
+        for (auto& routeTrips : splits)
+        {
+            Route route;
+            route.firstStop = static_cast<uint32_t>(routeStops_.size());
+            route.stopCount = static_cast<uint32_t>(stations.size());
+            route.firstTrip = static_cast<uint32_t>(tripRuns_.size());
+            route.tripCount = static_cast<uint32_t>(routeTrips.size());
+            route.firstTime = static_cast<uint32_t>(stopTimes_.size());
+            routeStops_.insert(routeStops_.end(), stations.begin(), stations.end());
+            for (auto i : routeTrips)
+            {
+                tripRuns_.push_back(trips[i].first);
+                for (auto& times : trips[i].second)
+                {
+                    stopTimes_.push_back(StopTime{ times.first, times.second });
+                }
+            }
+            routes_.push_back(route);
+        }
+    }
+
+    // the routes at each station:
+    auto stationCount = index.GetStationCount();
+    stationRouteOffsets_.assign(stationCount + 1, 0);
+    for (auto station : routeStops_)
+    {
+        ++stationRouteOffsets_[station + 1];
+    }
+    std::partial_sum(stationRouteOffsets_.begin(), stationRouteOffsets_.end(), stationRouteOffsets_.begin());
+    stationRoutes_.resize(stationRouteOffsets_.back());
+    std::vector<uint32_t> next(stationRouteOffsets_.begin(), stationRouteOffsets_.end() - 1);
+    for (uint32_t r = 0; r < routes_.size(); ++r)
+    {
+        for (uint32_t stop = 0; stop < routes_[r].stopCount; ++stop)
+        {
+            auto station = routeStops_[routes_[r].firstStop + stop];
+            stationRoutes_[next[station]++] = RouteStop{ r, stop };
+        }
+    }
+
+    changeTimes_.assign(stationCount, defaultChangeTime);
+    for (size_t station = 0; station < stationCount; ++station)
+    {
+        auto p = changeTimes.find(index.GetStation(station));
+        if (p != changeTimes.end())
+        {
+            changeTimes_[station] = p->second;
+        }
+    }
+}
+
+int RaptorPlanner::FindTrip(const Route& route, uint32_t stop, uint16_t ready, const ServiceCalendar::ServiceDay& day) const
+{
+    // the departures from a stop are in trip order as no trip overtakes another:
+    uint32_t first = 0, count = route.tripCount;
+    while (count > 0)
+    {
+        auto step = count / 2;
+        if (GetStopTime(route, first + step, stop).departure < ready)
+        {
+            first += step + 1;
+            count -= step + 1;
+        }
+        else
+        {
+            count = step;
+        }
+    }
+    for (; first < route.tripCount; ++first)
+    {
+        if (day.IsRunning(tripRuns_[route.firstTrip + first]))
+        {
+            return static_cast<int>(first);
+        }
+    }
+    return -1;
+}
+
+std::vector<RaptorPlanner::Journey> RaptorPlanner::Plan(const CRSCode& origin, const CRSCode& destination,
+    const ServiceCalendar::ServiceDay& day, uint16_t departAfter, int maxChanges) const
+{
+    std::vector<Journey> result;
+    auto originStation = index_->FindStation(origin);
+    auto destinationStation = index_->FindStation(destination);
+    if (originStation == index_->GetStationCount() || destinationStation == index_->GetStationCount() || originStation == destinationStation)
+    {
+        return result;
+    }
+
+    RaptorSearch search(*this, day, static_cast<uint32_t>(originStation), static_cast<uint32_t>(destinationStation), maxChanges);
+    search.Run(departAfter);
+    for (int round = 1; round <= maxChanges + 1; ++round)
+    {
+        if (search.IsFoundInRound(round))
+        {
+            result.push_back(search.GetJourney(round));
+        }
+    }
+    return result;
+}
+
+//----------------------------------------------------------------------------
+//
+// Name: Profile
+//
+// Description: rRAPTOR - search from each departure from the origin in the
+//              window, latest first, keeping the labels between searches.
+//              A search then only finds journeys that beat every journey
+//              leaving later, which are exactly the ones to keep.
+//
+//----------------------------------------------------------------------------
+std::vector<RaptorPlanner::Journey> RaptorPlanner::Profile(const CRSCode& origin, const CRSCode& destination,
+    const ServiceCalendar::ServiceDay& day, uint16_t fromMinutes, uint16_t toMinutes, int maxChanges) const
+{
+    std::vector<Journey> result;
+    auto originStation = index_->FindStation(origin);
+    auto destinationStation = index_->FindStation(destination);
+    if (originStation == index_->GetStationCount() || destinationStation == index_->GetStationCount() || originStation == destinationStation)
+    {
+        return result;
+    }
+
+    // the departure times from the origin in the window:
+    std::vector<uint16_t> departures;
+    for (auto i = stationRouteOffsets_[originStation]; i < stationRouteOffsets_[originStation + 1]; ++i)
+    {
+        auto& route = routes_[stationRoutes_[i].route];
+        auto stop = stationRoutes_[i].stop;
+        for (uint32_t trip = 0; trip < route.tripCount; ++trip)
+        {
+            auto departure = GetStopTime(route, trip, stop).departure;
+            if (departure >= fromMinutes && departure < toMinutes && day.IsRunning(tripRuns_[route.firstTrip + trip]))
+            {
+                departures.push_back(departure);
+            }
+        }
+    }
+    std::sort(departures.begin(), departures.end(), std::greater<uint16_t>());
+    departures.erase(std::unique(departures.begin(), departures.end()), departures.end());
+
+    RaptorSearch search(*this, day, static_cast<uint32_t>(originStation), static_cast<uint32_t>(destinationStation), maxChanges);
+    for (auto departure : departures)
+    {
+        std::vector<uint16_t> before;
+        for (int round = 1; round <= maxChanges + 1; ++round)
+        {
+            before.push_back(search.GetArrival(round));
+        }
+        search.Run(departure);
+        for (int round = 1; round <= maxChanges + 1; ++round)
+        {
+            if (search.GetArrival(round) < before[round - 1] && search.IsFoundInRound(round))
+            {
+                result.push_back(search.GetJourney(round));
+            }
+        }
+    }
+    std::stable_sort(result.begin(), result.end(), [](const Journey& x, const Journey& y) {return x.GetDeparture() < y.GetDeparture();});
+    return result;
+}
+
+size_t RaptorPlanner::GetMemoryBytes() const
+{
+    return routes_.capacity() * sizeof(Route) +
+        (routeStops_.capacity() + tripRuns_.capacity() + stationRouteOffsets_.capacity()) * sizeof(uint32_t) +
+        stopTimes_.capacity() * sizeof(StopTime) +
+        stationRoutes_.capacity() * sizeof(RouteStop) +
+        changeTimes_.capacity() * sizeof(uint16_t);
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include "TimetableIndex.h"
+#include "ServiceCalendar.h"
+
+// RaptorPlanner - journey planning over the whole timetable by rounds (RAPTOR - Delling, Pajor and Werneck, "Round-Based
+// Public Transit Routing"). Round k finds the earliest arrival at every station using k trains, so the rounds give the
+// earliest arrival for each number of changes in one search. No precomputed plans are needed.
+//
+// The timetable is rearranged into routes for the search: a route is a set of train runs with the same sequence of
+// stations in which no train overtakes another, and its stop times are held trip by trip in one flat array. A round
+// scans each route once from the first station on it reached in the previous round, which reads memory in order.
+//
+// Times are minutes from midnight of the service day. A train that runs past midnight has times of 1440 and more
+// after midnight. Only trains of the one service day are searched, so a journey cannot go on by a train that leaves
+// after midnight on the next service day. A change at a station takes at least the minimum connection time for the
+// station (from the MSN file) or defaultChangeTime if there is none.
+class RaptorPlanner
+{
+public:
+    static constexpr uint16_t defaultChangeTime = 10;
+    static constexpr int defaultMaxChanges = 4;
+
+    // one train in a journey - board and alight are the positions of calls in the run (see Timetable):
+    struct Leg
+    {
+        uint32_t run;
+        uint16_t board;
+        uint16_t alight;
+        uint16_t departure;
+        uint16_t arrival;
+    };
+
+    struct Journey
+    {
+        std::vector<Leg> legs;
+
+        uint16_t GetDeparture() const
+        {
+            return legs.front().departure;
+        }
+        uint16_t GetArrival() const
+        {
+            return legs.back().arrival;
+        }
+        size_t GetChanges() const
+        {
+            return legs.size() - 1;
+        }
+    };
+
+private:
+    friend class RaptorSearch;
+
+    struct Route
+    {
+        uint32_t firstStop;         // in routeStops_
+        uint32_t stopCount;
+        uint32_t firstTrip;         // in tripRuns_
+        uint32_t tripCount;
+        uint32_t firstTime;         // in stopTimes_ - tripCount * stopCount entries, trip by trip
+    };
+
+    struct StopTime
+    {
+        uint16_t arrival;
+        uint16_t departure;
+    };
+
+    struct RouteStop
+    {
+        uint32_t route;
+        uint32_t stop;              // the index of the station in the route
+    };
+
+    std::vector<Route> routes_;
+    std::vector<uint32_t> routeStops_;                  // the station numbers (see TimetableIndex) of each route
+    std::vector<uint32_t> tripRuns_;                    // the run of each trip - a route's trips are in departure order
+    std::vector<StopTime> stopTimes_;
+    std::vector<uint32_t> stationRouteOffsets_;         // for each station, its first entry in stationRoutes_
+    std::vector<RouteStop> stationRoutes_;              // the routes calling at each station
+    std::vector<uint16_t> changeTimes_;                 // the minimum connection time at each station
+    const TimetableIndex* index_ = nullptr;
+
+    const StopTime& GetStopTime(const Route& route, uint32_t trip, uint32_t stop) const
+    {
+        return stopTimes_[route.firstTime + trip * route.stopCount + stop];
+    }
+
+    // the first trip of a route running on the day that departs from a stop at or after a time - -1 if none:
+    int FindTrip(const Route& route, uint32_t stop, uint16_t ready, const ServiceCalendar::ServiceDay& day) const;
+
+public:
+    // build the routes for a timetable. The timetable and its index must outlive the planner and not change. The
+    // change times are in minutes by CRS:
+    void Build(const Timetable& timetable, const TimetableIndex& index, const std::map<CRSCode, uint16_t>& changeTimes);
+
+    // the journeys from origin to destination leaving at or after departAfter on the day: the earliest arrival
+    // using one train, then each journey with more changes that arrives earlier still, up to maxChanges changes:
+    std::vector<Journey> Plan(const CRSCode& origin, const CRSCode& destination, const ServiceCalendar::ServiceDay& day,
+        uint16_t departAfter, int maxChanges = defaultMaxChanges) const;
+
+    // every journey leaving in the window from fromMinutes up to toMinutes that no other journey beats - no journey
+    // leaves later, arrives earlier and has no more changes. In departure order:
+    std::vector<Journey> Profile(const CRSCode& origin, const CRSCode& destination, const ServiceCalendar::ServiceDay& day,
+        uint16_t fromMinutes, uint16_t toMinutes, int maxChanges = defaultMaxChanges) const;
+
+    size_t GetMemoryBytes() const;
+};
@@ -127,3 +127,21 @@ void ReadIDMS::WriteJSON(std::string filename, const std::set<UNLC>& nlcset)
     }
 
 }
+
+std::map<std::string, CRSCode> ReadIDMS::GetTiplocCRSCodes() const
+{
+    std::map<std::string, CRSCode> result;
+    for (auto& station : nlcToTiploc_)
+    {
+        auto p = nlcToCRS_.find(station.first);
+        if (p != nlcToCRS_.end())
+        {
+            for (auto tiploc : station.second)
+            {
+                ams::Trim(tiploc);
+                result[tiploc] = p->second;
+            }
+        }
+    }
+    return result;
+}
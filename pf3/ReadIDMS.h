@@ -15,5 +15,8 @@ class ReadIDMS
 public:
     ReadIDMS(std::string webdir, std::string idmsdir);
     void WriteJSON(std::string filename, const std::set<UNLC>& nlcset);
+
+    // the CRS code of each TIPLOC of a station that has both:
+    std::map<std::string, CRSCode> GetTiplocCRSCodes() const;
     virtual ~ReadIDMS(){}
 };
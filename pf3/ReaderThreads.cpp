@@ -36,11 +36,34 @@ unsigned WINAPI ReaderThreads::ReaderThread(void *p)
     {
         while (!stopped)
         {
-            ams::FastLineReader reader = queue.Remove();
-            reader.Read();
+            SourceReader reader = queue.Remove();
+            HANDLE h = reader.GetEvent();
+
+            // a file that cannot be read is still finished as far as the loader is concerned - the error is passed
+            // back with the file's event and the thread carries on with the next file:
+            std::string failure;
+            try
+            {
+                reader.Read();
+            }
+            catch (std::exception& ex)
+            {
+                failure = reader.GetFilename() + ": " + ex.what();
+            }
+            catch (...)
+            {
+                failure = reader.GetFilename() + ": unknown error";
+            }
+            if (!failure.empty())
+            {
+                std::cerr << failure << "\n";
+                if (h != nullptr)
+                {
+                    queue.AddFailure(h, failure);
+                }
+            }
 
             // set an event so that the monitoring thread knows that we have finished - this event is passed in the reader on the queue:
-            HANDLE h = reader.GetEvent();
             if (h != nullptr)
             {
                 // std::cout << "TID " << GetCurrentThreadId() << " Setting event for handle " << h << "\n";
@@ -53,9 +76,5 @@ unsigned WINAPI ReaderThreads::ReaderThread(void *p)
         // this is the way to leave the thread
         e;
     }
-    catch (std::exception ex)
-    {
-        std::cerr << ex.what() << "\n";
-    }
     return 0;
 }
\ No newline at end of file
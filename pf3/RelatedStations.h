@@ -1,4 +1,5 @@
 #pragma once
+#include "RJISDataset.h"
 
 
 // GetRelatedStations - given a station NLC and a travel date, return a list of related stations.
@@ -24,9 +25,10 @@ template <class Cont> void GetRelatedStations(Cont& container, const UNLC nlc, R
     //    std::cout << "GetRelatedStations\n";
     // today's date:
     RJISDate::Date today(RJISDate::Date::Today());
+    auto& dataset = RJISDataset::Get();
 
     // get all location entries (L-records) for the nlc
-    auto p1 = RJISMaps::locations.equal_range(nlc);
+    auto p1 = dataset.locations.equal_range(nlc);
     for (auto nlcEntry = p1.first; nlcEntry != p1.second; ++nlcEntry)
     {
         auto& loc = nlcEntry->second;
@@ -52,8 +54,8 @@ template <class Cont> void GetRelatedStations(Cont& container, const UNLC nlc, R
         }
     }
     // add the groups of which the station is a member - these are the M-records of RJIS5045
-    auto p2 = RJISMaps::groups.find(nlc);
-    if (p2 != RJISMaps::groups.end())
+    auto p2 = dataset.groups.find(nlc);
+    if (p2 != dataset.groups.end())
     {
         // iterate over the inner map, getting the structure contain the group code and list of end dates:
         for (auto groupEntry : p2->second)
@@ -68,8 +70,8 @@ template <class Cont> void GetRelatedStations(Cont& container, const UNLC nlc, R
             }
         }
     }
-    auto p3 = RJISMaps::auxGroups.find(nlc);
-    if (p3 != RJISMaps::auxGroups.end())
+    auto p3 = dataset.auxGroups.find(nlc);
+    if (p3 != dataset.auxGroups.end())
     {
         //        std::cout << "adding aux stations\n";
         // iterate over the inner map, getting the auxilliary member station NLC:
@@ -91,10 +93,11 @@ template<class Cont1, class Cont2> void AddClusters(
     bool checkdate = true       // generally we should check the date
     )
 {
+    auto& dataset = RJISDataset::Get();
     for (auto nlc : stations)
     {
-        auto clusterIDEntry = RJISMaps::clusters.find(nlc); // K-V pair - K = station NLC, V = list of clusters
-        if (clusterIDEntry != RJISMaps::clusters.end())
+        auto clusterIDEntry = dataset.clusters.find(nlc); // K-V pair - K = station NLC, V = list of clusters
+        if (clusterIDEntry != dataset.clusters.end())
         {
             // iterate along the list of clusters we found for the given station NLC:
             for (auto clusterID : clusterIDEntry->second)
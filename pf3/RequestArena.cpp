@@ -0,0 +1,101 @@
+#include "stdafx.h"
+#include "RequestArena.h"
+
+namespace {
+    thread_local RequestArena* currentArena = nullptr;
+}
+
+RequestArena::RequestArena(size_t initialSize)
+{
+    AddBlock(initialSize);
+}
+
+RequestArena::~RequestArena()
+{
+    for (auto& block : blocks_)
+    {
+        ::operator delete(block.data_);
+    }
+}
+
+void RequestArena::AddBlock(size_t minimumSize)
+{
+    size_t size = std::max(minimumSize, defaultBlockSize);
+    blocks_.push_back(Block{ static_cast<char*>(::operator new(size)), size });
+}
+
+void* RequestArena::Allocate(size_t bytes, size_t alignment)
+{
+    for (;;)
+    {
+        auto& block = blocks_[current_];
+        size_t aligned = (offset_ + alignment - 1) & ~(alignment - 1);
+        if (aligned + bytes <= block.size_)
+        {
+            used_ += aligned + bytes - offset_;
+            offset_ = aligned + bytes;
+            return block.data_ + aligned;
+        }
+        // move on to the next block, adding one if necessary. A block is always big enough for the allocation even
+        // if it is larger than the default block size:
+        size_t unused = block.size_ - offset_;
+        if (current_ + 1 == blocks_.size())
+        {
+            AddBlock(bytes + alignment);
+        }
+        else if (blocks_[current_ + 1].size_ < bytes + alignment)
+        {
+            ::operator delete(blocks_[current_ + 1].data_);
+            blocks_[current_ + 1].data_ = static_cast<char*>(::operator new(bytes + alignment));
+            blocks_[current_ + 1].size_ = bytes + alignment;
+        }
+        used_ += unused;
+        ++current_;
+        offset_ = 0;
+    }
+}
+
+void RequestArena::Reset()
+{
+    highWater_ = std::max(highWater_, used_);
+    if (current_ > 0)
+    {
+        size_t total = 0;
+        for (auto& block : blocks_)
+        {
+            total += block.size_;
+            ::operator delete(block.data_);
+        }
+        blocks_.clear();
+        AddBlock(total);
+    }
+    current_ = 0;
+    offset_ = 0;
+    used_ = 0;
+}
+
+RequestArena* RequestArena::Current()
+{
+    return currentArena;
+}
+
+RequestArena::Scope::Scope(RequestArena& arena) : arena_(arena), previous_(currentArena)
+{
+    currentArena = &arena;
+}
+
+RequestArena::Scope::~Scope()
+{
+    currentArena = previous_;
+    arena_.Reset();
+}
+
+RequestArena::NoArenaScope::NoArenaScope() : previous_(currentArena)
+{
+    currentArena = nullptr;
+}
+
+RequestArena::NoArenaScope::~NoArenaScope()
+{
+    currentArena = previous_;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+// RequestArena - a monotonic arena for the containers built while answering a single request. Allocation is a pointer
+// bump within a block and deallocation does nothing - all the memory is given back at once by Reset when the request
+// is finished. Each RequestHandler thread has its own arena so there is no allocator contention between threads.
+//
+// Containers use the arena through ArenaAllocator (in the style of std::pmr::polymorphic_allocator). A default
+// constructed ArenaAllocator uses the arena made current on this thread by RequestArena::Scope - if there is no current
+// arena it uses the global heap, so the same container types work outside a request (e.g. at startup).
+//
+// Only the containers declared with the Arena aliases below use the arena. Strings, the response, the dataset and any
+// container built on a thread with no current arena still come from the heap - the arena removes the many small node
+// allocations of the fare search, not every allocation made by a request.
+class RequestArena
+{
+    struct Block
+    {
+        char* data_;
+        size_t size_;
+    };
+    std::vector<Block> blocks_;
+    size_t current_ = 0;            // index of the block we are allocating from
+    size_t offset_ = 0;             // offset of the next free byte in the current block
+    size_t used_ = 0;               // total bytes allocated since the last reset (including alignment padding)
+    size_t highWater_ = 0;          // largest used_ ever seen
+
+    void AddBlock(size_t minimumSize);
+
+public:
+    static const size_t defaultBlockSize = 256 * 1024;
+
+    explicit RequestArena(size_t initialSize = defaultBlockSize);
+    ~RequestArena();
+    RequestArena(const RequestArena&) = delete;
+    RequestArena& operator=(const RequestArena&) = delete;
+
+    void* Allocate(size_t bytes, size_t alignment);
+
+    // give back everything allocated since the last reset. If the request needed more than one block, the blocks are
+    // replaced by a single block big enough for that request so the next similar request needs no new blocks:
+    void Reset();
+
+    size_t GetHighWater() const { return highWater_; }
+
+    // the arena in use on this thread or nullptr if none:
+    static RequestArena* Current();
+
+    // make an arena current on this thread for the lifetime of the scope object. The arena is reset when the scope ends
+    // so every container using it must be destroyed before then:
+    class Scope
+    {
+        RequestArena& arena_;
+        RequestArena* previous_;
+    public:
+        explicit Scope(RequestArena& arena);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    // make no arena current on this thread for the lifetime of the scope object, so that work which may run either on
+    // a thread with an arena or on one without uses the heap wherever it runs:
+    class NoArenaScope
+    {
+        RequestArena* previous_;
+    public:
+        NoArenaScope();
+        ~NoArenaScope();
+        NoArenaScope(const NoArenaScope&) = delete;
+        NoArenaScope& operator=(const NoArenaScope&) = delete;
+    };
+};
+
+template <class T> class ArenaAllocator
+{
+    template <class U> friend class ArenaAllocator;
+    RequestArena* arena_;
+
+public:
+    typedef T value_type;
+
+    // as with std::pmr::polymorphic_allocator the arena stays with the container - it is not taken from the other
+    // container on copy assignment, move assignment or swap. Allocators for different arenas are not equal so a move
+    // assignment between them moves the elements one by one, and two containers must only be swapped if they use the
+    // same arena:
+    typedef std::false_type propagate_on_container_copy_assignment;
+    typedef std::false_type propagate_on_container_move_assignment;
+    typedef std::false_type propagate_on_container_swap;
+    typedef std::false_type is_always_equal;
+
+    ArenaAllocator() : arena_(RequestArena::Current()) {}
+    explicit ArenaAllocator(RequestArena* arena) : arena_(arena) {}
+    template <class U> ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.arena_) {}
+
+    // a copy of a container belongs to the thread making the copy - a worker thread copying a request's containers
+    // must not allocate from the request thread's arena:
+    ArenaAllocator select_on_container_copy_construction() const { return ArenaAllocator(); }
+
+    T* allocate(size_t n)
+    {
+        if (arena_)
+        {
+            return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T)));
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t)
+    {
+        // arena memory is only given back by RequestArena::Reset:
+        if (!arena_)
+        {
+            ::operator delete(p);
+        }
+    }
+
+    template <class U> bool operator==(const ArenaAllocator<U>& other) const { return arena_ == other.arena_; }
+    template <class U> bool operator!=(const ArenaAllocator<U>& other) const { return arena_ != other.arena_; }
+};
+
+// request-scoped containers:
+template <class T> using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+template <class T> using ArenaDeque = std::deque<T, ArenaAllocator<T>>;
+template <class T, class Compare = std::less<T>> using ArenaSet = std::set<T, Compare, ArenaAllocator<T>>;
+template <class K, class V, class Compare = std::less<K>> using ArenaMap = std::map<K, V, Compare, ArenaAllocator<std::pair<const K, V>>>;
+template <class K, class V, class Compare = std::less<K>> using ArenaMultimap = std::multimap<K, V, Compare, ArenaAllocator<std::pair<const K, V>>>;
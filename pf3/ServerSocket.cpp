@@ -12,6 +12,7 @@ bool ServerSocket::startup_ = Startup();
 LPFN_ACCEPTEX ServerSocket::AcceptEx = GetAcceptEx();
 LPFN_DISCONNECTEX ServerSocket::DisconnectEx = GetDisconnectEx();
 LPFN_TRANSMITFILE ServerSocket::TransmitFile = GetTransmitFile();
+LPFN_GETACCEPTEXSOCKADDRS ServerSocket::GetAcceptExSockaddrs = LoadGetAcceptExSockaddrs();
 
 
 void ServerSocket::Init()
@@ -232,6 +233,19 @@ void ServerSocket::ProcessCompletion(ULONG_PTR key, LPOVERLAPPED pol, DWORD byte
         //    oss << (char)pClientContext->Data()[i];
         //}
 //        REPORTMESSAGE(oss.str(), 0);
+
+        // the admin URIs are only answered for callers on this device (or with the admin token) so the http
+        // manager needs to know where the connection came from:
+        sockaddr *localAddress, *remoteAddress;
+        int localLength, remoteLength;
+        GetAcceptExSockaddrs(pClientContext->Data(),
+                             static_cast<DWORD>(pClientContext->GetBufSize()),
+                             static_cast<DWORD>(pClientContext->GetAddrSize()),
+                             static_cast<DWORD>(pClientContext->GetAddrSize()),
+                             &localAddress, &localLength,
+                             &remoteAddress, &remoteLength);
+        pClientContext->httpmanager.SetLoopbackPeer(IsLoopbackAddress(remoteAddress));
+
         if (bytesTransferred == 0)
         {
             OutputDebugString("Zero byte accept - reading\n");
@@ -73,6 +73,7 @@ class ServerSocket
     static LPFN_ACCEPTEX AcceptEx;
     static LPFN_DISCONNECTEX DisconnectEx;
     static LPFN_TRANSMITFILE TransmitFile;
+    static LPFN_GETACCEPTEXSOCKADDRS GetAcceptExSockaddrs;
     static bool init_;
     AIOCP& iocp_;
     SOCKET listenSocket_;
@@ -162,6 +163,41 @@ inline LPFN_TRANSMITFILE GetTransmitFile()
     return result;
 }
 
+// AcceptEx writes the local and remote addresses after the received data - this splits them out:
+inline LPFN_GETACCEPTEXSOCKADDRS LoadGetAcceptExSockaddrs()
+{
+    SOCKET s1 = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    LPFN_GETACCEPTEXSOCKADDRS result;
+    GUID GuidGetAcceptExSockaddrs = WSAID_GETACCEPTEXSOCKADDRS;
+    DWORD dwbytes;
+    int res = WSAIoctl(s1, SIO_GET_EXTENSION_FUNCTION_POINTER,
+        &GuidGetAcceptExSockaddrs, sizeof (GuidGetAcceptExSockaddrs),
+        &result, sizeof (result),
+        &dwbytes, NULL, NULL);
+    if (res == SOCKET_ERROR)
+    {
+        throw ServerSocketException("WSAIoctl failed to get address for GetAcceptExSockaddrs");
+    }
+    return result;
+}
+
+// true if the address is on this device - 127.x.x.x, ::1 or an ipv4 loopback address mapped to ipv6 (the
+// listen socket is dual stack so ipv4 callers arrive as ::ffff:127.x.x.x):
+inline bool IsLoopbackAddress(const sockaddr* address)
+{
+    bool result = false;
+    if (address->sa_family == AF_INET)
+    {
+        auto address4 = reinterpret_cast<const sockaddr_in*>(address);
+        result = (ntohl(address4->sin_addr.s_addr) >> 24) == IN_LOOPBACKNET;
+    }
+    else if (address->sa_family == AF_INET6)
+    {
+        auto address6 = &reinterpret_cast<const sockaddr_in6*>(address)->sin6_addr;
+        result = IN6_IS_ADDR_LOOPBACK(address6) || (IN6_IS_ADDR_V4MAPPED(address6) && address6->s6_addr[12] == IN_LOOPBACKNET);
+    }
+    return result;
+}
 
 inline bool Startup()
 {
@@ -0,0 +1,59 @@
+#include "stdafx.h"
+#include <numeric>
+#include "ServiceCalendar.h"
+
+void ServiceCalendar::Build(const Timetable& timetable)
+{
+    timetable_ = &timetable;
+    runsByUID_.resize(timetable.GetRunCount());
+    std::iota(runsByUID_.begin(), runsByUID_.end(), 0);
+    std::stable_sort(runsByUID_.begin(), runsByUID_.end(), [&timetable](uint32_t x, uint32_t y) {
+        return timetable[x].GetTrainUID() < timetable[y].GetTrainUID();
+    });
+
+    uidOffsets_.clear();
+    for (uint32_t i = 0; i < runsByUID_.size(); ++i)
+    {
+        if (i == 0 || timetable[runsByUID_[i]].GetTrainUID() != timetable[runsByUID_[i - 1]].GetTrainUID())
+        {
+            uidOffsets_.push_back(i);
+        }
+    }
+    uidOffsets_.push_back(static_cast<uint32_t>(runsByUID_.size()));
+
+    cache_.Clear();
+}
+
+std::shared_ptr<const ServiceCalendar::ServiceDay> ServiceCalendar::MakeServiceDay(const RJISDate::Date& date) const
+{
+    auto& timetable = *timetable_;
+    auto day = std::make_shared<ServiceDay>();
+    day->bits_.assign((timetable.GetRunCount() + 63) / 64, 0);
+
+    for (size_t uid = 0; uid + 1 < uidOffsets_.size(); ++uid)
+    {
+        // the schedule for the train UID with the lowest STP indicator valid on the date (0 if there is none):
+        char best = 0;
+        uint32_t bestRun = 0;
+        for (auto i = uidOffsets_[uid]; i < uidOffsets_[uid + 1]; ++i)
+        {
+            auto run = timetable[runsByUID_[i]];
+            if ((best == 0 || run.GetSTPIndicator() < best) &&
+                run.GetRunningDates().IsDateInRange(date) && run.GetRunningDays().IsDateInDayset(date))
+            {
+                best = run.GetSTPIndicator();
+                bestRun = runsByUID_[i];
+            }
+        }
+        if (best != 0 && best != 'C')
+        {
+            day->bits_[bestRun >> 6] |= 1ull << (bestRun & 63);
+        }
+    }
+    return day;
+}
+
+std::shared_ptr<const ServiceCalendar::ServiceDay> ServiceCalendar::GetServiceDay(const RJISDate::Date& date) const
+{
+    return cache_.Get(date, [this](const RJISDate::Date& date) {return MakeServiceDay(date);});
+}
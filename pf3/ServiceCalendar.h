@@ -0,0 +1,49 @@
+#pragma once
+#include "Timetable.h"
+#include "DateCache.h"
+
+// ServiceCalendar - the train runs in the timetable that run on a given date, as one bit for each run. A timetable
+// query tests the bit for a run instead of testing the run's dates and days.
+//
+// Short term planning (STP) schedules are resolved when the bits for a date are made. Of the schedules for a train
+// UID that are valid on the date, the one with the lowest STP indicator is used: a cancellation (C) over a new (N)
+// schedule over an overlay (O) over the permanent (P) schedule. If that is a cancellation the train does not run.
+//
+// The bits for a date are made when a date is first asked for and kept in a DateCache.
+class ServiceCalendar
+{
+public:
+    // the runs running on one date:
+    class ServiceDay
+    {
+        std::vector<uint64_t> bits_;
+        friend class ServiceCalendar;
+    public:
+        bool IsRunning(uint32_t run) const
+        {
+            return (bits_[run >> 6] >> (run & 63)) & 1;
+        }
+    };
+
+private:
+    static const size_t cacheSize = 8;
+
+    const Timetable* timetable_ = nullptr;
+    std::vector<uint32_t> runsByUID_;                  // the run indexes sorted by train UID
+    std::vector<uint32_t> uidOffsets_;                 // the first run for each train UID - one more entry for the end
+
+    DateCache<ServiceDay, cacheSize> cache_;
+
+    std::shared_ptr<const ServiceDay> MakeServiceDay(const RJISDate::Date& date) const;
+
+public:
+    ServiceCalendar() = default;
+    ServiceCalendar(const ServiceCalendar&) = delete;
+    ServiceCalendar& operator=(const ServiceCalendar&) = delete;
+
+    // group the runs of a timetable by train UID - the timetable must outlive the calendar and not change:
+    void Build(const Timetable& timetable);
+
+    // the runs running on a date. The day returned stays valid after it has left the cache:
+    std::shared_ptr<const ServiceDay> GetServiceDay(const RJISDate::Date& date) const;
+};
@@ -0,0 +1,83 @@
+#include "stdafx.h"
+#include <ams/codetiming.h>
+#include "SourceReader.h"
+#include "ZipArchive.h"
+
+namespace {
+
+double GetSeconds(LARGE_INTEGER from, LARGE_INTEGER to)
+{
+    static const int64_t frequency = [] {
+        LARGE_INTEGER freq;
+        QueryPerformanceFrequency(&freq);
+        return freq.QuadPart;
+    }();
+    return static_cast<double>(ams::LiDiff(to, from)) / frequency;
+}
+
+}
+
+/* static */
+thread_local SourceStats* SourceReader::current_ = nullptr;
+
+// read the file and return its size in bytes:
+uint64_t SourceReader::ReadLines(std::function<void(std::string)> f)
+{
+    uint64_t result = 0;
+    if (ZipArchive::IsMemberPath(filename_))
+    {
+        result = ZipArchive::ReadMemberLines(filename_, f);
+    }
+    else
+    {
+        ams::FastLineReader reader(filename_, f);
+        reader.Read();
+        WIN32_FILE_ATTRIBUTE_DATA attributes;
+        if (GetFileAttributesEx(filename_.c_str(), GetFileExInfoStandard, &attributes))
+        {
+            result = (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+        }
+    }
+    return result;
+}
+
+void SourceReader::Read()
+{
+    if (stats_ == nullptr)
+    {
+        ReadLines(f_);
+        if (end_)
+        {
+            end_();
+        }
+    }
+    else
+    {
+        LARGE_INTEGER start, end;
+        QueryPerformanceCounter(&start);
+        stats_->queueSeconds = GetSeconds(queued_, start);
+
+        // the parser counts the records it stores with CountRecord:
+        current_ = stats_;
+        try
+        {
+            stats_->bytes = ReadLines([this](std::string line) {
+                ++stats_->lines;
+                f_(std::move(line));
+            });
+            if (end_)
+            {
+                end_();
+            }
+        }
+        catch (...)
+        {
+            current_ = nullptr;
+            throw;
+        }
+        current_ = nullptr;
+
+        QueryPerformanceCounter(&end);
+        stats_->readSeconds = GetSeconds(start, end);
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <ams/fileutils.h>
+
+// the cost of reading one file - filled in by the reader thread that reads it (see LoadReport):
+struct SourceStats
+{
+    std::string type;               // RJIS file extension or our own file type (PBN, MCA etc.)
+    std::string filename;
+    uint64_t bytes = 0;
+    uint64_t lines = 0;
+    uint64_t records = 0;           // records stored by the line parser - a line may give several records
+    double queueSeconds = 0;        // waiting on the file reader queue for a reader thread
+    double readSeconds = 0;         // reading and parsing
+};
+
+// SourceReader - read a source file line by line on one of the reader threads, calling a function for each line. The
+// file is either a file on disk or a member of a zip archive given as archive|member (see ZipArchive) so that an RJIS
+// distribution can be read without unpacking it.
+class SourceReader
+{
+    std::string filename_;
+    std::function<void(std::string)> f_;
+    std::function<void()> end_;
+    HANDLE event_;
+    SourceStats* stats_;
+    LARGE_INTEGER queued_;
+    static thread_local SourceStats* current_;
+
+    uint64_t ReadLines(std::function<void(std::string)> f);
+public:
+    SourceReader(std::string filename, std::function<void(std::string)> f, HANDLE event = nullptr, SourceStats* stats = nullptr) :
+        filename_(filename), f_(f), event_(event), stats_(stats)
+    {
+        QueryPerformanceCounter(&queued_);
+    }
+
+    // as above, but also call end after the last line - for a parser that works on more than one line at a time:
+    SourceReader(std::string filename, std::function<void(std::string)> f, std::function<void()> end, HANDLE event = nullptr, SourceStats* stats = nullptr) :
+        filename_(filename), f_(f), end_(end), event_(event), stats_(stats)
+    {
+        QueryPerformanceCounter(&queued_);
+    }
+
+    void Read();
+
+    const std::string& GetFilename() const
+    {
+        return filename_;
+    }
+
+    // the event to set when the file has been read:
+    HANDLE GetEvent() const
+    {
+        return event_;
+    }
+
+    // count records stored by the parser of the file being read on this thread:
+    static void CountRecord(uint64_t count = 1)
+    {
+        if (current_ != nullptr)
+        {
+            current_->records += count;
+        }
+    }
+};
@@ -0,0 +1,42 @@
+#include "stdafx.h"
+#include "StandardDiscountTable.h"
+
+// build the table from the standard discounts multimap. This must be called once all the RJIS files are loaded:
+void StandardDiscountTable::Build(const std::multimap<RJISTypes::SDiscountKey, RJISTypes::SDiscountValue>& standardDiscounts)
+{
+    statusCodes_.clear();
+    cells_.clear();
+    bands_.clear();
+
+    // the multimap is sorted by status code first so the status codes come out in order:
+    for (auto& discount : standardDiscounts)
+    {
+        if (statusCodes_.empty() || statusCodes_.back() != discount.first.statusCode_)
+        {
+            statusCodes_.push_back(discount.first.statusCode_);
+        }
+    }
+
+    cells_.resize(statusCodes_.size() * FareKernel::categoryCount, std::make_pair(0u, 0u));
+    bands_.reserve(standardDiscounts.size());
+
+    // entries with the same key are adjacent in the multimap and in insertion order, so each cell's bands are
+    // contiguous in bands_:
+    for (auto p = standardDiscounts.begin(); p != standardDiscounts.end();)
+    {
+        auto range = standardDiscounts.equal_range(p->first);
+        uint8_t categoryIndex = FareKernel::GetCategoryIndex(p->first.discountCategory_);
+        if (categoryIndex != FareKernel::invalidCategory)
+        {
+            int statusIndex = GetStatusIndex(p->first.statusCode_);
+            auto& cell = cells_[statusIndex * FareKernel::categoryCount + categoryIndex];
+            cell.first = static_cast<uint32_t>(bands_.size());
+            for (auto q = range.first; q != range.second; ++q)
+            {
+                bands_.push_back(Band{ q->second.endDate_, static_cast<uint16_t>(q->second.percentage_) });
+            }
+            cell.second = static_cast<uint32_t>(bands_.size()) - cell.first;
+        }
+        p = range.second;
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include "RJISTypes.h"
+#include "FareKernel.h"
+
+// StandardDiscountTable - the standard discounts from the RJIS .DIS file held as a dense table indexed by status code
+// and discount category. There are only a few hundred status codes and at most a hundred discount categories so the
+// table is small. Each cell holds the date bands (end date and percentage) for that status and category in the same
+// order as the standardDiscounts multimap, so the first band whose end date is not before the travel date is the
+// discount that applies - exactly as the multimap search does.
+//
+// A status code is converted to an index once per query with GetStatusIndex - subsequent lookups are an array index
+// and a scan of (usually) one or two date bands.
+class StandardDiscountTable
+{
+    struct Band
+    {
+        RJISDate::Date endDate_;
+        uint16_t percentage_;
+    };
+
+    std::vector<StatusCode> statusCodes_;                   // sorted - the position of a status code is its index
+    std::vector<std::pair<uint32_t, uint32_t>> cells_;      // [status * categoryCount + category] - first band and number of bands
+    std::vector<Band> bands_;
+
+public:
+    static const int noStatus = -1;
+
+    void Build(const std::multimap<RJISTypes::SDiscountKey, RJISTypes::SDiscountValue>& standardDiscounts);
+
+    // get the index of a status code or noStatus if the status code has no standard discounts:
+    int GetStatusIndex(const StatusCode& statusCode) const
+    {
+        auto p = std::lower_bound(statusCodes_.begin(), statusCodes_.end(), statusCode);
+        return (p == statusCodes_.end() || *p != statusCode) ? noStatus : static_cast<int>(p - statusCodes_.begin());
+    }
+
+    // get the discount percentage for a status index and category index valid on the travel date - returns false if
+    // there is none:
+    bool GetDiscount(int& percentage, int statusIndex, uint8_t categoryIndex, const RJISDate::Date& travelDate) const
+    {
+        if (statusIndex == noStatus || categoryIndex == FareKernel::invalidCategory)
+        {
+            return false;
+        }
+        auto& cell = cells_[statusIndex * FareKernel::categoryCount + categoryIndex];
+        for (uint32_t i = cell.first; i < cell.first + cell.second; ++i)
+        {
+            if (bands_[i].endDate_ >= travelDate)
+            {
+                percentage = bands_[i].percentage_;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // fill a percentage table for the batch fare kernel with every category's discount for the status on the travel
+    // date. Categories with no discount are set to FareKernel::noDiscount:
+    void FillPercentageTable(FareKernel::PercentageTable& table, int statusIndex, const RJISDate::Date& travelDate) const
+    {
+        for (int category = 0; category < FareKernel::categoryCount; ++category)
+        {
+            int percentage;
+            table[category] = GetDiscount(percentage, statusIndex, static_cast<uint8_t>(category), travelDate) ?
+                static_cast<uint16_t>(percentage) : FareKernel::noDiscount;
+        }
+    }
+};
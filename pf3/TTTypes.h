@@ -45,15 +45,15 @@ namespace TTTypes
     public:
         CRSCode crs;
     public:
-        TrainCall(std::string line)
+        TrainCall(std::string line, const TiplocUpdates& tiplocUpdates)
         {
-            std::string tiploc = line.substr(2, 8);
+            char tiploc[8];
+            std::copy_n(line.begin() + 2, 8, tiploc);
             if (isdigit(line[7]))
             {
-                tiploc = tiploc.substr(0, 7);
+                tiploc[7] = ' ';
             }
-            ams::Trim(tiploc);
-            crs = GetCRS(tiploc);
+            crs = std::string(GetCRS(tiploc, tiplocUpdates));
 
             // check this time - whether it is a departure or arrival time it is always present so this is a sensible sanity check:
             if (!isdigit(line[10]) || !isdigit(line[11]) || !isdigit(line[12]) || !isdigit(line[13]))
@@ -0,0 +1,127 @@
+#include "stdafx.h"
+#include "Timetable.h"
+#include "WorkerPool.h"
+
+std::vector<std::pair<uint16_t, uint16_t>> Timetable::RunView::GetCallTimes() const
+{
+    std::vector<std::pair<uint16_t, uint16_t>> result;
+    GetCallTimes(result);
+    return result;
+}
+
+void Timetable::RunView::GetCallTimes(std::vector<std::pair<uint16_t, uint16_t>>& times) const
+{
+    times.clear();
+    uint16_t offset = 0, previous = 0;
+    auto next = [&offset, &previous](uint16_t minutes) {
+        minutes += offset;
+        if (minutes < previous)
+        {
+            offset += 1440;
+            minutes += 1440;
+        }
+        previous = minutes;
+        return minutes;
+    };
+    for (size_t i = 0; i < callCount_; ++i)
+    {
+        uint16_t arrival = i == 0 ? GetDeparture(i) : GetArrival(i);
+        uint16_t departure = i + 1 == callCount_ ? arrival : GetDeparture(i);
+        arrival = next(arrival);
+        departure = next(departure);
+        times.emplace_back(arrival, departure);
+    }
+}
+
+void Timetable::Add(const TTTypes::TrainRun& run)
+{
+    TrainUID uid;
+    TrainID id;
+    uid.fill(' ');
+    id.fill(' ');
+    std::copy_n(run.trainUID.begin(), std::min(run.trainUID.size(), uid.size()), uid.begin());
+    std::copy_n(run.trainID.begin(), std::min(run.trainID.size(), id.size()), id.begin());
+    trainUIDs_.push_back(uid);
+    trainIDs_.push_back(id);
+    stpIndicators_.push_back(run.stpIndicator);
+    runningDates_.push_back(run.runningDates);
+    runningDays_.push_back(run.runningDays);
+    lineNumbers_.push_back(run.linenumber);
+
+    for (auto& call : run.callingAt)
+    {
+        crs_.push_back(call.crs);
+        arrivals_.push_back(call.GetArrival());
+        departures_.push_back(call.GetDeparture());
+    }
+    callOffsets_.push_back(static_cast<uint32_t>(crs_.size()));
+}
+
+void Timetable::Append(std::vector<Timetable>& parts)
+{
+    // the first run and first call of each part - a prefix sum of the run and call counts:
+    std::vector<size_t> firstRuns(parts.size() + 1, GetRunCount());
+    std::vector<size_t> firstCalls(parts.size() + 1, GetCallCount());
+    for (size_t i = 0; i < parts.size(); ++i)
+    {
+        firstRuns[i + 1] = firstRuns[i] + parts[i].GetRunCount();
+        firstCalls[i + 1] = firstCalls[i] + parts[i].GetCallCount();
+    }
+
+    callOffsets_.resize(firstRuns.back() + 1);
+    trainUIDs_.resize(firstRuns.back());
+    trainIDs_.resize(firstRuns.back());
+    stpIndicators_.resize(firstRuns.back());
+    runningDates_.resize(firstRuns.back());
+    runningDays_.resize(firstRuns.back());
+    lineNumbers_.resize(firstRuns.back());
+    crs_.resize(firstCalls.back());
+    arrivals_.resize(firstCalls.back());
+    departures_.resize(firstCalls.back());
+
+    // each part fills its own ranges of the columns:
+    WorkerPool::GetInstance().ParallelFor(parts.size(), [&](size_t i) {
+        auto& part = parts[i];
+        auto run = firstRuns[i];
+        auto call = static_cast<uint32_t>(firstCalls[i]);
+        std::transform(part.callOffsets_.begin() + 1, part.callOffsets_.end(), callOffsets_.begin() + run + 1,
+            [call](uint32_t offset) {return offset + call;});
+        std::copy(part.trainUIDs_.begin(), part.trainUIDs_.end(), trainUIDs_.begin() + run);
+        std::copy(part.trainIDs_.begin(), part.trainIDs_.end(), trainIDs_.begin() + run);
+        std::copy(part.stpIndicators_.begin(), part.stpIndicators_.end(), stpIndicators_.begin() + run);
+        std::copy(part.runningDates_.begin(), part.runningDates_.end(), runningDates_.begin() + run);
+        std::copy(part.runningDays_.begin(), part.runningDays_.end(), runningDays_.begin() + run);
+        std::copy(part.lineNumbers_.begin(), part.lineNumbers_.end(), lineNumbers_.begin() + run);
+        std::copy(part.crs_.begin(), part.crs_.end(), crs_.begin() + call);
+        std::copy(part.arrivals_.begin(), part.arrivals_.end(), arrivals_.begin() + call);
+        std::copy(part.departures_.begin(), part.departures_.end(), departures_.begin() + call);
+        part = Timetable();
+    });
+}
+
+void Timetable::ShrinkToFit()
+{
+    callOffsets_.shrink_to_fit();
+    trainUIDs_.shrink_to_fit();
+    trainIDs_.shrink_to_fit();
+    stpIndicators_.shrink_to_fit();
+    runningDates_.shrink_to_fit();
+    runningDays_.shrink_to_fit();
+    lineNumbers_.shrink_to_fit();
+    crs_.shrink_to_fit();
+    arrivals_.shrink_to_fit();
+    departures_.shrink_to_fit();
+}
+
+size_t Timetable::GetMemoryBytes() const
+{
+    return callOffsets_.capacity() * sizeof(uint32_t) +
+        trainUIDs_.capacity() * sizeof(TrainUID) +
+        trainIDs_.capacity() * sizeof(TrainID) +
+        stpIndicators_.capacity() * sizeof(char) +
+        runningDates_.capacity() * sizeof(RJISDate::Range) +
+        runningDays_.capacity() * sizeof(RJISDate::Dayset) +
+        lineNumbers_.capacity() * sizeof(int) +
+        crs_.capacity() * sizeof(CRSCode) +
+        (arrivals_.capacity() + departures_.capacity()) * sizeof(uint16_t);
+}
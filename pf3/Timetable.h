@@ -0,0 +1,129 @@
+#pragma once
+#include <array>
+#include "TTTypes.h"
+
+// Timetable - the train runs of the timetable held as columns. The calls of every run are stored one after another in
+// parallel arrays (station, arrival and departure) and a run is a range of calls, with its schedule (train UID and
+// ID, dates, days and STP indicator) in arrays indexed by run number. The whole timetable is a few large allocations
+// rather than several for each run, and a scan of the calls reads memory in order.
+//
+// A run is read through a RunView, which refers to the timetable and copies nothing. A position is the index of a
+// call within its run - the timetable indexes hold run numbers and positions (see TimetableIndex).
+class Timetable
+{
+public:
+    typedef std::array<char, 6> TrainUID;
+    typedef std::array<char, 4> TrainID;
+
+    class RunView
+    {
+        const Timetable* timetable_;
+        uint32_t run_;
+        uint32_t firstCall_;
+        uint32_t callCount_;
+    public:
+        RunView(const Timetable& timetable, uint32_t run) :
+            timetable_(&timetable),
+            run_(run),
+            firstCall_(timetable.callOffsets_[run]),
+            callCount_(timetable.callOffsets_[run + 1] - timetable.callOffsets_[run])
+        {
+        }
+
+        size_t GetCallCount() const
+        {
+            return callCount_;
+        }
+
+        // the station and times of a call - the public times where the file gives them and they are close to the
+        // working times. The first call has no arrival and the last no departure (0xFFFF):
+        const CRSCode& GetCRS(size_t position) const
+        {
+            return timetable_->crs_[firstCall_ + position];
+        }
+        uint16_t GetArrival(size_t position) const
+        {
+            return timetable_->arrivals_[firstCall_ + position];
+        }
+        uint16_t GetDeparture(size_t position) const
+        {
+            return timetable_->departures_[firstCall_ + position];
+        }
+
+        // the arrival and departure minutes of each call, never going back - after midnight they carry on from 1440.
+        // The origin arrives when it departs and the destination departs when it arrives:
+        std::vector<std::pair<uint16_t, uint16_t>> GetCallTimes() const;
+
+        // as above into a buffer that can be reused from run to run:
+        void GetCallTimes(std::vector<std::pair<uint16_t, uint16_t>>& times) const;
+
+        const TrainUID& GetTrainUID() const
+        {
+            return timetable_->trainUIDs_[run_];
+        }
+        std::string GetTrainID() const
+        {
+            auto& id = timetable_->trainIDs_[run_];
+            return std::string(id.begin(), id.end());
+        }
+        char GetSTPIndicator() const
+        {
+            return timetable_->stpIndicators_[run_];
+        }
+        const RJISDate::Range& GetRunningDates() const
+        {
+            return timetable_->runningDates_[run_];
+        }
+        const RJISDate::Dayset& GetRunningDays() const
+        {
+            return timetable_->runningDays_[run_];
+        }
+        int GetLineNumber() const
+        {
+            return timetable_->lineNumbers_[run_];
+        }
+    };
+
+private:
+    // the runs:
+    std::vector<uint32_t> callOffsets_;         // the first call of each run - one more entry for the end
+    std::vector<TrainUID> trainUIDs_;
+    std::vector<TrainID> trainIDs_;
+    std::vector<char> stpIndicators_;
+    std::vector<RJISDate::Range> runningDates_;
+    std::vector<RJISDate::Dayset> runningDays_;
+    std::vector<int> lineNumbers_;              // of the BS record in the MCA file
+
+    // the calls:
+    std::vector<CRSCode> crs_;
+    std::vector<uint16_t> arrivals_;
+    std::vector<uint16_t> departures_;
+
+public:
+    Timetable() : callOffsets_(1, 0) {}
+
+    size_t GetRunCount() const
+    {
+        return callOffsets_.size() - 1;
+    }
+    size_t GetCallCount() const
+    {
+        return crs_.size();
+    }
+    RunView operator[](size_t run) const
+    {
+        return RunView(*this, static_cast<uint32_t>(run));
+    }
+
+    // add a run read from the MCA file:
+    void Add(const TTTypes::TrainRun& run);
+
+    // add the runs of parts of the MCA file read separately, in order - the runs of each part are numbered after
+    // those of the parts before it. The parts are copied in parallel and left empty:
+    void Append(std::vector<Timetable>& parts);
+
+    // free the spare capacity left by adding runs one at a time:
+    void ShrinkToFit();
+
+    size_t GetMemoryBytes() const;
+};
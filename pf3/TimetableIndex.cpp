@@ -0,0 +1,93 @@
+#include "stdafx.h"
+#include <numeric>
+#include "TimetableIndex.h"
+
+void TimetableIndex::Build(const Timetable& timetable)
+{
+    stations_.clear();
+    for (uint32_t runIndex = 0; runIndex < timetable.GetRunCount(); ++runIndex)
+    {
+        auto run = timetable[runIndex];
+        for (size_t i = 0; i < run.GetCallCount(); ++i)
+        {
+            stations_.push_back(run.GetCRS(i));
+        }
+    }
+    std::sort(stations_.begin(), stations_.end());
+    stations_.erase(std::unique(stations_.begin(), stations_.end()), stations_.end());
+    stations_.shrink_to_fit();
+
+    // 1. the station for every call and the number of departures and calls at each station. The last call of a run
+    // is not a departure:
+    std::vector<uint32_t> callStations;
+    departureOffsets_.assign(stations_.size() + 1, 0);
+    callOffsets_.assign(stations_.size() + 1, 0);
+    for (uint32_t runIndex = 0; runIndex < timetable.GetRunCount(); ++runIndex)
+    {
+        auto run = timetable[runIndex];
+        for (size_t i = 0; i < run.GetCallCount(); ++i)
+        {
+            auto station = static_cast<uint32_t>(FindStation(run.GetCRS(i)));
+            callStations.push_back(station);
+            ++callOffsets_[station + 1];
+            if (i + 1 < run.GetCallCount())
+            {
+                ++departureOffsets_[station + 1];
+            }
+        }
+    }
+    std::partial_sum(departureOffsets_.begin(), departureOffsets_.end(), departureOffsets_.begin());
+    std::partial_sum(callOffsets_.begin(), callOffsets_.end(), callOffsets_.begin());
+
+    // 2. place each call with its times from the start of the run's service day - taking the runs in order leaves the
+    // calls at each station in run and position order:
+    departures_.resize(departureOffsets_.back());
+    calls_.resize(callOffsets_.back());
+    std::vector<uint32_t> nextDeparture(departureOffsets_.begin(), departureOffsets_.end() - 1);
+    std::vector<uint32_t> nextCall(callOffsets_.begin(), callOffsets_.end() - 1);
+    size_t callIndex = 0;
+    for (uint32_t runIndex = 0; runIndex < timetable.GetRunCount(); ++runIndex)
+    {
+        auto times = timetable[runIndex].GetCallTimes();
+        for (size_t i = 0; i < times.size(); ++i)
+        {
+            auto station = callStations[callIndex++];
+            auto position = static_cast<uint16_t>(i);
+            calls_[nextCall[station]++] = Event{ times[i].first, position, runIndex };
+            if (i + 1 < times.size())
+            {
+                departures_[nextDeparture[station]++] = Event{ times[i].second, position, runIndex };
+            }
+        }
+    }
+
+    // 3. the departures from each station in time order:
+    for (size_t station = 0; station < stations_.size(); ++station)
+    {
+        std::sort(departures_.begin() + departureOffsets_[station], departures_.begin() + departureOffsets_[station + 1],
+            [](const Event& x, const Event& y) {return std::tie(x.minutes, x.run) < std::tie(y.minutes, y.run);});
+    }
+}
+
+size_t TimetableIndex::FindStation(const CRSCode& crs) const
+{
+    auto p = std::lower_bound(stations_.begin(), stations_.end(), crs);
+    return p != stations_.end() && *p == crs ? p - stations_.begin() : stations_.size();
+}
+
+const TimetableIndex::Event* TimetableIndex::FindLaterCall(size_t station, uint32_t run, uint16_t position) const
+{
+    auto first = calls_.begin() + callOffsets_[station];
+    auto last = calls_.begin() + callOffsets_[station + 1];
+    auto p = std::upper_bound(first, last, std::make_pair(run, position), [](const std::pair<uint32_t, uint16_t>& x, const Event& y) {
+        return x < std::make_pair(y.run, y.position);
+    });
+    return p != last && p->run == run ? &*p : nullptr;
+}
+
+size_t TimetableIndex::GetMemoryBytes() const
+{
+    return stations_.capacity() * sizeof(CRSCode) +
+        (departureOffsets_.capacity() + callOffsets_.capacity()) * sizeof(uint32_t) +
+        (departures_.capacity() + calls_.capacity()) * sizeof(Event);
+}
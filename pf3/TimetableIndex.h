@@ -0,0 +1,116 @@
+#pragma once
+#include "Timetable.h"
+
+// TimetableIndex - the calls at each station, arranged to answer "which trains go from A to B after time t" without
+// storing anything for a pair of stations. Its size is linear in the number of calls in the timetable: for each
+// station its departures in time order and its calls in train order. The trains from A to B are found by taking the
+// departures from A in time order and, for each, looking up a later call by the same train at B.
+//
+// The train runs themselves (see Timetable) are the stop sequence for each train - a position in the index is the
+// position of a call in its run.
+class TimetableIndex
+{
+public:
+    // a call by a train at a station. In the departures minutes is the departure time, in the calls it is the arrival
+    // time - both from the start of the run's service day, so past 1440 after midnight:
+    struct Event
+    {
+        uint16_t minutes;
+        uint16_t position;
+        uint32_t run;
+    };
+
+private:
+    std::vector<CRSCode> stations_;                 // sorted
+    std::vector<uint32_t> departureOffsets_;        // for each station, its first departure - one more entry for the end
+    std::vector<uint32_t> callOffsets_;             // for each station, its first call - one more entry for the end
+    std::vector<Event> departures_;                 // by station then departure time - a station's departures are
+                                                    // found by binary search
+    std::vector<Event> calls_;                      // by station then train run then position
+
+    // the first call by a run at a station after a given position - null if there is none:
+    const Event* FindLaterCall(size_t station, uint32_t run, uint16_t position) const;
+
+public:
+    // stations are numbered from 0 in CRS order - other timetable indexes use the same numbers (see RaptorPlanner):
+    size_t GetStationCount() const
+    {
+        return stations_.size();
+    }
+    const CRSCode& GetStation(size_t station) const
+    {
+        return stations_[station];
+    }
+
+    // the number of a station - GetStationCount() if no train calls there:
+    size_t FindStation(const CRSCode& crs) const;
+
+    // build the index for the timetable - the indexes of the runs must not change afterwards:
+    void Build(const Timetable& timetable);
+
+    // call f for each departure from a station in a window of a service day - at or after fromMinutes and before
+    // toMinutes, which may be up to a day later. The times of a run go on past 1440 after midnight (see
+    // Timetable::RunView::GetCallTimes), so the window takes departures from the runs of three service days: the day
+    // before (day -1 - its runs still going after midnight), the day itself (0) and, for a window past midnight, the
+    // next day (1). Each is a binary search and a walk along the station's departures. f is given the departure and
+    // its day, in time order - the time on the service day of the window is event.minutes + 1440 * day. f returns
+    // false to stop:
+    template <class F> void ForEachDeparture(size_t station, uint16_t fromMinutes, uint16_t toMinutes, F f) const
+    {
+        auto first = departures_.begin() + departureOffsets_[station];
+        auto last = departures_.begin() + departureOffsets_[station + 1];
+        auto lower = [first, last](int minutes) {
+            return std::lower_bound(first, last, minutes, [](const Event& event, int minutes) {return event.minutes < minutes;});
+        };
+        std::vector<Event>::const_iterator begins[3], ends[3];
+        for (int day = -1; day <= 1; ++day)
+        {
+            begins[day + 1] = lower(fromMinutes - 1440 * day);
+            ends[day + 1] = lower(toMinutes - 1440 * day);
+        }
+
+        // merge the departures of the three days:
+        for (;;)
+        {
+            int next = -1;
+            for (int i = 0; i < 3; ++i)
+            {
+                if (begins[i] != ends[i] && (next < 0 || begins[i]->minutes + 1440 * i < begins[next]->minutes + 1440 * next))
+                {
+                    next = i;
+                }
+            }
+            if (next < 0 || !f(*begins[next], next - 1))
+            {
+                break;
+            }
+            ++begins[next];
+        }
+    }
+
+    // call f for each train from origin to destination departing in a window of a service day (see
+    // ForEachDeparture), in departure time order. f is given a MinutesIndex with the departure time from the origin on
+    // the service day of the window, the train run and the positions of the origin and destination calls in the run,
+    // and the day of the run (-1, 0 or 1). f returns false to stop:
+    template <class F> void ForEachLeg(const CRSCode& origin, const CRSCode& destination, uint16_t fromMinutes, uint16_t toMinutes, F f) const
+    {
+        auto originStation = FindStation(origin);
+        auto destinationStation = FindStation(destination);
+        if (originStation == stations_.size() || destinationStation == stations_.size())
+        {
+            return;
+        }
+        ForEachDeparture(originStation, fromMinutes, toMinutes, [&](const Event& departure, int day) {
+            auto call = FindLaterCall(destinationStation, departure.run, departure.position);
+            auto minutes = static_cast<uint16_t>(departure.minutes + 1440 * day);
+            return call == nullptr || f(TTTypes::MinutesIndex(minutes, departure.run, departure.position, call->position), day);
+        });
+    }
+
+    // the number of departures and calls indexed and the memory they use:
+    size_t GetEventCount() const
+    {
+        return departures_.size() + calls_.size();
+    }
+    size_t GetMemoryBytes() const;
+};
@@ -1,9 +1,16 @@
 #include "stdafx.h"
 #include "TiplocToNLC.h"
 
-// turn off optimisation - VS2015 has huge problems optimising code with big static maps:
-#pragma optimize( "", off )
-std::map<std::string, std::string> tiplocToCRSMap =
+namespace {
+
+struct TiplocEntry
+{
+    const char* tiploc;
+    const char* crs;
+};
+
+// the TIPLOC of each station and its CRS code - a TIPLOC must be listed once only:
+constexpr TiplocEntry tiplocToCRS[] =
 {
     { "ALEXNDP", "AAP" },
     { "ACHANLT", "AAT" },
@@ -3793,28 +3800,183 @@ std::map<std::string, std::string> tiplocToCRSMap =
     { "WHAMLT", "ZWZ" }
 };
 
+const size_t entryCount = sizeof(tiplocToCRS) / sizeof(tiplocToCRS[0]);
 
-std::string GetCRS(std::string tiploc)
+// a TIPLOC as an integer - its eight characters with spaces after the end of the string:
+constexpr uint64_t PackTiploc(const char* tiploc)
 {
-    std::string result;
-    auto p = tiplocToCRSMap.find(tiploc);
-    if (p == tiplocToCRSMap.end())
+    uint64_t result = 0;
+    bool ended = false;
+    for (int i = 0; i < 8; ++i)
     {
-        result = "";
+        ended = ended || tiploc[i] == '\0';
+        result = result << 8 | static_cast<uint8_t>(ended ? ' ' : tiploc[i]);
     }
-    else
+    return result;
+}
+
+constexpr uint64_t Mix(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// TiplocTable - a perfect hash table of the TIPLOCs made by the compiler, so there is nothing to build at startup.
+// The hash of a TIPLOC picks its bucket, and the displacement of the bucket then picks its slot. The buckets are
+// placed largest first, each with the first displacement that puts all of its TIPLOCs in empty slots - every TIPLOC
+// ends up with a slot of its own and a lookup is two hashes and one comparison. Building the table at compile time
+// takes more steps than MSVC allows by default, so this file is compiled with /constexpr:steps (see pf3.vcxproj):
+struct TiplocTable
+{
+    static const int bucketBits = 10;
+    static const int slotBits = 13;             // about twice as many slots as TIPLOCs
+    static const size_t bucketCount = size_t(1) << bucketBits;
+    static const size_t slotCount = size_t(1) << slotBits;
+
+    struct Slot
     {
-        result = tiplocToCRSMap.at(tiploc);
+        uint64_t tiploc;                        // 0 for an empty slot
+        char crs[4];
+    };
+
+    uint16_t displacements[bucketCount];
+    Slot slots[slotCount];
+    bool complete;                              // every TIPLOC has a slot
+
+    static constexpr size_t GetBucket(uint64_t tiploc)
+    {
+        return static_cast<size_t>(Mix(tiploc) >> (64 - bucketBits));
     }
-    return result;
+    static constexpr size_t GetSlot(uint64_t tiploc, uint32_t displacement)
+    {
+        return static_cast<size_t>(Mix(tiploc ^ displacement * 0x9e3779b97f4a7c15ULL) & (slotCount - 1));
+    }
+};
+
+constexpr TiplocTable MakeTiplocTable()
+{
+    TiplocTable table{};
+    table.complete = true;
+
+    // the entries in each bucket, in the order they are listed:
+    uint64_t keys[entryCount] = {};
+    size_t bucketOffsets[TiplocTable::bucketCount + 1] = {};
+    for (size_t i = 0; i < entryCount; ++i)
+    {
+        keys[i] = PackTiploc(tiplocToCRS[i].tiploc);
+        ++bucketOffsets[TiplocTable::GetBucket(keys[i]) + 1];
+    }
+    size_t largest = 0;
+    for (size_t bucket = 0; bucket < TiplocTable::bucketCount; ++bucket)
+    {
+        largest = bucketOffsets[bucket + 1] > largest ? bucketOffsets[bucket + 1] : largest;
+        bucketOffsets[bucket + 1] += bucketOffsets[bucket];
+    }
+    size_t next[TiplocTable::bucketCount] = {};
+    for (size_t bucket = 0; bucket < TiplocTable::bucketCount; ++bucket)
+    {
+        next[bucket] = bucketOffsets[bucket];
+    }
+    size_t members[entryCount] = {};
+    for (size_t i = 0; i < entryCount; ++i)
+    {
+        members[next[TiplocTable::GetBucket(keys[i])]++] = i;
+    }
+
+    for (size_t size = largest; size > 0; --size)
+    {
+        for (size_t bucket = 0; bucket < TiplocTable::bucketCount; ++bucket)
+        {
+            size_t first = bucketOffsets[bucket], last = bucketOffsets[bucket + 1];
+            if (last - first != size)
+            {
+                continue;
+            }
+            bool placed = false;
+            for (uint32_t displacement = 0; displacement < 0x10000 && !placed; ++displacement)
+            {
+                // each TIPLOC of the bucket needs an empty slot and a different slot from the others:
+                placed = true;
+                for (size_t j = first; j < last && placed; ++j)
+                {
+                    size_t slot = TiplocTable::GetSlot(keys[members[j]], displacement);
+                    placed = table.slots[slot].tiploc == 0;
+                    for (size_t k = first; k < j && placed; ++k)
+                    {
+                        placed = TiplocTable::GetSlot(keys[members[k]], displacement) != slot;
+                    }
+                }
+                if (placed)
+                {
+                    table.displacements[bucket] = static_cast<uint16_t>(displacement);
+                    for (size_t j = first; j < last; ++j)
+                    {
+                        auto& slot = table.slots[TiplocTable::GetSlot(keys[members[j]], displacement)];
+                        slot.tiploc = keys[members[j]];
+                        for (int c = 0; c < 3; ++c)
+                        {
+                            slot.crs[c] = tiplocToCRS[members[j]].crs[c];
+                        }
+                    }
+                }
+            }
+            table.complete = table.complete && placed;
+        }
+    }
+    return table;
 }
 
-void GetCRSSet(std::set<std::string>& crsset)
+constexpr TiplocTable tiplocTable = MakeTiplocTable();
+static_assert(tiplocTable.complete, "cannot place every TIPLOC in the hash table - is a TIPLOC listed twice?");
+
+const char* FindCRS(uint64_t tiploc)
 {
-    for (auto p : tiplocToCRSMap)
+    auto& slot = tiplocTable.slots[TiplocTable::GetSlot(tiploc, tiplocTable.displacements[TiplocTable::GetBucket(tiploc)])];
+    return slot.tiploc == tiploc ? slot.crs : "";
+}
+
+}
+
+const char* GetCRS(const char* tiploc, const TiplocUpdates& updates)
+{
+    auto key = PackTiploc(tiploc);
+    if (!updates.crs_.empty())
+    {
+        auto p = updates.crs_.find(key);
+        if (p != updates.crs_.end())
+        {
+            return p->second.data();
+        }
+    }
+    return FindCRS(key);
+}
+
+void GetCRSSet(std::set<std::string>& crsset, const TiplocUpdates& updates)
+{
+    for (auto& entry : tiplocToCRS)
     {
-        crsset.insert(p.second);
+        crsset.insert(entry.crs);
+    }
+    for (auto& update : updates.crs_)
+    {
+        crsset.insert(update.second.data());
     }
 }
 
-#pragma optimize( "", on )
\ No newline at end of file
+TiplocUpdates::TiplocUpdates(const std::map<std::string, CRSCode>& updates)
+{
+    for (auto& update : updates)
+    {
+        auto crs = update.second.GetString();
+        if (update.first.length() <= 7 && crs.length() == 3)
+        {
+            auto key = PackTiploc(update.first.c_str());
+            if (crs != FindCRS(key))
+            {
+                std::array<char, 4> value = { crs[0], crs[1], crs[2], '\0' };
+                crs_[key] = value;
+            }
+        }
+    }
+}
@@ -1,5 +1,29 @@
 #pragma once
 
-std::string GetCRS(std::string tiploc);
-void GetCRSSet(std::set<std::string>& crsset);
+// TiplocUpdates - TIPLOCs added or changed by the IDMS station reference data (see ReadIDMS). They are made before a
+// timetable is read and kept in the dataset it is read into, so a reload makes new updates rather than changing the
+// ones a dataset being read or in use was made with:
+class TiplocUpdates
+{
+    std::map<uint64_t, std::array<char, 4>> crs_;       // by packed TIPLOC - only where it differs from the table
+    friend const char* GetCRS(const char* tiploc, const TiplocUpdates& updates);
+    friend void GetCRSSet(std::set<std::string>& crsset, const TiplocUpdates& updates);
+public:
+    TiplocUpdates() = default;
+    explicit TiplocUpdates(const std::map<std::string, CRSCode>& updates);
 
+    bool operator==(const TiplocUpdates& other) const
+    {
+        return crs_ == other.crs_;
+    }
+    bool operator!=(const TiplocUpdates& other) const
+    {
+        return !(*this == other);
+    }
+};
+
+// the CRS code of the station at a TIPLOC - an empty string if the TIPLOC is not a station. The TIPLOC is up to eight
+// characters, either ending in a zero or padded with spaces (the field of a timetable location record can be passed
+// as it is):
+const char* GetCRS(const char* tiploc, const TiplocUpdates& updates);
+void GetCRSSet(std::set<std::string>& crsset, const TiplocUpdates& updates);
@@ -0,0 +1,89 @@
+#pragma once
+#include "RJISTypes.h"
+#include "FareKernel.h"
+
+// the fields of a ticket type (.TTY) record needed to price a fare. The full record (with its description
+// strings) is still available through full_ for anything else:
+struct TicketTypeHot
+{
+    RJISDate::Triple seqDates_;
+    int ticketClass_;                           // 1, 2 or 9
+    char ticketType_;                           // S, R or N (single, return or season)
+    DiscountCategory discountCategory_;
+    uint8_t categoryIndex_;                     // index of the discount category in a FareKernel::PercentageTable
+    const RJISTypes::TicketTypeValue* full_;
+
+    explicit TicketTypeHot(const RJISTypes::TicketTypeValue& value) :
+        seqDates_(value.seqDates_),
+        ticketClass_(value.ticketClass_),
+        ticketType_(value.ticketType_),
+        discountCategory_(value.discountCategory_),
+        categoryIndex_(FareKernel::GetCategoryIndex(value.discountCategory_)),
+        full_(&value)
+    {}
+};
+
+// the fields of a railcard (.RLC) record needed to price a fare:
+struct RailcardHot
+{
+    RJISDate::Triple seqDates_;
+    StatusCode adultStatus_;
+    StatusCode childStatus_;
+    const RJISTypes::RailcardValue* full_;
+
+    explicit RailcardHot(const RJISTypes::RailcardValue& value) :
+        seqDates_(value.seqDates_),
+        adultStatus_(value.adultStatus_),
+        childStatus_(value.childStatus_),
+        full_(&value)
+    {}
+};
+
+// ValidityIndex - the records for each code (ticket code or railcard code) held as contiguous date bands of "hot"
+// fields. Codes are sorted so finding a code is a binary search, and the bands for a code are kept in the same order
+// as in the multimap they are built from so that the first band valid for the query and travel dates is the same record
+// the multimap search would have found. Hot must have a seqDates_ member and a constructor taking the multimap value.
+template <class Code, class Hot> class ValidityIndex
+{
+    std::vector<Code> codes_;                               // sorted
+    std::vector<std::pair<uint32_t, uint32_t>> ranges_;     // for each code - first band and number of bands
+    std::vector<Hot> bands_;
+
+public:
+    // the full records are pointed to by the index so the multimap must not change after the index is built:
+    template <class Value> void Build(const std::multimap<Code, Value>& records)
+    {
+        codes_.clear();
+        ranges_.clear();
+        bands_.clear();
+        bands_.reserve(records.size());
+        for (auto& record : records)
+        {
+            if (codes_.empty() || codes_.back() != record.first)
+            {
+                codes_.push_back(record.first);
+                ranges_.push_back(std::make_pair(static_cast<uint32_t>(bands_.size()), 0u));
+            }
+            bands_.emplace_back(record.second);
+            ranges_.back().second++;
+        }
+    }
+
+    // return the entry for the code valid on the dates given or nullptr if there is none:
+    const Hot* Find(const Code& code, const RJISDate::Date& queryDate, const RJISDate::Date& travelDate) const
+    {
+        auto p = std::lower_bound(codes_.begin(), codes_.end(), code);
+        if (p != codes_.end() && *p == code)
+        {
+            auto& range = ranges_[p - codes_.begin()];
+            for (uint32_t i = range.first; i < range.first + range.second; ++i)
+            {
+                if (bands_[i].seqDates_.AreDatesValid(queryDate, travelDate))
+                {
+                    return &bands_[i];
+                }
+            }
+        }
+        return nullptr;
+    }
+};
@@ -0,0 +1,135 @@
+#include "stdafx.h"
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool()
+{
+    InitializeSRWLock(&lock_);
+    InitializeConditionVariable(&jobAvailable_);
+    InitializeConditionVariable(&chunkFinished_);
+
+    SYSTEM_INFO sysinfo;
+    GetSystemInfo(&sysinfo);
+
+    // start as many threads as there are CPUs (i.e. cores). The threads run for the life of the process:
+    for (auto i = 0u; i < sysinfo.dwNumberOfProcessors; ++i)
+    {
+        threads_.push_back(AThread(WorkerThread, 0, this, false));
+    }
+}
+
+// hand out the next chunk of a job. Once the last chunk is handed out the job is removed from the list of jobs
+// so that no more workers pick it up:
+bool WorkerPool::ClaimChunk(Job& job, size_t& chunk)
+{
+    if (job.next_ >= job.count_)
+    {
+        return false;
+    }
+    chunk = job.next_++;
+    job.running_++;
+    if (job.next_ == job.count_)
+    {
+        auto p = std::find(jobs_.begin(), jobs_.end(), &job);
+        if (p != jobs_.end())
+        {
+            jobs_.erase(p);
+        }
+    }
+    return true;
+}
+
+void WorkerPool::FinishChunk(Job& job, std::exception_ptr exception)
+{
+    if (exception && !job.exception_)
+    {
+        job.exception_ = exception;
+    }
+    job.running_--;
+    if (job.next_ == job.count_ && job.running_ == 0)
+    {
+        WakeAllConditionVariable(&chunkFinished_);
+    }
+}
+
+void WorkerPool::ParallelFor(size_t count, const std::function<void(size_t)>& func)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    Job job;
+    job.func_ = &func;
+    job.count_ = count;
+
+    AcquireSRWLockExclusive(&lock_);
+    if (count > 1)
+    {
+        jobs_.push_back(&job);
+        WakeAllConditionVariable(&jobAvailable_);
+    }
+
+    // run chunks on this thread as well - the job cannot finish until we have run out of chunks to claim:
+    size_t chunk;
+    while (ClaimChunk(job, chunk))
+    {
+        ReleaseSRWLockExclusive(&lock_);
+        std::exception_ptr exception;
+        try
+        {
+            func(chunk);
+        }
+        catch (...)
+        {
+            exception = std::current_exception();
+        }
+        AcquireSRWLockExclusive(&lock_);
+        FinishChunk(job, exception);
+    }
+
+    // wait for chunks still running on the workers:
+    while (job.running_ > 0)
+    {
+        SleepConditionVariableSRW(&chunkFinished_, &lock_, INFINITE, 0);
+    }
+    ReleaseSRWLockExclusive(&lock_);
+
+    if (job.exception_)
+    {
+        std::rethrow_exception(job.exception_);
+    }
+}
+
+/* static - the thread function: */
+unsigned WINAPI WorkerPool::WorkerThread(void *p)
+{
+    WorkerPool& pool = *static_cast<WorkerPool*>(p);
+    AcquireSRWLockExclusive(&pool.lock_);
+    for (;;)
+    {
+        while (pool.jobs_.empty())
+        {
+            SleepConditionVariableSRW(&pool.jobAvailable_, &pool.lock_, INFINITE, 0);
+        }
+
+        // take a chunk from the oldest job. The job cannot go away while we have a chunk running:
+        Job& job = *pool.jobs_.front();
+        size_t chunk;
+        if (pool.ClaimChunk(job, chunk))
+        {
+            ReleaseSRWLockExclusive(&pool.lock_);
+            std::exception_ptr exception;
+            try
+            {
+                (*job.func_)(chunk);
+            }
+            catch (...)
+            {
+                exception = std::current_exception();
+            }
+            AcquireSRWLockExclusive(&pool.lock_);
+            pool.FinishChunk(job, exception);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <ams/AThread.h>
+
+// WorkerPool - a pool of threads (one per CPU) shared by all the request handler threads. A request splits a big piece
+// of work into chunks with ParallelFor - the chunks of every request in progress are available to all workers, so an
+// idle worker takes chunks from whichever request still has some. The requesting thread runs chunks of its own job
+// too so a job always makes progress even when every worker is busy with other requests.
+class WorkerPool
+{
+    struct Job
+    {
+        const std::function<void(size_t)>* func_;
+        size_t count_;                  // number of chunks
+        size_t next_ = 0;               // next chunk to hand out
+        size_t running_ = 0;            // chunks handed out but not yet finished
+        std::exception_ptr exception_;  // the first exception thrown by a chunk
+    };
+
+    SRWLOCK lock_;
+    CONDITION_VARIABLE jobAvailable_;
+    CONDITION_VARIABLE chunkFinished_;
+    std::deque<Job*> jobs_;             // jobs with chunks still to hand out - oldest first
+    std::deque<AThread> threads_;
+
+    WorkerPool();
+    WorkerPool(WorkerPool&) = delete;
+
+    // both must be called with the lock held:
+    bool ClaimChunk(Job& job, size_t& chunk);
+    void FinishChunk(Job& job, std::exception_ptr exception);
+
+    static unsigned WINAPI WorkerThread(void *p);
+
+public:
+    static WorkerPool& GetInstance()
+    {
+        static WorkerPool instance;
+        return instance;
+    }
+
+    size_t GetThreadCount() const { return threads_.size(); }
+
+    // call func(i) for every i in [0, count) using the pool and the calling thread. The calling thread always runs
+    // chunk 0. Returns when every chunk has finished. If any chunk throws, the first exception is rethrown here once
+    // all chunks have finished:
+    void ParallelFor(size_t count, const std::function<void(size_t)>& func);
+
+    virtual ~WorkerPool() {}
+};
@@ -0,0 +1,1108 @@
+#include "stdafx.h"
+#include <exception>
+#include <ams/AThread.h>
+#include <ams/debugutils.h>
+#include <ams/stringutils.h>
+#include "ZipArchive.h"
+
+namespace {
+
+const uint32_t endOfCentralDirectorySignature = 0x06054b50;
+const uint32_t centralDirectorySignature = 0x02014b50;
+const uint32_t localHeaderSignature = 0x04034b50;
+
+// the size of the blocks passed from the inflating thread to the thread processing the lines and the number of
+// blocks that can be waiting:
+const size_t blockSize = 1 << 20;
+const size_t queuedBlocks = 4;
+
+// zip files are little-endian:
+inline uint16_t Get16(const uint8_t* p)
+{
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+inline uint32_t Get32(const uint8_t* p)
+{
+    return Get16(p) | (static_cast<uint32_t>(Get16(p + 2)) << 16);
+}
+
+uint32_t UpdateCRC(uint32_t crc, const uint8_t* p, size_t n)
+{
+    static const auto table = [] {
+        std::array<uint32_t, 256> result;
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k)
+            {
+                c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            }
+            result[i] = c;
+        }
+        return result;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < n; ++i)
+    {
+        crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// Inflater - decode a deflate stream (RFC 1951). The output is passed to a function in blocks as it is produced. The
+// last 32K of output is kept for back references. Huffman codes of up to fastBits bits are decoded by table lookup,
+// longer ones a bit at a time:
+class Inflater
+{
+    static const int maxBits = 15;
+    static const int fastBits = 9;
+    static const size_t windowSize = 32768;
+
+    struct Huffman
+    {
+        std::array<uint16_t, maxBits + 1> count;        // the number of codes of each length
+        std::array<uint16_t, 288> symbol;               // the symbols in code order
+        std::array<uint16_t, 1 << fastBits> fast;       // (length << fastBits) | symbol by the next fastBits bits -
+                                                        // zero if the code is longer than fastBits
+    };
+
+    const uint8_t* in_;
+    size_t inSize_;
+    size_t inPos_ = 0;
+    uint64_t bitBuffer_ = 0;
+    int bitCount_ = 0;
+
+    std::vector<uint8_t> out_;
+    size_t outPos_ = 0;
+    size_t flushed_ = 0;        // output before this has been passed on
+    std::function<void(const uint8_t*, size_t)> output_;
+
+    static int Reverse(int code, int length)
+    {
+        int result = 0;
+        for (int i = 0; i < length; ++i)
+        {
+            result = (result << 1) | (code & 1);
+            code >>= 1;
+        }
+        return result;
+    }
+
+    static void Build(Huffman& h, const uint8_t* lengths, int n)
+    {
+        h.count.fill(0);
+        for (int i = 0; i < n; ++i)
+        {
+            h.count[lengths[i]]++;
+        }
+        h.count[0] = 0;
+
+        // an incomplete code is allowed (a distance code may have a single code) but not an over-subscribed one:
+        int left = 1;
+        for (int length = 1; length <= maxBits; ++length)
+        {
+            left = (left << 1) - h.count[length];
+            if (left < 0)
+            {
+                throw QException("Invalid deflate code lengths");
+            }
+        }
+
+        std::array<uint16_t, maxBits + 2> offsets;
+        offsets[1] = 0;
+        for (int length = 1; length <= maxBits; ++length)
+        {
+            offsets[length + 1] = offsets[length] + h.count[length];
+        }
+        for (int i = 0; i < n; ++i)
+        {
+            if (lengths[i] != 0)
+            {
+                h.symbol[offsets[lengths[i]]++] = static_cast<uint16_t>(i);
+            }
+        }
+
+        // codes are canonical - consecutive within a length, in symbol order. The bits of a code are read most
+        // significant first so the lookup index is the code reversed:
+        h.fast.fill(0);
+        int code = 0;
+        int index = 0;
+        for (int length = 1; length <= fastBits; ++length)
+        {
+            for (int k = 0; k < h.count[length]; ++k, ++code, ++index)
+            {
+                for (int j = Reverse(code, length); j < (1 << fastBits); j += 1 << length)
+                {
+                    h.fast[j] = static_cast<uint16_t>((length << fastBits) | h.symbol[index]);
+                }
+            }
+            code <<= 1;
+        }
+    }
+
+    static const Huffman& GetFixedLiteralCode()
+    {
+        static const Huffman result = [] {
+            std::array<uint8_t, 288> lengths;
+            std::fill(lengths.begin(), lengths.begin() + 144, 8);
+            std::fill(lengths.begin() + 144, lengths.begin() + 256, 9);
+            std::fill(lengths.begin() + 256, lengths.begin() + 280, 7);
+            std::fill(lengths.begin() + 280, lengths.end(), 8);
+            Huffman h;
+            Build(h, lengths.data(), 288);
+            return h;
+        }();
+        return result;
+    }
+
+    static const Huffman& GetFixedDistanceCode()
+    {
+        static const Huffman result = [] {
+            std::array<uint8_t, 30> lengths;
+            lengths.fill(5);
+            Huffman h;
+            Build(h, lengths.data(), 30);
+            return h;
+        }();
+        return result;
+    }
+
+    void Refill()
+    {
+        while (bitCount_ <= 56 && inPos_ < inSize_)
+        {
+            bitBuffer_ |= static_cast<uint64_t>(in_[inPos_++]) << bitCount_;
+            bitCount_ += 8;
+        }
+    }
+
+    uint32_t GetBits(int n)
+    {
+        if (bitCount_ < n)
+        {
+            Refill();
+            if (bitCount_ < n)
+            {
+                throw QException("Deflate stream is truncated");
+            }
+        }
+        uint32_t result = static_cast<uint32_t>(bitBuffer_ & ((1ull << n) - 1));
+        bitBuffer_ >>= n;
+        bitCount_ -= n;
+        return result;
+    }
+
+    int Decode(const Huffman& h)
+    {
+        if (bitCount_ < maxBits)
+        {
+            Refill();
+        }
+        int entry = h.fast[bitBuffer_ & ((1 << fastBits) - 1)];
+        int length = entry >> fastBits;
+        if (entry != 0 && length <= bitCount_)
+        {
+            bitBuffer_ >>= length;
+            bitCount_ -= length;
+            return entry & ((1 << fastBits) - 1);
+        }
+
+        // a long code - first is the first code of each length and index the position of its symbol:
+        int code = 0;
+        int first = 0;
+        int index = 0;
+        for (length = 1; length <= maxBits; ++length)
+        {
+            code |= GetBits(1);
+            int count = h.count[length];
+            if (code - count < first)
+            {
+                return h.symbol[index + (code - first)];
+            }
+            index += count;
+            first = (first + count) << 1;
+            code <<= 1;
+        }
+        throw QException("Invalid deflate code");
+    }
+
+    // pass on the output not yet passed on:
+    void Emit()
+    {
+        if (outPos_ > flushed_)
+        {
+            output_(out_.data() + flushed_, outPos_ - flushed_);
+        }
+        flushed_ = outPos_;
+    }
+
+    // make room in a full output buffer, keeping the window:
+    void Slide()
+    {
+        Emit();
+        std::memmove(out_.data(), out_.data() + outPos_ - windowSize, windowSize);
+        outPos_ = flushed_ = windowSize;
+    }
+
+    void Put(uint8_t c)
+    {
+        if (outPos_ == out_.size())
+        {
+            Slide();
+        }
+        out_[outPos_++] = c;
+    }
+
+    void Copy(size_t distance, size_t length)
+    {
+        if (distance > outPos_)
+        {
+            throw QException("Invalid deflate distance");
+        }
+        while (length > 0)
+        {
+            if (outPos_ == out_.size())
+            {
+                Slide();
+            }
+            size_t n = std::min(length, out_.size() - outPos_);
+            if (distance >= n)
+            {
+                std::memcpy(out_.data() + outPos_, out_.data() + outPos_ - distance, n);
+            }
+            else
+            {
+                // the copy overlaps itself so repeats the last distance bytes:
+                for (size_t i = 0; i < n; ++i)
+                {
+                    out_[outPos_ + i] = out_[outPos_ + i - distance];
+                }
+            }
+            outPos_ += n;
+            length -= n;
+        }
+    }
+
+    void Stored()
+    {
+        // a stored block starts on a byte boundary:
+        GetBits(bitCount_ % 8);
+        uint32_t length = GetBits(16);
+        if (GetBits(16) != (~length & 0xFFFF))
+        {
+            throw QException("Invalid deflate stored block length");
+        }
+        // take any bytes already in the bit buffer then copy straight from the input:
+        while (length > 0 && bitCount_ >= 8)
+        {
+            Put(static_cast<uint8_t>(GetBits(8)));
+            --length;
+        }
+        if (inSize_ - inPos_ < length)
+        {
+            throw QException("Deflate stream is truncated");
+        }
+        while (length > 0)
+        {
+            if (outPos_ == out_.size())
+            {
+                Slide();
+            }
+            size_t n = std::min<size_t>(length, out_.size() - outPos_);
+            std::memcpy(out_.data() + outPos_, in_ + inPos_, n);
+            outPos_ += n;
+            inPos_ += n;
+            length -= static_cast<uint32_t>(n);
+        }
+    }
+
+    void Codes(const Huffman& literalCode, const Huffman& distanceCode)
+    {
+        static const uint16_t lengthBase[29] = {
+            3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+        static const uint8_t lengthExtra[29] = {
+            0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+        static const uint16_t distanceBase[30] = {
+            1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+            1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+        static const uint8_t distanceExtra[30] = {
+            0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+        for (;;)
+        {
+            int symbol = Decode(literalCode);
+            if (symbol < 256)
+            {
+                Put(static_cast<uint8_t>(symbol));
+            }
+            else if (symbol == 256)
+            {
+                return;
+            }
+            else
+            {
+                symbol -= 257;
+                if (symbol >= 29)
+                {
+                    throw QException("Invalid deflate length code");
+                }
+                size_t length = lengthBase[symbol] + GetBits(lengthExtra[symbol]);
+                symbol = Decode(distanceCode);
+                if (symbol >= 30)
+                {
+                    throw QException("Invalid deflate distance code");
+                }
+                size_t distance = distanceBase[symbol] + GetBits(distanceExtra[symbol]);
+                Copy(distance, length);
+            }
+        }
+    }
+
+    void Dynamic()
+    {
+        static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+        int literals = GetBits(5) + 257;
+        int distances = GetBits(5) + 1;
+        int codeLengthCodes = GetBits(4) + 4;
+        if (literals > 286 || distances > 30)
+        {
+            throw QException("Invalid deflate code counts");
+        }
+
+        std::array<uint8_t, 19> codeLengths{};
+        for (int i = 0; i < codeLengthCodes; ++i)
+        {
+            codeLengths[order[i]] = static_cast<uint8_t>(GetBits(3));
+        }
+        Huffman lengthCode;
+        Build(lengthCode, codeLengths.data(), 19);
+
+        // the literal/length and distance code lengths are one run-length coded sequence:
+        std::array<uint8_t, 286 + 30> lengths{};
+        int index = 0;
+        while (index < literals + distances)
+        {
+            int symbol = Decode(lengthCode);
+            if (symbol < 16)
+            {
+                lengths[index++] = static_cast<uint8_t>(symbol);
+            }
+            else
+            {
+                uint8_t length = 0;
+                int repeat;
+                if (symbol == 16)
+                {
+                    if (index == 0)
+                    {
+                        throw QException("Invalid deflate code length repeat");
+                    }
+                    length = lengths[index - 1];
+                    repeat = 3 + GetBits(2);
+                }
+                else if (symbol == 17)
+                {
+                    repeat = 3 + GetBits(3);
+                }
+                else
+                {
+                    repeat = 11 + GetBits(7);
+                }
+                if (index + repeat > literals + distances)
+                {
+                    throw QException("Invalid deflate code length repeat");
+                }
+                while (repeat-- > 0)
+                {
+                    lengths[index++] = length;
+                }
+            }
+        }
+        if (lengths[256] == 0)
+        {
+            throw QException("Deflate block has no end code");
+        }
+
+        Huffman literalCode, distanceCode;
+        Build(literalCode, lengths.data(), literals);
+        Build(distanceCode, lengths.data() + literals, distances);
+        Codes(literalCode, distanceCode);
+    }
+
+public:
+    Inflater(const uint8_t* in, size_t size, std::function<void(const uint8_t*, size_t)> output) :
+        in_(in), inSize_(size), out_(windowSize + blockSize), output_(output)
+    {
+    }
+
+    void Inflate()
+    {
+        bool last;
+        do
+        {
+            last = GetBits(1) != 0;
+            switch (GetBits(2))
+            {
+            case 0:
+                Stored();
+                break;
+            case 1:
+                Codes(GetFixedLiteralCode(), GetFixedDistanceCode());
+                break;
+            case 2:
+                Dynamic();
+                break;
+            default:
+                throw QException("Invalid deflate block type");
+            }
+        } while (!last);
+        Emit();
+    }
+};
+
+// BlockQueue - a bounded queue of blocks of inflated data passed from the inflating thread to the thread processing
+// the lines:
+class BlockQueue
+{
+    SRWLOCK lock_;
+    CONDITION_VARIABLE changed_;
+    std::deque<std::vector<char>> blocks_;
+    bool finished_ = false;             // the inflating thread will add no more blocks
+    bool cancelled_ = false;            // the reading thread has stopped - the inflating thread should stop too
+    std::exception_ptr exception_;      // why the inflating thread stopped
+public:
+    BlockQueue()
+    {
+        InitializeSRWLock(&lock_);
+        InitializeConditionVariable(&changed_);
+    }
+
+    // add a block, waiting while the queue is full. Returns false if the reader has stopped:
+    bool Add(std::vector<char>&& block)
+    {
+        AcquireSRWLockExclusive(&lock_);
+        while (blocks_.size() >= queuedBlocks && !cancelled_)
+        {
+            SleepConditionVariableSRW(&changed_, &lock_, INFINITE, 0);
+        }
+        bool result = !cancelled_;
+        if (result)
+        {
+            blocks_.push_back(std::move(block));
+        }
+        ReleaseSRWLockExclusive(&lock_);
+        WakeAllConditionVariable(&changed_);
+        return result;
+    }
+
+    void Finish(std::exception_ptr exception)
+    {
+        AcquireSRWLockExclusive(&lock_);
+        finished_ = true;
+        exception_ = exception;
+        ReleaseSRWLockExclusive(&lock_);
+        WakeAllConditionVariable(&changed_);
+    }
+
+    // get the next block, waiting while the queue is empty. Returns false after the last block - or rethrows the
+    // exception that stopped the inflating thread:
+    bool Remove(std::vector<char>& block)
+    {
+        AcquireSRWLockExclusive(&lock_);
+        while (blocks_.empty() && !finished_)
+        {
+            SleepConditionVariableSRW(&changed_, &lock_, INFINITE, 0);
+        }
+        bool result = !blocks_.empty();
+        if (result)
+        {
+            block = std::move(blocks_.front());
+            blocks_.pop_front();
+        }
+        auto exception = exception_;
+        ReleaseSRWLockExclusive(&lock_);
+        WakeAllConditionVariable(&changed_);
+        if (!result && exception)
+        {
+            std::rethrow_exception(exception);
+        }
+        return result;
+    }
+
+    void Cancel()
+    {
+        AcquireSRWLockExclusive(&lock_);
+        cancelled_ = true;
+        ReleaseSRWLockExclusive(&lock_);
+        WakeAllConditionVariable(&changed_);
+    }
+};
+
+struct InflateJob
+{
+    const uint8_t* data;
+    const ZipArchive::Member* member;
+    BlockQueue* queue;
+};
+
+struct InflateCancelled {};
+
+// inflate a deflated member, passing on the output in blocks, then check its size and CRC:
+void InflateMember(const uint8_t* data, const ZipArchive::Member& member, std::function<void(const uint8_t*, size_t)> output)
+{
+    uint32_t crc = 0;
+    uint64_t size = 0;
+    Inflater inflater(data, static_cast<size_t>(member.compressedSize), [&](const uint8_t* p, size_t n) {
+        crc = UpdateCRC(crc, p, n);
+        size += n;
+        output(p, n);
+    });
+    inflater.Inflate();
+    if (size != member.size || crc != member.crc)
+    {
+        throw QException("Zip member " + member.name + " is corrupt - the size or CRC does not match");
+    }
+}
+
+unsigned WINAPI InflateThread(void *p)
+{
+    auto& job = *static_cast<InflateJob*>(p);
+    try
+    {
+        InflateMember(job.data, *job.member, [&](const uint8_t* data, size_t n) {
+            if (!job.queue->Add(std::vector<char>(data, data + n)))
+            {
+                throw InflateCancelled();
+            }
+        });
+        job.queue->Finish(nullptr);
+    }
+    catch (InflateCancelled)
+    {
+        job.queue->Finish(nullptr);
+    }
+    catch (...)
+    {
+        job.queue->Finish(std::current_exception());
+    }
+    return 0;
+}
+
+// LineSplitter - split blocks of data into lines. A line may span blocks. Lines end with LF or CR LF:
+class LineSplitter
+{
+    std::string line_;
+    std::function<void(std::string)>& f_;
+public:
+    explicit LineSplitter(std::function<void(std::string)>& f) : f_(f) {}
+
+    void Add(const char* p, size_t n)
+    {
+        const char* end = p + n;
+        while (p != end)
+        {
+            auto newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+            if (newline == nullptr)
+            {
+                line_.append(p, end);
+                return;
+            }
+            line_.append(p, newline);
+            Finish();
+            p = newline + 1;
+        }
+    }
+
+    // pass on the line so far:
+    void Finish()
+    {
+        if (!line_.empty() && line_.back() == '\r')
+        {
+            line_.pop_back();
+        }
+        f_(std::move(line_));
+        line_.clear();
+    }
+
+    bool IsEmpty() const
+    {
+        return line_.empty();
+    }
+};
+
+}
+
+ZipArchive::ZipArchive(const std::string& filename) : filename_(filename)
+{
+    file_ = CreateFile(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if (file_ == INVALID_HANDLE_VALUE)
+    {
+        DWORD error = GetLastError();
+        throw QException("Cannot open zip archive " + filename + " - Windows error was " + ams::GetWinErrorAsString(error));
+    }
+    try
+    {
+        LARGE_INTEGER size;
+        GetFileSizeEx(file_, &size);
+        size_ = size.QuadPart;
+        if (size_ > 0)
+        {
+            mapping_ = CreateFileMapping(file_, 0, PAGE_READONLY, 0, 0, 0);
+            base_ = mapping_ ? static_cast<const uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+            if (base_ == nullptr)
+            {
+                DWORD error = GetLastError();
+                throw QException("Cannot map zip archive " + filename + " - Windows error was " + ams::GetWinErrorAsString(error));
+            }
+        }
+        ReadCentralDirectory();
+    }
+    catch (...)
+    {
+        Close();
+        throw;
+    }
+}
+
+ZipArchive::~ZipArchive()
+{
+    Close();
+}
+
+void ZipArchive::Close()
+{
+    if (base_ != nullptr)
+    {
+        UnmapViewOfFile(base_);
+        base_ = nullptr;
+    }
+    if (mapping_ != nullptr)
+    {
+        CloseHandle(mapping_);
+        mapping_ = nullptr;
+    }
+    if (file_ != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(file_);
+        file_ = INVALID_HANDLE_VALUE;
+    }
+}
+
+void ZipArchive::ReadCentralDirectory()
+{
+    const size_t endRecordSize = 22;
+    const size_t maxCommentSize = 65535;
+    if (size_ < endRecordSize)
+    {
+        throw QException(filename_ + " is not a zip archive");
+    }
+
+    // the end of central directory record is at the end of the archive followed by a comment of up to 64K:
+    const uint8_t* end = nullptr;
+    for (uint64_t pos = size_ - endRecordSize; end == nullptr && size_ - pos <= endRecordSize + maxCommentSize; --pos)
+    {
+        if (Get32(base_ + pos) == endOfCentralDirectorySignature)
+        {
+            end = base_ + pos;
+        }
+        if (pos == 0)
+        {
+            break;
+        }
+    }
+    if (end == nullptr)
+    {
+        throw QException(filename_ + " is not a zip archive");
+    }
+
+    uint16_t count = Get16(end + 10);
+    uint32_t directorySize = Get32(end + 12);
+    uint32_t directoryOffset = Get32(end + 16);
+    if (count == 0xFFFF || directoryOffset == 0xFFFFFFFF)
+    {
+        throw QException("Zip archive " + filename_ + " is zip64 which is not supported");
+    }
+    if (static_cast<uint64_t>(directoryOffset) + directorySize > size_)
+    {
+        throw QException("Zip archive " + filename_ + " is corrupt");
+    }
+
+    const uint8_t* p = base_ + directoryOffset;
+    const uint8_t* directoryEnd = p + directorySize;
+    members_.reserve(count);
+    for (int i = 0; i < count; ++i)
+    {
+        const size_t headerSize = 46;
+        if (directoryEnd - p < static_cast<ptrdiff_t>(headerSize) || Get32(p) != centralDirectorySignature)
+        {
+            throw QException("Zip archive " + filename_ + " is corrupt");
+        }
+        Member member;
+        uint16_t flags = Get16(p + 8);
+        member.method = Get16(p + 10);
+        member.crc = Get32(p + 16);
+        member.compressedSize = Get32(p + 20);
+        member.size = Get32(p + 24);
+        uint16_t nameLength = Get16(p + 28);
+        uint16_t extraLength = Get16(p + 30);
+        uint16_t commentLength = Get16(p + 32);
+        member.headerOffset = Get32(p + 42);
+        if (directoryEnd - p < static_cast<ptrdiff_t>(headerSize + nameLength + extraLength + commentLength))
+        {
+            throw QException("Zip archive " + filename_ + " is corrupt");
+        }
+        member.name.assign(reinterpret_cast<const char*>(p + headerSize), nameLength);
+        bool zip64 = member.compressedSize == 0xFFFFFFFF || member.size == 0xFFFFFFFF || member.headerOffset == 0xFFFFFFFF;
+        member.supported = !(flags & 1) && !zip64 && (member.method == 0 || member.method == 8);
+        members_.push_back(member);
+        p += headerSize + nameLength + extraLength + commentLength;
+    }
+}
+
+const ZipArchive::Member* ZipArchive::FindMember(const std::string& name) const
+{
+    std::string upperName = name;
+    ams::MakeUpper(upperName);
+    for (auto& member : members_)
+    {
+        std::string upperMember = member.name;
+        ams::MakeUpper(upperMember);
+        if (upperMember == upperName)
+        {
+            return &member;
+        }
+    }
+    return nullptr;
+}
+
+const uint8_t* ZipArchive::GetMemberData(const Member& member) const
+{
+    const size_t headerSize = 30;
+    if (!member.supported)
+    {
+        throw QException("Zip member " + member.name + " in " + filename_ +
+            " cannot be read - only stored or deflated members without encryption or zip64 are supported");
+    }
+    if (member.headerOffset + headerSize > size_ || Get32(base_ + member.headerOffset) != localHeaderSignature)
+    {
+        throw QException("Zip archive " + filename_ + " is corrupt");
+    }
+    const uint8_t* header = base_ + member.headerOffset;
+    uint64_t dataOffset = member.headerOffset + headerSize + Get16(header + 26) + Get16(header + 28);
+    if (dataOffset + member.compressedSize > size_)
+    {
+        throw QException("Zip archive " + filename_ + " is corrupt");
+    }
+    return base_ + dataOffset;
+}
+
+void ZipArchive::ReadLines(const Member& member, std::function<void(std::string)> f) const
+{
+    const uint8_t* data = GetMemberData(member);
+    LineSplitter splitter(f);
+
+    if (member.method == 0)
+    {
+        if (UpdateCRC(0, data, static_cast<size_t>(member.size)) != member.crc)
+        {
+            throw QException("Zip member " + member.name + " is corrupt - the CRC does not match");
+        }
+        splitter.Add(reinterpret_cast<const char*>(data), static_cast<size_t>(member.size));
+    }
+    else
+    {
+        // inflate on another thread while we split and process the lines:
+        BlockQueue queue;
+        InflateJob job{ data, &member, &queue };
+        AThread inflateThread(InflateThread, 0, &job, false);
+        try
+        {
+            std::vector<char> block;
+            while (queue.Remove(block))
+            {
+                splitter.Add(block.data(), block.size());
+            }
+        }
+        catch (...)
+        {
+            queue.Cancel();
+            WaitForSingleObject(inflateThread, INFINITE);
+            throw;
+        }
+        WaitForSingleObject(inflateThread, INFINITE);
+    }
+
+    // the last line may not end with a newline:
+    if (!splitter.IsEmpty())
+    {
+        splitter.Finish();
+    }
+}
+
+/* static */
+uint64_t ZipArchive::ReadMemberLines(const std::string& path, std::function<void(std::string)> f)
+{
+    auto pos = path.find(memberSeparator);
+    std::string archiveName = path.substr(0, pos);
+    std::string memberName = path.substr(pos + 1);
+    ZipArchive archive(archiveName);
+    auto member = archive.FindMember(memberName);
+    if (member == nullptr)
+    {
+        throw QException("There is no member " + memberName + " in zip archive " + archiveName);
+    }
+    archive.ReadLines(*member, f);
+    return member->size;
+}
+
+namespace {
+
+// BitWriter - write a deflate stream for the self test. Huffman codes are written most significant bit first and
+// everything else least significant bit first:
+class BitWriter
+{
+    std::vector<uint8_t> bytes_;
+    uint32_t buffer_ = 0;
+    int count_ = 0;
+public:
+    void Put(uint32_t value, int n)
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            buffer_ |= ((value >> i) & 1) << count_;
+            if (++count_ == 8)
+            {
+                bytes_.push_back(static_cast<uint8_t>(buffer_));
+                buffer_ = 0;
+                count_ = 0;
+            }
+        }
+    }
+
+    void PutCode(uint32_t code, int n)
+    {
+        for (int i = n - 1; i >= 0; --i)
+        {
+            Put(code >> i, 1);
+        }
+    }
+
+    void Align()
+    {
+        if (count_ > 0)
+        {
+            Put(0, 8 - count_);
+        }
+    }
+
+    // a literal or length symbol in the fixed code:
+    void PutFixedSymbol(int symbol)
+    {
+        if (symbol < 144)
+        {
+            PutCode(0x30 + symbol, 8);
+        }
+        else if (symbol < 256)
+        {
+            PutCode(0x190 + symbol - 144, 9);
+        }
+        else if (symbol < 280)
+        {
+            PutCode(symbol - 256, 7);
+        }
+        else
+        {
+            PutCode(0xC0 + symbol - 280, 8);
+        }
+    }
+
+    void PutStored(const uint8_t* p, uint32_t n, bool last)
+    {
+        Put(last, 1);
+        Put(0, 2);
+        Align();
+        Put(n, 16);
+        Put(~n, 16);
+        bytes_.insert(bytes_.end(), p, p + n);
+    }
+
+    std::vector<uint8_t> Finish()
+    {
+        Align();
+        return bytes_;
+    }
+};
+
+// a stored block, a fixed code block and a dynamic code block made by zlib (raw deflate):
+const uint8_t storedStream[] = {
+    0x01, 0x12, 0x00, 0xed, 0xff, 0x52, 0x4a, 0x49, 0x53, 0x20, 0x73, 0x74, 0x6f, 0x72, 0x65, 0x64, 0x20, 0x62, 0x6c,
+    0x6f, 0x63, 0x6b, 0x0a
+};
+const char storedText[] = "RJIS stored block\n";
+const uint32_t storedCRC = 0xf2f20f43;
+
+const uint8_t fixedStream[] = {
+    0x0b, 0x72, 0x33, 0x30, 0x30, 0x30, 0x54, 0x48, 0xcb, 0xac, 0x48, 0x4d, 0xc1, 0x42, 0x26, 0xe7, 0xa7, 0xa4, 0x16,
+    0x73, 0x01, 0x00
+};
+const char fixedText[] = "RF0001 fixed fixed fixed fixed codes\n";
+const uint32_t fixedCRC = 0x7ba7a826;
+
+// the text is the 12 lines made by GetDynamicText:
+const uint8_t dynamicStream[] = {
+    0x95, 0xd2, 0xcd, 0x0d, 0xc2, 0x30, 0x0c, 0x86, 0xe1, 0x3b, 0x53, 0x78, 0x84, 0xcf, 0x71, 0x7e, 0x9a, 0x35, 0xba,
+    0x41, 0x1a, 0x12, 0xb5, 0x82, 0x06, 0xa9, 0x80, 0x10, 0xdb, 0x93, 0x54, 0x2c, 0x60, 0x9f, 0x7c, 0x79, 0x2e, 0xaf,
+    0x3d, 0xe3, 0x3f, 0x74, 0xfd, 0xb6, 0xb4, 0x6f, 0x99, 0xd6, 0x77, 0xad, 0x7b, 0x6a, 0xb4, 0xdc, 0x1f, 0xf9, 0x46,
+    0x9f, 0xed, 0xb5, 0xd2, 0x92, 0xfa, 0x76, 0x94, 0x5a, 0x8e, 0xd2, 0x72, 0x79, 0x12, 0x2e, 0x73, 0x17, 0x01, 0x60,
+    0xd1, 0x30, 0x1e, 0x8c, 0x2d, 0x60, 0xbc, 0x86, 0x99, 0xc1, 0x0c, 0x03, 0x12, 0x35, 0x4c, 0x4e, 0x36, 0x01, 0xce,
+    0x68, 0x98, 0x1d, 0x4c, 0x1c, 0xe0, 0x9d, 0x3a, 0x89, 0x35, 0xbd, 0xca, 0xa4, 0x4e, 0x62, 0x23, 0x10, 0x59, 0x9d,
+    0xc4, 0x79, 0x30, 0xac, 0x3a, 0x89, 0x17, 0x30, 0x07, 0x75, 0x92, 0xf3, 0xda, 0xfa, 0x2f, 0x09, 0xa1, 0x5f, 0x5c,
+    0xf9, 0x25, 0x3f
+};
+const uint32_t dynamicCRC = 0xfc8e8630;
+
+std::vector<uint8_t> GetDynamicText()
+{
+    std::ostringstream oss;
+    oss << std::setfill('0');
+    for (int i = 0; i < 12; ++i)
+    {
+        oss << "R" << std::setw(4) << i * 7 << std::setw(4) << i * 13 << " dynamic huffman block with back references " <<
+            i % 5 << "\n";
+    }
+    auto text = oss.str();
+    return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+// a stream longer than the inflater's output buffer: stored blocks of pseudo-random bytes up to just short of the
+// point where the buffer slides then a fixed code block with copies across it - at the greatest distance, at
+// distances shorter than the copy and at distance 1. The expected output is made alongside:
+std::vector<uint8_t> MakeLongStream(std::vector<uint8_t>& expected)
+{
+    const size_t storedSize = blockSize + 32768 - 300;
+    uint32_t random = 12345;
+    expected.resize(storedSize);
+    for (auto& c : expected)
+    {
+        random = random * 1103515245 + 12345;
+        c = static_cast<uint8_t>(random >> 16);
+    }
+
+    BitWriter writer;
+    for (size_t pos = 0; pos < storedSize; pos += 65535)
+    {
+        writer.PutStored(expected.data() + pos, static_cast<uint32_t>(std::min<size_t>(65535, storedSize - pos)), false);
+    }
+
+    auto copy = [&](size_t distance, size_t length) {
+        for (size_t i = 0; i < length; ++i)
+        {
+            expected.push_back(expected[expected.size() - distance]);
+        }
+    };
+
+    writer.Put(1, 1);                       // the last block
+    writer.Put(1, 2);                       // fixed codes
+    writer.PutFixedSymbol(285);             // length 258
+    writer.PutCode(29, 5);                  // distance 24577 + 13 extra bits
+    writer.Put(32768 - 24577, 13);
+    copy(32768, 258);
+    writer.PutFixedSymbol(285);
+    writer.PutCode(5, 5);                   // distance 7 + 1 extra bit
+    writer.Put(0, 1);
+    copy(7, 258);
+    writer.PutFixedSymbol(264);             // length 10
+    writer.PutCode(0, 5);                   // distance 1
+    copy(1, 10);
+    writer.PutFixedSymbol('X');
+    expected.push_back('X');
+    writer.PutFixedSymbol(256);             // end of block
+    return writer.Finish();
+}
+
+}
+
+/* static */
+bool ZipArchive::SelfTest(std::ostream& os)
+{
+    auto inflate = [](const std::vector<uint8_t>& stream, uint32_t crc, uint64_t size) {
+        Member member{ "selftest", 8, crc, stream.size(), size, 0, true };
+        std::vector<uint8_t> result;
+        InflateMember(stream.data(), member, [&](const uint8_t* p, size_t n) {
+            result.insert(result.end(), p, p + n);
+        });
+        return result;
+    };
+
+    int errors = 0;
+    auto check = [&](const char* name, const std::vector<uint8_t>& stream, const std::vector<uint8_t>& expected,
+        uint32_t crc) {
+        try
+        {
+            if (inflate(stream, crc, expected.size()) != expected)
+            {
+                os << "Inflating the " << name << " gives the wrong output\n";
+                ++errors;
+            }
+        }
+        catch (std::exception& ex)
+        {
+            os << "Inflating the " << name << " failed: " << ex.what() << "\n";
+            ++errors;
+        }
+    };
+    auto checkRejected = [&](const char* name, const std::vector<uint8_t>& stream, uint32_t crc, uint64_t size) {
+        try
+        {
+            inflate(stream, crc, size);
+            os << "Inflating the " << name << " did not fail\n";
+            ++errors;
+        }
+        catch (QException&)
+        {
+        }
+    };
+
+    const std::vector<uint8_t> stored(std::begin(storedStream), std::end(storedStream));
+    const std::vector<uint8_t> storedOutput(storedText, storedText + sizeof storedText - 1);
+    check("stored block", stored, storedOutput, storedCRC);
+    check("fixed code block", std::vector<uint8_t>(std::begin(fixedStream), std::end(fixedStream)),
+        std::vector<uint8_t>(fixedText, fixedText + sizeof fixedText - 1), fixedCRC);
+    check("dynamic code block", std::vector<uint8_t>(std::begin(dynamicStream), std::end(dynamicStream)),
+        GetDynamicText(), dynamicCRC);
+
+    std::vector<uint8_t> longOutput;
+    auto longStream = MakeLongStream(longOutput);
+    check("long stream", longStream, longOutput, UpdateCRC(0, longOutput.data(), longOutput.size()));
+
+    checkRejected("invalid block type", { 0x07 }, 0, 0);
+    checkRejected("truncated stream", std::vector<uint8_t>(stored.begin(), stored.begin() + 10), storedCRC,
+        storedOutput.size());
+    auto badLength = stored;
+    badLength[3] ^= 1;
+    checkRejected("stored block with a bad length check", badLength, storedCRC, storedOutput.size());
+    checkRejected("stream with the wrong CRC", stored, storedCRC ^ 1, storedOutput.size());
+    checkRejected("stream with the wrong size", stored, storedCRC, storedOutput.size() + 1);
+
+    BitWriter badDistance;
+    badDistance.Put(1, 1);
+    badDistance.Put(1, 2);
+    badDistance.PutFixedSymbol('R');
+    badDistance.PutFixedSymbol(257);        // length 3
+    badDistance.PutCode(1, 5);              // distance 2 - before the start of the output
+    badDistance.PutFixedSymbol(256);
+    checkRejected("copy from before the start", badDistance.Finish(), 0, 4);
+
+    if (errors == 0)
+    {
+        os << "Zip inflate self test passed\n";
+    }
+    else
+    {
+        os << "Zip inflate self test FAILED with " << errors << " mismatches\n";
+    }
+    return errors == 0;
+}
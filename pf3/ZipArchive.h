@@ -0,0 +1,71 @@
+#pragma once
+
+// ZipArchive - read the members of a zip archive (such as an RJIS distribution) without unpacking it to disk. The
+// archive is memory mapped and members are inflated as they are read. Only stored and deflated members are supported,
+// and not zip64 or encryption.
+//
+// A member of an archive can be given anywhere a filename is expected as archive|member (see SourceReader) - the '|'
+// cannot appear in a Windows filename.
+class ZipArchive
+{
+public:
+    struct Member
+    {
+        std::string name;               // the name in the archive, including any folders
+        uint16_t method;                // 0 = stored, 8 = deflated
+        uint32_t crc;
+        uint64_t compressedSize;
+        uint64_t size;
+        uint64_t headerOffset;          // of the local file header
+        bool supported;                 // false if encrypted, zip64 or compressed other than by deflate
+    };
+
+private:
+    std::string filename_;
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+    const uint8_t* base_ = nullptr;
+    uint64_t size_ = 0;
+    std::vector<Member> members_;
+
+    void ReadCentralDirectory();
+    const uint8_t* GetMemberData(const Member& member) const;
+    void Close();
+
+public:
+    explicit ZipArchive(const std::string& filename);
+    ~ZipArchive();
+    ZipArchive(const ZipArchive&) = delete;
+    ZipArchive& operator=(const ZipArchive&) = delete;
+
+    const std::vector<Member>& GetMembers() const
+    {
+        return members_;
+    }
+
+    // find a member by name (not case sensitive) - returns null if there is no such member:
+    const Member* FindMember(const std::string& name) const;
+
+    // read a member line by line, calling f for each line. A deflated member is inflated on another thread so that
+    // inflating the next block overlaps processing the lines of this one. The CRC of the member is checked:
+    void ReadLines(const Member& member, std::function<void(std::string)> f) const;
+
+    static const char memberSeparator = '|';
+
+    static bool IsMemberPath(const std::string& path)
+    {
+        return path.find(memberSeparator) != std::string::npos;
+    }
+
+    static std::string MakeMemberPath(const std::string& archive, const std::string& member)
+    {
+        return archive + memberSeparator + member;
+    }
+
+    // read a member given as archive|member - returns the size of the member:
+    static uint64_t ReadMemberLines(const std::string& path, std::function<void(std::string)> f);
+
+    // inflate deflate streams with stored, fixed and dynamic blocks and some corrupt ones, checking the output or that
+    // they are rejected. Returns true if all is as expected:
+    static bool SelfTest(std::ostream& os);
+};
@@ -33,6 +33,7 @@ namespace Config
     {
         std::set<std::string> argset_;
         std::vector<std::string> arglist_;
+        std::string adminToken_;
 
         // private default and copy constructors:
         Config() = default;
@@ -97,6 +98,21 @@ namespace Config
             return argset_.find(argname) != argset_.end();
         }
 
+        //----------------------------------------------------------------------------
+        //
+        // Name: GetAdminToken
+        //
+        // Description: return the token a caller on another device must send in the
+        //              X-PF-Admin-Token header to use the /PFADMIN URIs. Empty if
+        //              there is no admin element in the config file - the admin URIs
+        //              are then only answered for callers on this device.
+        //
+        //----------------------------------------------------------------------------
+        std::string GetAdminToken() const
+        {
+            return adminToken_;
+        }
+
         //----------------------------------------------------------------------------
         //
         // Name: Read
@@ -150,6 +166,12 @@ namespace Config
 
                 }
 
+                auto pAdmin = configData->FirstChildElement("admin");
+                if (pAdmin != nullptr)
+                {
+                    adminToken_ = TixmlUtil::GetStringAttribute(pAdmin, "token");
+                }
+
             }
         }
     };
@@ -1,17 +1,22 @@
 #pragma once
 #include <ams/fileutils.h>
 #include <ams/semqueue.h>
+#include "SourceReader.h"
 
 extern std::string g_workingDirectory;
 extern std::map<SOCKET, std::vector<std::string>> sockmap;
 
-// reader is either ams::FileReader or ams::FastFileReader
+// the files waiting to be read by the reader threads:
 class FileReaderQueue
 {
 public:
     class EndThreadException {};
 private:
-    SemQueue<ams::FastLineReader, EndThreadException> queue_;
+    SemQueue<SourceReader, EndThreadException> queue_;
+
+    // errors for files that could not be read, by the event of the file:
+    SRWLOCK failuresLock_ = SRWLOCK_INIT;
+    std::map<HANDLE, std::string> failures_;
 
     FileReaderQueue(FileReaderQueue&) = delete;
     FileReaderQueue() : queue_(100) {}
@@ -32,15 +37,39 @@ public:
         queue_.Stop();
     }
 
-    ams::FastLineReader Remove()
+    SourceReader Remove()
     {
         return queue_.Remove();
     }
 
-    void Add(ams::FastLineReader&& reader)
+    void Add(SourceReader&& reader)
     {
         queue_.Add(std::move(reader));
     }
+
+    // record that the file with the event given could not be read - the reader thread does this before it sets the
+    // event so that whoever is waiting for the file can tell that it failed:
+    void AddFailure(HANDLE event, std::string message)
+    {
+        AcquireSRWLockExclusive(&failuresLock_);
+        failures_[event] = message;
+        ReleaseSRWLockExclusive(&failuresLock_);
+    }
+
+    // remove and return the error recorded for the file with the event given - an empty string if the file was read:
+    std::string TakeFailure(HANDLE event)
+    {
+        std::string result;
+        AcquireSRWLockExclusive(&failuresLock_);
+        auto p = failures_.find(event);
+        if (p != failures_.end())
+        {
+            result = p->second;
+            failures_.erase(p);
+        }
+        ReleaseSRWLockExclusive(&failuresLock_);
+        return result;
+    }
 };
 
 #pragma pack(push, 1)